@@ -52,6 +52,19 @@ namespace leetCrypto {
 }
 #endif
 
+#include <thread>
+#include <atomic>
+#include <deque>
+#include <condition_variable>
+#include <optional>
+#include <variant>
+#include <type_traits>
+#include <shared_mutex>
+#include <unordered_map>
+#include <list>
+#include <future>
+#include "net/Request.hpp"
+
 /* The main namespace, most functions and variables will be contained in this. */
 namespace leet {
     enum {
@@ -102,6 +115,12 @@ namespace leet {
         LEET_ERROR_NOT_OUR_MESSAGE,
         LEET_ERROR_WRONG_MESSAGE_TYPE,
         LEET_ERROR_WRONG_MESSAGE_ALGORITHM,
+
+        /* Request types */
+        LEET_REQUEST_GET,
+        LEET_REQUEST_POST,
+        LEET_REQUEST_PUT,
+        LEET_REQUEST_DELETE,
     };
 
     namespace User {
@@ -182,6 +201,148 @@ namespace leet {
                 std::string avatarURL{}; // His avatar mxc:// URL
                 std::vector<User::Device> Devices{}; // All of his devices
         }; /* https://spec.matrix.org/v1.8/client-server-api/#profiles */
+
+        /**
+         * @brief Class which represents users whose devices have changed between two sync tokens.
+         */
+        class DeviceListChanges {
+            private:
+            public:
+                std::vector<std::string> Changed{}; // Users whose devices have changed, or who now share an encrypted room with us
+                std::vector<std::string> Left{}; // Users who no longer share an encrypted room with us
+        }; /* https://spec.matrix.org/v1.8/client-server-api/#get_matrixclientv3keyschanges */
+
+        /**
+         * @brief Cache of the devices of other users, so that their keys only have to be queried again when they change.
+         *
+         * If it is set as the deviceCache of the active client, returnUsersInRoom() and returnDevicesFromUser()
+         * only query users which aren't cached or have been marked as changed. returnSync() and SyncEngine mark
+         * users using the device_lists section of each sync. If the cache was last updated with another sync token
+         * than the one a sync was made with, for example because it was loaded from cacheFile after a restart,
+         * the changes in between are asked for with returnDeviceListChanges() instead.
+         */
+        class DeviceCache {
+            private:
+                /**
+                 * @brief Class that represents the cached devices of a single user
+                 */
+                class Entry {
+                    private:
+                    public:
+                        std::vector<Device> Devices{};
+                        bool Stale{false}; // The devices have changed since they were queried
+                        std::uint64_t changedAt{0}; // Generation the devices were last marked as changed at
+                };
+
+                std::mutex cacheMutex{};
+                std::unordered_map<std::string, Entry> Users{};
+                std::string Token{}; // Sync token the cache has been kept up to date until
+                std::uint64_t Generation{0}; // Incremented each time devices are marked as changed
+                std::uint64_t uncachedChangedAt{0}; // Generation a user who wasn't cached last changed or left at
+                bool Loaded{false};
+
+                void loadFromFile();
+                void saveToFile();
+            public:
+                std::string cacheFile{}; // File to persist the cache to, empty to only keep it in memory
+
+                /**
+                 * @brief  Find the devices of a user.
+                 * @param  userID The user.
+                 * @return Returns the devices, or std::nullopt if the user isn't cached or his devices have changed.
+                 */
+                std::optional<std::vector<Device>> findDevices(const std::string& userID);
+                /**
+                 * @brief  Get the current generation, to be passed to addDevices() once a query has returned.
+                 * @return Returns the generation.
+                 */
+                std::uint64_t returnGeneration();
+                /**
+                 * @brief  Add devices which have just been queried.
+                 *
+                 * Users whose devices have been marked as changed since queriedAt are added but stay stale,
+                 * since the query may have been answered before the change.
+                 *
+                 * @param  userDevices Devices by user ID.
+                 * @param  queriedAt Return value of returnGeneration() from before the query was made.
+                 */
+                void addDevices(const std::map<std::string, std::vector<Device>>& userDevices, const std::uint64_t queriedAt);
+                /**
+                 * @brief  Mark users whose devices have changed and forget users who have left.
+                 * @param  Changes The users, as found in a sync response or returned by returnDeviceListChanges().
+                 * @param  nextToken The sync token the cache is up to date until after this.
+                 */
+                void update(const DeviceListChanges& Changes, const std::string& nextToken);
+                /**
+                 * @brief  Mark all cached users as changed, used when it is unknown whose devices have changed.
+                 * @param  nextToken The sync token the cache is up to date until after this.
+                 */
+                void invalidate(const std::string& nextToken);
+                /**
+                 * @brief  Get the sync token the cache has been kept up to date until.
+                 * @return Returns the token, or an empty string if the cache has never been updated.
+                 */
+                std::string returnToken();
+                /**
+                 * @brief  Forget all users.
+                 */
+                void clear();
+        };
+
+        /**
+         * @brief Cache of display names and avatars, which keeps the most recently used profiles.
+         *
+         * If it is set as the profileCache of the active client, getUserData() only asks the server for
+         * profiles which aren't cached or are older than maxAge. Member events received by returnSync() and
+         * SyncEngine and the members returned by returnUsersInRoom() refresh the profiles without a request.
+         */
+        class ProfileCache {
+            private:
+                /**
+                 * @brief Class that represents a cached profile
+                 */
+                class Entry {
+                    private:
+                    public:
+                        Profile userProfile{}; // Without devices
+                        std::chrono::steady_clock::time_point Added{};
+                };
+
+                std::mutex cacheMutex{};
+                std::list<Entry> Entries{}; // Most recently used first
+                std::unordered_map<std::string, std::list<Entry>::iterator> Index{}; // User ID -> entry
+
+                void insert(const Profile& userProfile);
+            public:
+                std::size_t maxSize{10000}; // The least recently used profiles are forgotten beyond this
+                std::chrono::milliseconds maxAge{600000}; // Profiles older than this are asked for again
+
+                /**
+                 * @brief  Find the profile of a user.
+                 * @param  userID The user.
+                 * @return Returns the profile without devices, or std::nullopt if it isn't cached or is too old.
+                 */
+                std::optional<Profile> findProfile(const std::string& userID);
+                /**
+                 * @brief  Add or refresh the profile of a user.
+                 * @param  userProfile The profile, devices are not kept.
+                 */
+                void addProfile(const Profile& userProfile);
+                /**
+                 * @brief  Add or refresh the profiles of many users at once.
+                 * @param  userProfiles The profiles, devices are not kept.
+                 */
+                void addProfiles(const std::vector<Profile>& userProfiles);
+                /**
+                 * @brief  Forget the profile of a user.
+                 * @param  userID The user.
+                 */
+                void removeProfile(const std::string& userID);
+                /**
+                 * @brief  Forget all profiles.
+                 */
+                void clear();
+        };
     }
 
     namespace VOIP {
@@ -248,6 +409,77 @@ namespace leet {
                 std::string roomType{}; // Room type
                 std::vector<leet::Room::Room> Rooms{}; // Rooms in the space
         };
+
+        /**
+         * @brief Class containing settings for walking the hierarchy of a space
+         */
+        class HierarchyConfiguration {
+            private:
+            public:
+                int maxDepth{-1}; // How many levels of sub-spaces to descend into, -1 for no limit
+                bool suggestedOnly{false}; // Only include rooms and spaces which are marked as suggested
+                int pageSize{50}; // Rooms asked for per request
+                int maxRooms{0}; // Stop descending once this many rooms have been found, 0 for no limit
+        };
+
+        /**
+         * @brief Class which represents a space along with every space below it.
+         */
+        class Hierarchy {
+            private:
+            public:
+                std::string spaceID{}; // The space the hierarchy starts at
+                std::map<std::string, Space> Spaces{}; // Each space that was walked by space ID, with its direct children in Rooms
+                bool Complete{true}; // False if part of the hierarchy could not be fetched
+        }; /* https://spec.matrix.org/v1.8/client-server-api/#get_matrixclientv1roomsroomidhierarchy */
+
+        /**
+         * @brief Cache of spaces and their direct children, so that walking a hierarchy again only fetches what has changed.
+         *
+         * If it is set as the hierarchyCache of the active client, returnHierarchy(), returnRoomsInSpace() and
+         * returnSpaces() only fetch spaces which aren't cached or are older than maxAge. A space is forgotten when
+         * returnSync() or SyncEngine see one of its m.space.child events change.
+         */
+        class HierarchyCache {
+            private:
+                /**
+                 * @brief Class that represents a cached space
+                 */
+                class Entry {
+                    private:
+                    public:
+                        Space theSpace{};
+                        std::chrono::steady_clock::time_point Fetched{};
+                };
+
+                std::mutex cacheMutex{};
+                std::map<std::string, Entry> Spaces{}; // <space ID>/<suggested only> -> space
+            public:
+                std::chrono::milliseconds maxAge{300000}; // Spaces older than this are fetched again
+
+                /**
+                 * @brief  Find a space and its direct children.
+                 * @param  spaceID The space.
+                 * @param  suggestedOnly Whether the children were limited to suggested ones.
+                 * @return Returns the space, or std::nullopt if it isn't cached or is too old.
+                 */
+                std::optional<Space> findSpace(const std::string& spaceID, const bool suggestedOnly);
+                /**
+                 * @brief  Add a space which has just been fetched.
+                 * @param  theSpace The space, with all of its direct children in Rooms.
+                 * @param  suggestedOnly Whether the children were limited to suggested ones.
+                 */
+                void addSpace(const Space& theSpace, const bool suggestedOnly);
+                /**
+                 * @brief  Forget a space, so that it is fetched again the next time.
+                 * @param  spaceID The space.
+                 */
+                void removeSpace(const std::string& spaceID);
+                /**
+                 * @brief  Forget all spaces.
+                 */
+                void clear();
+        };
     }
 
     namespace Attachment {
@@ -282,8 +514,52 @@ namespace leet {
     }
 
     namespace Filter {
+        /**
+         * @brief Filter for events which don't belong to a room, such as presence and account data.
+         *
+         * Lists which are not set are left out of the filter. Note that an empty list that is set matches nothing.
+         */
+        class EventFilter {
+            private:
+            public:
+                int Limit{0}; // Max number of events to return, 0 for the server default
+                std::optional<std::vector<std::string>> Types{}; // Event types to include, '*' can be used as a wildcard
+                std::optional<std::vector<std::string>> notTypes{}; // Event types to exclude
+                std::optional<std::vector<std::string>> Senders{}; // Senders to include
+                std::optional<std::vector<std::string>> notSenders{}; // Senders to exclude
+        };
+        /**
+         * @brief Filter for room events, also used for room state.
+         */
+        class RoomEventFilter : public EventFilter {
+            private:
+            public:
+                std::optional<std::vector<std::string>> Rooms{}; // Rooms to include
+                std::optional<std::vector<std::string>> notRooms{}; // Rooms to exclude
+                std::optional<bool> containsURL{}; // If set, only include events with (true) or without (false) a URL
+                bool lazyLoadMembers{false}; // Only send member events for senders of the returned events
+                bool includeRedundantMembers{false}; // Send member events again even if the client should already have them, requires lazyLoadMembers
+                bool unreadThreadNotifications{false}; // Report unread notifications per thread
+        };
+        /**
+         * @brief Filter for everything in the rooms section of a sync.
+         */
+        class RoomFilter {
+            private:
+            public:
+                RoomEventFilter Timeline{}; // Filter for the timeline
+                RoomEventFilter State{}; // Filter for the state
+                RoomEventFilter Ephemeral{}; // Filter for typing notifications and receipts
+                RoomEventFilter accountData{}; // Filter for per-room account data
+                std::optional<std::vector<std::string>> Rooms{}; // Rooms to include
+                std::optional<std::vector<std::string>> notRooms{}; // Rooms to exclude
+                bool includeLeave{false}; // Include rooms the user has left
+        };
         /**
          * @brief Filter configuration, can be used to generate a filter which can be used to find an event ID by functions that make use of it.
+         *
+         * The fields at the top are shorthands which apply to several parts of the filter. Anything set in Presence,
+         * accountData or Room takes precedence over them.
          */
         class FilterConfiguration {
             private:
@@ -294,6 +570,12 @@ namespace leet {
                 std::vector<std::string> Rooms{}; // Rooms to include
                 std::vector<std::string> Fields = { "type", "content", "sender" }; // Vector of fields
                 int Limit{0}; // Max number of events to return
+                bool lazyLoadMembers{false}; // Lazy load members in both the state and the timeline
+
+                std::string eventFormat{"client"}; // "client" or "federation"
+                EventFilter Presence{}; // Filter for presence events
+                EventFilter accountData{}; // Filter for global account data
+                RoomFilter Room{}; // Filter for room events
         };
 
         /**
@@ -304,8 +586,160 @@ namespace leet {
             public:
                 std::string filterID{}; // Filter ID returned from endpoint
         };
+
+        /**
+         * @brief Cache of filters which have already been uploaded, so that an identical filter gets the same filter ID.
+         *
+         * Filters are keyed by user ID and a hash of the filter JSON. If cacheFile is set, the cache is loaded from it
+         * on first use and saved to it whenever it changes, so that filter IDs survive restarts.
+         */
+        class FilterCache {
+            private:
+                /**
+                 * @brief Class that represents a cached filter
+                 */
+                class Entry {
+                    private:
+                    public:
+                        std::string filterJSON{}; // The filter that was uploaded, compared to rule out hash collisions
+                        std::string filterID{}; // Filter ID returned from endpoint
+                };
+
+                std::mutex cacheMutex{};
+                std::map<std::string, Entry> Filters{}; // <user ID>/<hash> -> filter
+                bool Loaded{false};
+
+                void loadFromFile();
+                void saveToFile();
+            public:
+                std::string cacheFile{}; // File to persist the cache to, empty to only keep it in memory
+
+                /**
+                 * @brief  Find the filter ID of a filter uploaded earlier.
+                 * @param  userID The user the filter was uploaded for.
+                 * @param  filterJSON The filter, as serialized JSON.
+                 * @return Returns the filter ID, or an empty string if the filter hasn't been uploaded.
+                 */
+                std::string findFilter(const std::string& userID, const std::string& filterJSON);
+                /**
+                 * @brief  Add an uploaded filter to the cache.
+                 * @param  userID The user the filter was uploaded for.
+                 * @param  filterJSON The filter, as serialized JSON.
+                 * @param  filterID The filter ID returned by the server.
+                 */
+                void addFilter(const std::string& userID, const std::string& filterJSON, const std::string& filterID);
+                /**
+                 * @brief  Remove a filter the server no longer knows about.
+                 * @param  userID The user the filter was uploaded for.
+                 * @param  filterID The filter ID to remove.
+                 */
+                void removeFilter(const std::string& userID, const std::string& filterID);
+                /**
+                 * @brief  Remove all filters from the cache.
+                 */
+                void clear();
+        };
+    }
+
+    namespace Batch {
+        /**
+         * @brief Class which represents a single request in a batch.
+         */
+        class Request {
+            private:
+            public:
+                int Type{LEET_REQUEST_GET}; // Request type
+                std::string URL{}; // Full URL, usually returned by leet::getAPI()
+                std::string Body{}; // Body to send, ignored for LEET_REQUEST_GET and LEET_REQUEST_DELETE
+                std::string Authentication{}; // Access token, leave empty to make an unauthenticated request
+        };
+
+        /**
+         * @brief Class which represents the result of a single request in a batch.
+         *
+         * The errors are stored here instead of in leet::errorCode, leet::Error and leet::friendlyError
+         * so that requests running at the same time do not overwrite each other's errors.
+         */
+        class Result {
+            private:
+            public:
+                int statusCode{0}; // HTTP status code, 0 if the request could not be made at all
+                std::string Body{}; // Response body
+                int errorCode{0}; // 0 if the request succeeded, otherwise 1
+                std::string Error{}; // Error code returned by the server (i.e. M_UNKNOWN)
+                std::string friendlyError{}; // Human readable error
+        };
     }
 
+    /**
+     * @brief  Class which represents a failed API call
+     */
+    class APIError {
+        private:
+        public:
+            int statusCode{0}; // HTTP status code, 0 if the request never got a response
+            int leetError{LEET_ERROR_NONE}; // libleet specific error
+            std::string Error{}; // Error code returned by the server (i.e. M_LIMIT_EXCEEDED)
+            std::string friendlyError{}; // Human readable error returned by the server
+            std::chrono::milliseconds retryAfter{0}; // How long the server asked the client to wait before trying again, 0 if it did not say
+
+            /**
+             * @brief  Check if the call may succeed if it is made again
+             * @return Returns true for network errors, rate limiting and server errors.
+             */
+            bool isRetryable() const {
+                return statusCode == 0 || statusCode == 429 || statusCode >= 500;
+            }
+    };
+
+    /**
+     * @brief  Class which holds either the value returned by an API call or the error it failed with
+     *
+     * Nothing is allocated for the error unless the call actually failed.
+     */
+    template <typename T> class Result {
+        private:
+            std::variant<T, APIError> Value;
+        public:
+            Result(T theValue) : Value(std::in_place_index<0>, std::move(theValue)) {}
+            Result(APIError theError) : Value(std::in_place_index<1>, std::move(theError)) {}
+
+            bool hasValue() const { return Value.index() == 0; }
+            explicit operator bool() const { return hasValue(); }
+
+            /**
+             * @brief  Get the value. Must only be called if hasValue() returns true.
+             */
+            T& value() { return std::get<0>(Value); }
+            const T& value() const { return std::get<0>(Value); }
+            /**
+             * @brief  Get the error. Must only be called if hasValue() returns false.
+             */
+            const APIError& error() const { return std::get<1>(Value); }
+            /**
+             * @brief  Get the value, or Default if the call failed
+             */
+            T valueOr(T Default) const { return hasValue() ? std::get<0>(Value) : std::move(Default); }
+    };
+
+    /**
+     * @brief  Result of an API call which does not return anything
+     */
+    template <> class Result<void> {
+        private:
+            std::optional<APIError> Failure{};
+        public:
+            Result() = default;
+            Result(APIError theError) : Failure(std::move(theError)) {}
+
+            bool hasValue() const { return !Failure.has_value(); }
+            explicit operator bool() const { return hasValue(); }
+
+            const APIError& error() const { return *Failure; }
+    };
+
+    class Client; // Defined after the namespaces
+
     namespace Sync {
         /**
          * @brief Class that represents a user event.
@@ -331,6 +765,22 @@ namespace leet {
                 std::string Inviter{};
                 std::string stateKey{};
         };
+        /**
+         * @brief Class that represents a single event in a room, received through sync.
+         */
+        class RoomEvent {
+            private:
+            public:
+                std::string eventID{}; // Event ID, empty for ephemeral and account data events
+                std::string Type{}; // Event type, such as "m.room.message"
+                std::string Sender{}; // User who sent the event
+                std::string stateKey{}; // State key, only meaningful if isState is true
+                bool isState{false}; // True if the event has a state key
+                int64_t originServerTS{}; // Time stamp of the event on the origin server
+                int64_t Age{}; // Time since the event occured
+                std::string eventContent{}; // Event contents in JSON format
+                std::string Redacts{}; // Event removed by this one, only set for m.room.redaction events
+        };
         /**
          * @brief Class that represents a room event.
          */
@@ -357,66 +807,588 @@ namespace leet {
                         bool Encrypted{false}; // encrypted bool
                 };
                 /**
-                 * @brief Class that represents a join event.
+                 * @brief Class that represents a join event.
+                 */
+                class JoinEvent {
+                    private:
+                    public:
+                        std::string roomID{}; // room the events belong to
+                        std::vector<RoomEvent> Timeline{}; // new events, oldest first
+                        bool Limited{false}; // true if there were more events than the timeline could fit
+                        std::string prevBatch{}; // token for getting the events before the timeline
+                        std::vector<RoomEvent> State{}; // state changes up to the start of the timeline
+                        std::vector<RoomEvent> Ephemeral{}; // typing notifications and receipts
+                        std::vector<RoomEvent> accountData{}; // account data for this room
+                        int highlightCount{}; // unread highlighted events
+                        int notificationCount{}; // unread notifying events
+                };
+                /**
+                 * @brief Class that represents a knock event.
+                 */
+                class KnockEvent {
+                    private:
+                    public:
+                        std::string roomID{}; // room knocked on
+                        std::vector<RoomEvent> State{}; // stripped state of the room
+                };
+                /**
+                 * @brief Class that represents a leave event.
+                 */
+                class LeaveEvent {
+                    private:
+                    public:
+                        std::string roomID{}; // room left
+                        std::vector<RoomEvent> Timeline{}; // events up to leaving
+                        bool Limited{false};
+                        std::string prevBatch{};
+                        std::vector<RoomEvent> State{};
+                        std::vector<RoomEvent> accountData{};
+                };
+
+                std::vector<InviteEvent> inviteEvents{};
+                std::vector<JoinEvent> joinEvents{};
+                std::vector<KnockEvent> knockEvents{};
+                std::vector<LeaveEvent> leaveEvents{};
+        };
+        /**
+         * @brief Class that represents a Megolm session sent in the room */
+        class MegolmSession {
+            private:
+            public:
+                std::string Algorithm{};
+                std::string cipherText{};
+                int cipherType{};
+                std::string senderKey{};
+                std::string Sender{};
+                std::string Type{};
+        };
+        /**
+         * @brief Class containing objects of all the other classes in leet::Sync
+         */
+        class Sync {
+            private:
+            public:
+                UserEvents userEvents{};
+                NameEvents nameEvents{};
+                RoomEvents roomEvents{};
+                std::vector<MegolmSession> megolmSessions{};
+                User::DeviceListChanges deviceLists{}; // Users whose devices have changed
+                std::string nextBatch{};
+                std::string theRequest{};
+        };
+
+        /**
+         * @brief Class which keeps the current state of rooms, as received through sync.
+         *
+         * Give it every sync response with update(). If it is set as the stateStore of the active client,
+         * returnRoom(), getStateFromType() and returnUsersInRoom() answer from it instead of asking the
+         * server, as long as all state of the room has been received and a sync has been applied within maxAge.
+         * returnSync() and SyncEngine update the store of their client by themselves.
+         */
+        class RoomStateStore {
+            private:
+                /**
+                 * @brief Class that represents the state of a single room
+                 */
+                class RoomState {
+                    private:
+                    public:
+                        std::map<std::pair<std::string, std::string>, RoomEvent> State{}; // (type, state key) -> latest state event
+                        std::map<std::string, User::Profile> Members{}; // Joined members by user ID
+                        Room::Room Summary{}; // Kept up to date as the state changes
+                        bool Complete{false}; // All state of the room has been received, not just changes
+                };
+
+                mutable std::shared_mutex storeMutex{};
+                std::unordered_map<std::string, RoomState> Rooms{};
+                std::chrono::steady_clock::time_point lastUpdate{};
+                bool Initialized{false}; // A full state sync has been applied, so rooms seen for the first time after it are newly joined
+
+                void applyEvent(RoomState& theRoom, const RoomEvent& theEvent);
+                const RoomState* findFreshRoom(const std::string& roomID) const;
+            public:
+                std::chrono::milliseconds maxAge{120000}; // The state is not used if no sync has been applied for this long
+
+                /**
+                 * @brief  Apply the state changes in a sync response.
+                 * @param  sync The sync response.
+                 * @param  fullState True if the response contains all state of the joined rooms, i.e. it is an initial sync or full_state was set.
+                 * @param  Filtered True if the sync filter leaves out state events or lazy loads members, in which case the state is never considered complete.
+                 */
+                void update(const Sync& sync, const bool fullState, const bool Filtered = false);
+                /**
+                 * @brief  Check if a room can be answered from the store.
+                 * @param  roomID The room.
+                 * @return Returns true if all state of the room is known and recent.
+                 */
+                bool isFresh(const std::string& roomID) const;
+                /**
+                 * @brief  Find a state event.
+                 * @param  roomID The room.
+                 * @param  Type The event type.
+                 * @param  stateKey The state key.
+                 * @return Returns the event, or std::nullopt if the room is not fresh or has no such state.
+                 */
+                std::optional<RoomEvent> findState(const std::string& roomID, const std::string& Type, const std::string& stateKey) const;
+                /**
+                 * @brief  Get the summary of a room, like returnRoom() does.
+                 * @param  roomID The room.
+                 * @return Returns the room, or std::nullopt if the room is not fresh.
+                 */
+                std::optional<Room::Room> findRoom(const std::string& roomID) const;
+                /**
+                 * @brief  Get the joined members of a room.
+                 * @param  roomID The room.
+                 * @return Returns the members without devices, or std::nullopt if the room is not fresh.
+                 */
+                std::optional<std::vector<User::Profile>> findMembers(const std::string& roomID) const;
+                /**
+                 * @brief  Forget a room.
+                 * @param  roomID The room.
+                 */
+                void removeRoom(const std::string& roomID);
+                /**
+                 * @brief  Forget all rooms.
+                 */
+                void clear();
+        };
+
+        /**
+         * @brief Class containing settings for a sync call
+         */
+        class SyncConfiguration {
+            private:
+            public:
+                std::string Since{};
+                leet::Filter::Filter Filter{};
+                std::optional<leet::Filter::FilterConfiguration> filterConfiguration{}; // Filter sent along with the request, only used if Filter has no ID
+                bool fullState{false};
+                int Presence{LEET_PRESENCE_OFFLINE};
+                int Timeout{30000};
+                leetRequest::CancellationToken cancellationToken{}; // Token which can be used to stop the sync from another thread
+        };
+
+        /**
+         * @brief Class that represents a single event received through sync, passed to SyncEngine callbacks.
+         */
+        class SyncEvent {
+            private:
+            public:
+                std::string roomID{}; // Room the event belongs to, empty for events that don't belong to a room
+                std::string Membership{}; // "join", "invite", "knock" or "leave" for room events
+                std::string Section{}; // Where in the sync response the event was found, such as "timeline", "state", "ephemeral", "account_data", "to_device" or "presence"
+                std::string Type{}; // Event type, such as "m.room.message"
+                std::string eventContent{}; // The whole event in JSON format
+        };
+
+        /**
+         * @brief Lock-free ring buffer for exactly one producer thread and one consumer thread.
+         */
+        template <typename T> class RingBuffer {
+            private:
+                std::vector<T> Items{};
+                std::size_t Mask{};
+                alignas(64) std::atomic<std::size_t> Head{0}; // Next item to pop, only written by the consumer
+                alignas(64) std::atomic<std::size_t> Tail{0}; // Next slot to push to, only written by the producer
+            public:
+                /**
+                 * @param  Capacity Number of items the buffer can hold, rounded up to a power of two.
+                 */
+                explicit RingBuffer(const std::size_t Capacity) {
+                    std::size_t Size{2};
+
+                    while (Size < Capacity) {
+                        Size <<= 1;
+                    }
+
+                    Items.resize(Size);
+                    Mask = Size - 1;
+                }
+                /**
+                 * @brief  Push an item. Only call this from the producer thread.
+                 * @param  Item The item, which is moved from only if it was pushed.
+                 * @return Returns false if the buffer is full.
+                 */
+                bool push(T& Item) {
+                    const std::size_t theTail = Tail.load(std::memory_order_relaxed);
+
+                    if (theTail - Head.load(std::memory_order_acquire) > Mask) {
+                        return false;
+                    }
+
+                    Items[theTail & Mask] = std::move(Item);
+                    Tail.store(theTail + 1, std::memory_order_release);
+
+                    return true;
+                }
+                /**
+                 * @brief  Pop an item. Only call this from the consumer thread.
+                 * @param  Item Set to the popped item.
+                 * @return Returns false if the buffer is empty.
+                 */
+                bool pop(T& Item) {
+                    const std::size_t theHead = Head.load(std::memory_order_relaxed);
+
+                    if (theHead == Tail.load(std::memory_order_acquire)) {
+                        return false;
+                    }
+
+                    Item = std::move(Items[theHead & Mask]);
+                    Head.store(theHead + 1, std::memory_order_release);
+
+                    return true;
+                }
+                /**
+                 * @brief  Check if the buffer is empty.
+                 * @return Returns true if there is nothing to pop.
+                 */
+                bool empty() const {
+                    return Head.load(std::memory_order_acquire) == Tail.load(std::memory_order_acquire);
+                }
+        };
+
+        /**
+         * @brief Class which hands events to a pool of worker threads, keeping the order of events within each room.
+         *
+         * Events are sharded by room ID, each shard having its own worker thread and ring buffer. Events which
+         * don't belong to a room all go to the same shard. If a shard is full, dispatch() waits until its worker
+         * has caught up, which slows down whatever is producing the events. Workers with nothing to do block
+         * until an event is pushed to their shard. Each worker calls the handler with a copy of the client which
+         * was active on the thread that created the dispatcher.
+         *
+         * dispatch() must only be called from one thread at a time.
+         */
+        class EventDispatcher {
+            private:
+                /**
+                 * @brief Class that represents a shard and its worker thread
+                 */
+                class Shard {
+                    private:
+                    public:
+                        RingBuffer<SyncEvent> Queue;
+                        std::atomic<std::uint64_t> Pushed{0}; // Number of events pushed to the shard
+                        std::atomic<std::uint64_t> Handled{0}; // Number of events the handler has returned from
+                        std::atomic<bool> Sleeping{false}; // The worker has found the queue empty and is waiting for notEmpty
+                        std::mutex waitMutex{};
+                        std::condition_variable notEmpty{};
+                        std::thread Worker{};
+
+                        explicit Shard(const std::size_t Capacity) : Queue(Capacity) {}
+                };
+
+                std::vector<std::unique_ptr<Shard>> Shards{};
+                std::function<void(const SyncEvent&)> Handler{};
+                std::atomic<bool> Running{true};
+                std::shared_ptr<Client> workerClient{}; // Copy of the client active on the thread which created the dispatcher, each worker uses a copy of its own
+
+                void workerLoop(Shard& theShard);
+            public:
+                /**
+                 * @param  Threads Number of worker threads, at least one is used.
+                 * @param  Capacity Number of events each shard can hold before dispatch() waits.
+                 * @param  theHandler Function called with each event, from the worker threads.
+                 */
+                EventDispatcher(const std::size_t Threads, const std::size_t Capacity, std::function<void(const SyncEvent&)> theHandler);
+                ~EventDispatcher();
+
+                /**
+                 * @brief  Queue an event for the shard its room belongs to, waiting if the shard is full.
+                 * @param  theEvent The event to queue.
+                 */
+                void dispatch(SyncEvent& theEvent);
+                /**
+                 * @brief  Get the number of events pushed to each shard so far, for use with isHandled().
+                 * @return Returns a vector with the count for each shard.
+                 */
+                std::vector<std::uint64_t> returnPushed() const;
+                /**
+                 * @brief  Check if all events up to a point returned by returnPushed() have been handled.
+                 * @param  Marks Return value of returnPushed().
+                 * @return Returns true if the handler has returned for all of those events.
+                 */
+                bool isHandled(const std::vector<std::uint64_t>& Marks) const;
+                /**
+                 * @brief  Handle all queued events and stop the worker threads.
+                 */
+                void stop();
+        };
+
+        /**
+         * @brief Class which runs a sync loop in the background and passes what it receives to callbacks.
+         *
+         * Two threads are used. One long-polls the server and starts the next request as soon as
+         * a response has been received, and the other parses the responses and calls the callbacks.
+         * Time spent in callbacks therefore does not delay the next sync.
+         *
+         * Callbacks are called from the dispatch thread, and must not call stop() themselves. If dispatchThreads
+         * is set, event callbacks are instead called from a pool of threads through an EventDispatcher, in order
+         * within each room.
+         *
+         * Each thread uses a copy of the client which was active when start() was called, so that client may be
+         * changed or destroyed while the engine runs. Callbacks which send events should set transactionIDs on it
+         * beforehand, since the copies don't share transID.
+         */
+        class SyncEngine {
+            private:
+                /**
+                 * @brief Class that represents a registered event callback
                  */
-                class JoinEvent {
+                class EventCallback {
                     private:
                     public:
+                        int ID{};
+                        std::string Type{}; // Empty matches every event type
+                        std::string roomID{}; // Empty matches every room
+                        std::function<void(const SyncEvent&)> Function{};
                 };
                 /**
-                 * @brief Class that represents a knock event.
+                 * @brief Class that represents a sync response waiting to be dispatched
                  */
-                class KnockEvent {
+                class PendingSync {
                     private:
                     public:
+                        std::string Body{};
+                        std::string nextBatch{};
+                        bool fullState{false}; // The response contains all state, see RoomStateStore::update()
+                        std::string Since{}; // Token the sync was made with
                 };
+
+                std::mutex callbackMutex{};
+                std::shared_ptr<const std::vector<EventCallback>> eventCallbacks{std::make_shared<std::vector<EventCallback>>()}; // Replaced, not modified, so it can be read without holding the lock
+                std::map<int, std::function<void(const Sync&)>> syncCallbacks{};
+                std::function<void(const int, const std::string&)> errorCallback{};
+                int nextID{0};
+
+                std::mutex queueMutex{};
+                std::condition_variable queueCondition{};
+                std::deque<PendingSync> Pending{};
+                std::string Since{}; // Token of the last response which has been dispatched
+
+                std::thread fetchThread{};
+                std::thread dispatchThread{};
+                std::atomic<bool> Running{false};
+                leetRequest::CancellationToken cancellationToken{};
+
+                std::shared_ptr<Client> theClient{}; // Copy of the client active on the thread which called start(), each sync thread uses a copy of its own
+                std::unique_ptr<EventDispatcher> Dispatcher{};
+                std::deque<std::pair<std::string, std::vector<std::uint64_t>>> unhandledTokens{}; // Tokens waiting for the dispatcher to handle their events
+
+                void fetchLoop();
+                void dispatchLoop();
+                void dispatch(const PendingSync& theSync);
+                void callEventCallbacks(const SyncEvent& theEvent);
+                void saveSince(const std::string& theSince);
+                void saveHandledSince();
+            public:
+                User::CredentialsResponse Credentials{}; // Account to sync
+                SyncConfiguration Configuration{}; // Configuration for the first sync. Since is set to the last handled token by stop(), so start() continues from there.
+                std::string sinceFile{}; // File the since token is saved to after each dispatched response, and loaded from by start()
+                std::size_t maxPending{4}; // Number of received responses which may wait for dispatch before the fetch thread waits too
+                std::chrono::milliseconds minimumBackoff{1000}; // Time to wait after the first failed request
+                std::chrono::milliseconds maximumBackoff{60000}; // Backoff is doubled for each failed request up to this
+                std::size_t dispatchThreads{0}; // Threads to call event callbacks from, 0 to call them from the dispatch thread
+                std::size_t dispatchQueueSize{1024}; // Events each dispatch thread can have queued before the sync loop waits
+
+                SyncEngine(const User::CredentialsResponse& resp, const SyncConfiguration& conf) : Credentials(resp), Configuration(conf) {}
+                ~SyncEngine();
+
                 /**
-                 * @brief Class that represents a leave event.
+                 * @brief  Register a function to be called for each event matching a type and room.
+                 * @param  Type Event type to match, or an empty string for all event types.
+                 * @param  roomID Room ID to match, or an empty string for all rooms.
+                 * @param  Function The function to call.
+                 * @return Returns an ID which can be passed to removeCallback().
                  */
-                class LeaveEvent {
+                int addEventCallback(const std::string& Type, const std::string& roomID, std::function<void(const SyncEvent&)> Function);
+                /**
+                 * @brief  Register a function to be called with each parsed sync response.
+                 * @param  Function The function to call.
+                 * @return Returns an ID which can be passed to removeCallback().
+                 */
+                int addSyncCallback(std::function<void(const Sync&)> Function);
+                /**
+                 * @brief  Set a function to be called when a sync request fails.
+                 * @param  Function The function to call, given the HTTP status code (0 for network errors) and the response body.
+                 */
+                void setErrorCallback(std::function<void(const int, const std::string&)> Function);
+                /**
+                 * @brief  Remove a callback registered with addEventCallback() or addSyncCallback().
+                 * @param  ID The ID returned when the callback was added.
+                 */
+                void removeCallback(const int ID);
+                /**
+                 * @brief  Start syncing in the background. If sinceFile exists and Configuration.Since is empty, syncing resumes from the saved token.
+                 */
+                void start();
+                /**
+                 * @brief  Stop syncing, cancelling the request in progress, and wait for the threads to exit.
+                 */
+                void stop();
+                /**
+                 * @brief  Check if the engine is running. It stops by itself if the access token is rejected.
+                 * @return Returns true if the engine is running.
+                 */
+                bool isRunning() const;
+                /**
+                 * @brief  Get the since token of the last dispatched response, which syncing can be resumed from.
+                 * @return Returns the since token.
+                 */
+                std::string returnSince();
+        };
+
+        /**
+         * @brief Class which runs the sync loops of many accounts on a single thread.
+         *
+         * Each account only needs its credentials, configuration and since token, and the accounts
+         * share the connections of one leetRequest::AsyncClient. Callbacks are called from the
+         * thread running run(), so anything slow should be handed off, for example to an EventDispatcher.
+         */
+        class SyncMultiplexer {
+            private:
+                /**
+                 * @brief Class that represents an account being synced
+                 */
+                class Account {
                     private:
                     public:
+                        int ID{};
+                        std::string Homeserver{}; // Homeserver of the account, for example https://matrix.org
+                        User::CredentialsResponse Credentials{};
+                        SyncConfiguration Configuration{}; // Since is updated after each response
+                        std::function<void(const Sync&)> Callback{};
+                        std::function<void(const int, const std::string&)> errorCallback{};
+                        std::chrono::milliseconds Backoff{0};
+                        bool Removed{false};
                 };
 
-                std::vector<InviteEvent> inviteEvents{};
+                leetRequest::AsyncClient asyncClient{};
+                std::mutex accountMutex{};
+                std::map<int, std::shared_ptr<Account>> Accounts{};
+                int nextID{0};
+
+                void poll(std::shared_ptr<Account> theAccount);
+                void handleResponse(std::shared_ptr<Account> theAccount, const leetRequest::Response& response);
+            public:
+                std::chrono::milliseconds minimumBackoff{1000}; // Time to wait after the first failed request
+                std::chrono::milliseconds maximumBackoff{60000}; // Backoff is doubled for each failed request up to this
+
+                ~SyncMultiplexer();
+
+                /**
+                 * @brief  Add an account and start syncing it. The account starts syncing once run() is called if it is not running yet.
+                 * @param  Homeserver The homeserver of the account, for example https://matrix.org
+                 * @param  resp The credentials of the account.
+                 * @param  conf Configuration for the first sync. Since is updated automatically after that.
+                 * @param  Callback Function called with each parsed sync response.
+                 * @param  errorCallback Function called when a sync request fails, given the HTTP status code (0 for network errors) and the response body.
+                 * @return Returns an ID which can be passed to removeAccount() and returnSince().
+                 */
+                int addAccount(const std::string& Homeserver, const User::CredentialsResponse& resp, const SyncConfiguration& conf,
+                        std::function<void(const Sync&)> Callback, std::function<void(const int, const std::string&)> errorCallback = nullptr);
+                /**
+                 * @brief  Stop syncing an account, cancelling its request in progress.
+                 * @param  ID The ID returned by addAccount().
+                 */
+                void removeAccount(const int ID);
+                /**
+                 * @brief  Get the since token of the last response received for an account.
+                 * @param  ID The ID returned by addAccount().
+                 * @return Returns the since token, or an empty string if there is no such account.
+                 */
+                std::string returnSince(const int ID);
+                /**
+                 * @brief  Sync the accounts until stop() is called. Only one thread may call this at a time.
+                 */
+                void run();
+                /**
+                 * @brief  Make run() return. The accounts are kept, and continue syncing if run() is called again.
+                 */
+                void stop();
         };
+
         /**
-         * @brief Class that represents a Megolm session sent in the room */
-        class MegolmSession {
+         * @brief Class that represents a room list in a sliding sync request.
+         */
+        class SlidingList {
             private:
             public:
-                std::string Algorithm{};
-                std::string cipherText{};
-                int cipherType{};
-                std::string senderKey{};
-                std::string Sender{};
-                std::string Type{};
+                std::vector<std::pair<int, int>> Ranges{ { 0, 19 } }; // Windows into the sorted room list, both ends inclusive
+                std::vector<std::pair<std::string, std::string>> requiredState{}; // Event type and state key pairs to send for each room, "*" matches anything and "$LAZY" lazy loads members
+                int timelineLimit{1}; // Max number of timeline events to send for each room
+                std::optional<bool> isDM{}; // If set, only include rooms which are (true) or are not (false) direct messages
+                std::optional<bool> isInvite{}; // If set, only include rooms which are (true) or are not (false) invites
         };
         /**
-         * @brief Class containing objects of all the other classes in leet::Sync
+         * @brief Class that represents a subscription to a single room in a sliding sync request.
          */
-        class Sync {
+        class RoomSubscription {
             private:
             public:
-                UserEvents userEvents{};
-                NameEvents nameEvents{};
-                RoomEvents roomEvents{};
-                std::vector<MegolmSession> megolmSessions{};
-                std::string nextBatch{};
-                std::string theRequest{};
+                std::vector<std::pair<std::string, std::string>> requiredState{}; // Event type and state key pairs to send
+                int timelineLimit{20}; // Max number of timeline events to send
         };
-
         /**
-         * @brief Class containing settings for a sync call
+         * @brief Class containing settings for a sliding sync call
+         *
+         * Sliding sync (MSC4186) only sends the rooms in the requested windows, so a client can show something
+         * before the state of every room has been downloaded.
          */
-        class SyncConfiguration {
+        class SlidingSyncConfiguration {
             private:
             public:
-                std::string Since{};
-                leet::Filter::Filter Filter{};
-                bool fullState{false};
-                int Presence{LEET_PRESENCE_OFFLINE};
-                int Timeout{30000};
+                std::string connectionID{}; // Identifies the connection if a client runs several at the same time
+                std::string Position{}; // Position returned by the previous call, empty for the first call
+                int Timeout{30000}; // How long the server may wait for something to happen
+                std::map<std::string, SlidingList> Lists{}; // Room lists by name
+                std::map<std::string, RoomSubscription> roomSubscriptions{}; // Room subscriptions by room ID
+
+                bool toDevice{false}; // Enable the to-device extension
+                std::string toDeviceSince{}; // Since token of the to-device extension, returned in SlidingSync::toDeviceNextBatch
+                bool accountData{false}; // Enable the account data extension
+                bool Typing{false}; // Enable the typing extension
+                bool Receipts{false}; // Enable the receipts extension
+
+                leetRequest::CancellationToken cancellationToken{}; // Token which can be used to stop the sync from another thread
+        };
+        /**
+         * @brief Class that represents a room in a sliding sync response. Only fields the server sent are set.
+         */
+        class SlidingRoom {
+            private:
+            public:
+                std::string roomID{};
+                std::string Name{}; // Room name, or a name calculated by the server
+                std::string avatarURL{};
+                bool Initial{false}; // True if this is the first time the room has been sent, in which case everything is included
+                bool isDM{false};
+                bool Limited{false}; // True if there were more events than the timeline could fit
+                std::string prevBatch{}; // Token for getting the events before the timeline
+                int64_t bumpStamp{}; // Used by the server to sort rooms
+                int joinedCount{};
+                int invitedCount{};
+                int notificationCount{};
+                int highlightCount{};
+                int numLive{}; // Number of timeline events that are new, rather than history
+                std::vector<RoomEvent> requiredState{};
+                std::vector<RoomEvent> Timeline{};
+                std::vector<RoomEvent> inviteState{};
+        };
+        /**
+         * @brief Class containing a sliding sync response
+         */
+        class SlidingSync {
+            private:
+            public:
+                std::string Position{}; // Position to pass in the next call
+                std::map<std::string, int> listCounts{}; // Total number of rooms in each list
+                std::vector<SlidingRoom> Rooms{}; // Rooms which have changed
+                std::vector<MegolmSession> megolmSessions{};
+                std::string toDeviceNextBatch{};
+                std::vector<RoomEvent> accountData{}; // Global account data
+                std::map<std::string, std::vector<std::string>> typingUsers{}; // Users typing in each room where it has changed, if the typing extension is enabled
+                std::map<std::string, RoomEvent> Receipts{}; // New m.receipt event of each room, if the receipts extension is enabled
+                std::string theRequest{};
         };
     }
 
@@ -474,15 +1446,516 @@ namespace leet {
                 int bodyType{LEET_BODYTYPE_BASIC};
                 int msgType{LEET_MESSAGETYPE_STRING};
         };
+
+        /**
+         * @brief Class which keeps every room event seen on disk, so that history which has already been seen doesn't have to be fetched again.
+         *
+         * Events are appended to log files in Directory, which are split into segments of segmentSize bytes. An index
+         * of fixed size records, memory mapped where the platform allows it, points at them by room and position and by
+         * event ID. Each room has a run of events known to be without gaps which ends at the newest event.
+         *
+         * If it is set as the eventStore of the active client, returnSync() and SyncEngine add the timeline of each
+         * sync, returnMessages() adds what it fetches and answers from the run instead of the server when the run is
+         * long enough and a sync has been stored within maxAge. The sync token is kept in the index, so that after a
+         * restart the runs are kept if sync continues from where it left off.
+         */
+        class EventStore {
+            private:
+                class Storage; // Defined in libleet.cpp
+
+                mutable std::mutex storeMutex{};
+                std::unique_ptr<Storage> theStorage{};
+                std::chrono::steady_clock::time_point lastUpdate{};
+            public:
+                std::uint64_t segmentSize{64 * 1024 * 1024}; // A new log file is started once the current one is this large
+                std::chrono::milliseconds maxAge{120000}; // History is only answered from the store if a sync has been stored within this long
+
+                EventStore();
+                ~EventStore();
+
+                EventStore(const EventStore&) = delete;
+                EventStore& operator=(const EventStore&) = delete;
+
+                /**
+                 * @brief  Open the store in a directory, creating it if it does not exist.
+                 * @param  Directory Directory for the log files and the index.
+                 * @return Returns false if the store could not be opened.
+                 */
+                bool open(const std::string& Directory);
+                /**
+                 * @brief  Close the store. Nothing is stored or found until it is opened again.
+                 */
+                void close();
+                /**
+                 * @brief  Store the timeline of each room in a sync response.
+                 *
+                 * A sync whose timeline is filtered, or made with a filter ID the configuration doesn't describe, leaves
+                 * events out, so nothing is stored and every run starts over with the next unfiltered sync.
+                 *
+                 * @param  sync The sync response.
+                 * @param  conf The configuration the sync was made with. If Since isn't the token of the last stored sync, events may have been missed, so every run starts over.
+                 */
+                void update(const Sync::Sync& sync, const Sync::SyncConfiguration& conf);
+                /**
+                 * @brief  Store events returned by /messages, starting at the newest event in the room.
+                 * @param  roomID The room.
+                 * @param  Events The events in JSON format, newest first.
+                 */
+                void addMessages(const std::string& roomID, const std::vector<std::string>& Events);
+                /**
+                 * @brief  Find the newest events of a room.
+                 * @param  roomID The room.
+                 * @param  Count Number of events.
+                 * @return Returns the events in JSON format, newest first, or std::nullopt if the store doesn't know the last Count events for certain.
+                 */
+                std::optional<std::vector<std::string>> findLatestEvents(const std::string& roomID, const std::size_t Count);
+                /**
+                 * @brief  Find an event by its ID.
+                 * @param  eventID The event ID.
+                 * @return Returns the event in JSON format, or std::nullopt if it has not been stored.
+                 */
+                std::optional<std::string> findEvent(const std::string& eventID);
+        };
+
+        /**
+         * @brief Class which represents a page of room history.
+         */
+        class MessagePage {
+            private:
+            public:
+                std::vector<Message> Messages{}; // Messages in the order they were returned, newest first when paging backwards
+                std::string Start{}; // Token the page starts at
+                std::string End{}; // Token the next page starts at, empty if there are no more events in this direction
+        };
+
+        /**
+         * @brief Class which pages through the history of a room, keeping the token between pages.
+         *
+         * Each call to next() returns the page after the one returned before it. If prefetch is set, the
+         * following page is requested on another thread as soon as a page has been returned, so that it has
+         * usually arrived by the time the caller has worked through the current one.
+         *
+         * Requests are made through a copy of the client which was active on the thread that created the paginator.
+         * Changes to the public members apply from the page after the one being prefetched.
+         */
+        class Paginator {
+            private:
+                std::shared_ptr<Client> theClient{}; // Copy of the client active on the thread which created the paginator
+                std::string From{}; // Token the next page starts at
+                bool Finished{false}; // The last page has been returned
+                std::future<Result<MessagePage>> Prefetched{}; // Page being fetched in the background
+
+                void requestPage();
+            public:
+                User::CredentialsResponse Credentials{}; // Account to read history with
+                std::string roomID{}; // Room to read history from
+                bool Direction{false}; // true to page forward from older to newer events, false to page backwards like returnMessages()
+                int pageSize{50}; // Number of events to request per page
+                std::string To{}; // Token to stop at, empty to page until there are no more events
+                Filter::RoomEventFilter filter{}; // Filter to apply to the events
+                bool prefetch{true}; // Whether the next page should be requested in the background
+
+                /**
+                 * @brief  Start paging through the history of a room.
+                 * @param  resp CredentialsResponse object, required for authentication.
+                 * @param  room The room.
+                 * @param  Direction true to page forward, false to page backwards.
+                 * @param  From Token to start at, for example one returned by returnToken() or a prev_batch token from sync. Empty to start at the newest event when paging backwards, or the oldest when paging forward.
+                 */
+                Paginator(const User::CredentialsResponse& resp, const Room::Room& room, const bool Direction = false, const std::string& From = "");
+                ~Paginator();
+
+                Paginator(const Paginator&) = delete;
+                Paginator& operator=(const Paginator&) = delete;
+
+                /**
+                 * @brief  Get the next page of messages.
+                 * @return Returns the messages, or an empty vector if there are no more or the request failed. If it failed, errorCode is set and the next call requests the same page again. A page may also be empty while more follow, so use hasMore() to tell when to stop.
+                 */
+                std::vector<Message> next();
+                /**
+                 * @brief  Check if there may be more pages.
+                 * @return Returns false once the server has said there are no more events in this direction.
+                 */
+                bool hasMore() const;
+                /**
+                 * @brief  Get the token the next page starts at, which can be saved to continue from later.
+                 * @return Returns the token, or an empty string if paging hasn't started or has finished.
+                 */
+                std::string returnToken() const;
+        };
+
+        /**
+         * @brief Class which pulls the complete history of many rooms at once.
+         *
+         * Rooms are paged through with /messages by a pool of threads, Concurrency pages being requested at
+         * once across all rooms, and no more than requestsPerSecond requests being started. Every room which
+         * hasn't been finished waits its turn after each page, so that large rooms don't hold up the others.
+         *
+         * Each page is handed to the sink, after which the token the room continues from is written to
+         * checkpointFile. A backfill which is stopped or crashes continues from there when it is started again,
+         * so a page may be handed to the sink twice, but never skipped. Rooms are paged from the newest event
+         * at the time they are first requested, newer events being left to sync.
+         *
+         * Failed requests are made again after a backoff, or after the wait the server asked for if it was rate
+         * limited. After maxAttempts failures in a row the room is given up on and the error callback is called.
+         * Requests the server refuses outright, such as for rooms the account isn't in, are not made again.
+         *
+         * Requests are made through a copy of the client which was active when start() was called, each getting
+         * state of its own from Client::call().
+         *
+         * The public members must not be changed while the backfill is running.
+         */
+        class Backfill {
+            private:
+                /**
+                 * @brief Class that represents how far a room has been backfilled
+                 */
+                class Progress {
+                    private:
+                    public:
+                        std::string Token{}; // Token the next page starts at, empty if no page has been requested yet
+                        bool Finished{false}; // There are no more events
+                        bool Failed{false}; // The room was given up on
+                        std::size_t Attempts{0}; // Failed requests in a row
+                        std::chrono::steady_clock::time_point retryAt{}; // The room must not be requested again before this
+                };
+
+                std::mutex backfillMutex{};
+                std::condition_variable backfillCondition{};
+                std::map<std::string, Progress> Rooms{};
+                std::deque<std::string> Queue{}; // Rooms waiting for their next page, in the order they will be requested
+                std::size_t Active{0}; // Rooms which are being requested
+                std::chrono::steady_clock::time_point pausedUntil{}; // No room is requested before this, set when the server rate limits
+
+                std::mutex checkpointMutex{};
+                std::chrono::steady_clock::time_point lastCheckpoint{};
+                bool Loaded{false};
+
+                std::mutex bucketMutex{};
+                leetRequest::TokenBucket Bucket{};
+
+                std::vector<std::thread> Workers{};
+                std::atomic<bool> Running{false};
+                std::shared_ptr<Client> theClient{}; // Copy of the client active on the thread which called start(), which the workers make their requests through
+
+                std::function<void(const std::string&, const std::vector<Message>&)> Sink{};
+                std::function<void(const std::string&, const APIError&)> errorCallback{};
+
+                void workerLoop();
+                void loadCheckpoint();
+                void saveCheckpoint(const bool Force);
+            public:
+                User::CredentialsResponse Credentials{}; // Account to read history with
+                std::string checkpointFile{}; // File progress is saved to and loaded from by start(), empty to not save progress
+                std::chrono::milliseconds checkpointInterval{1000}; // Progress is saved at most this often while running, 0 to save after every page
+                std::size_t Concurrency{8}; // Max number of pages requested at once
+                double requestsPerSecond{0}; // Max number of requests started per second, 0 means unlimited
+                double requestBurst{1}; // Number of requests which may be started at once before the rate limit kicks in
+                int pageSize{100}; // Number of events to request per page
+                bool Direction{false}; // true to page forward from the oldest event, false to page backwards from the newest
+                Filter::RoomEventFilter filter{}; // Filter to apply to the events
+                std::size_t maxAttempts{5}; // Failed requests in a row after which a room is given up on
+                std::chrono::milliseconds minimumBackoff{1000}; // Time to wait after the first failed request
+                std::chrono::milliseconds maximumBackoff{60000}; // Backoff is doubled for each failed request up to this
+
+                /**
+                 * @param  resp CredentialsResponse object, required for authentication.
+                 * @param  theSink Function called with the room ID and messages of each page. It is called from several threads at once, but never for the same room at once, and pages of a room are passed in order.
+                 */
+                Backfill(const User::CredentialsResponse& resp, std::function<void(const std::string&, const std::vector<Message>&)> theSink) : Sink(std::move(theSink)), Credentials(resp) {}
+                ~Backfill();
+
+                Backfill(const Backfill&) = delete;
+                Backfill& operator=(const Backfill&) = delete;
+
+                /**
+                 * @brief  Add a room to backfill. Rooms which are already known, including ones loaded from checkpointFile, are left as they are.
+                 * @param  roomID The room ID.
+                 */
+                void addRoom(const std::string& roomID);
+                /**
+                 * @brief  Add several rooms to backfill.
+                 * @param  rooms The rooms, for example from returnRoomIDs().
+                 */
+                void addRooms(const std::vector<Room::Room>& rooms);
+                /**
+                 * @brief  Set a function to be called when a room is given up on.
+                 * @param  Function The function to call with the room ID and the last error.
+                 */
+                void setErrorCallback(std::function<void(const std::string&, const APIError&)> Function);
+                /**
+                 * @brief  Load progress from checkpointFile and start the worker threads.
+                 */
+                void start();
+                /**
+                 * @brief  Stop the worker threads once the pages being requested have been handed to the sink, and save progress.
+                 */
+                void stop();
+                /**
+                 * @brief  Wait until every room has been backfilled or given up on.
+                 */
+                void wait();
+                /**
+                 * @brief  Get the number of rooms which have neither been backfilled nor given up on.
+                 * @return Returns the number of rooms.
+                 */
+                std::size_t returnRemaining();
+                /**
+                 * @brief  Get the rooms which have been given up on.
+                 * @return Returns the room IDs. They are requested again the next time the backfill is started.
+                 */
+                std::vector<std::string> returnFailedRooms();
+        };
     }
 
-    inline std::string Homeserver{"https://matrix.org"}; // Home server used to make API calls. This should be overridden once a home server has been determined.
-    inline std::string Error{}; // Error code returned by the server (i.e. M_UNKNOWN)
-    inline std::string friendlyError{}; // Human readable error code also returned by the server in most cases (i.e. Unknown error)
-    inline int leetError{LEET_ERROR_NONE}; // libleet specific error
-    inline int errorCode{0}; // Error code returned by libleet functions. If not set to 0, something went wrong.
-    inline int transID{0}; // Transaction ID. Should be loaded/saved for each session, and incremented for each event
-    inline int networkStatusCode{200}; // Status code returned by the last network request
+    #ifndef LEET_NO_ENCRYPTION
+    class Encryption;
+    #endif // #ifndef LEET_NO_ENCRYPTION
+
+    /**
+     * @brief  Class which hands out transaction IDs that are never used twice, even across restarts
+     *
+     * IDs are taken from an atomic counter, so any number of threads can send at once without
+     * locking. Whenever the counter runs past the reserved block, the end of the next block is
+     * written to the file and synced to disk before the ID is handed out. After a crash the
+     * counter continues from the end of the last reserved block, skipping the IDs that were
+     * reserved but not used.
+     */
+    class TransactionIDAllocator {
+        private:
+            std::atomic<std::int64_t> Next{0}; // Next ID to hand out
+            std::atomic<std::int64_t> Reserved{0}; // IDs below this have been reserved
+            std::mutex reserveMutex{};
+            std::string File{};
+
+            bool reserve(const std::int64_t ID);
+        public:
+            std::int64_t blockSize{4096}; // Number of IDs reserved with each write to the file
+
+            /**
+             * @brief  Continue from the IDs reserved in a file, creating it if it does not exist.
+             * @param  theFile Path to the file. Without a file, IDs are only unique within this process, starting at First.
+             * @param  First ID to start from if the file does not exist, for example returnUnixTimestamp() for a new device.
+             * @return Returns false if the file exists but could not be read.
+             */
+            bool open(const std::string& theFile, const std::int64_t First = 0);
+            /**
+             * @brief  Get a transaction ID which has not been handed out before.
+             * @return Returns the ID, or -1 if the next block could not be reserved on disk.
+             */
+            std::int64_t allocate();
+    };
+
+    /**
+     * @brief  Class which owns the state API calls read and write, such as the home server and the last error.
+     *
+     * The free functions use the client made active on the calling thread with Client::Scope,
+     * or leet::defaultClient if there is none. The methods below make the client active, call
+     * the free function of the same name and return what it returns, so each thread or account
+     * can have a client of its own without the calls racing each other.
+     */
+    class Client {
+        private:
+            static std::shared_ptr<TransactionIDAllocator> returnCallTransactionIDs();
+        public:
+            std::string Homeserver{"https://matrix.org"}; // Home server used to make API calls. This should be overridden once a home server has been determined.
+            std::string Error{}; // Error code returned by the server (i.e. M_UNKNOWN)
+            std::string friendlyError{}; // Human readable error code also returned by the server in most cases (i.e. Unknown error)
+            int leetError{LEET_ERROR_NONE}; // libleet specific error
+            int errorCode{0}; // Error code returned by libleet functions. If not set to 0, something went wrong.
+            int transID{0}; // Transaction ID. Should be loaded/saved for each session, and incremented for each event
+            int networkStatusCode{200}; // Status code returned by the last network request
+            std::chrono::milliseconds retryAfter{0}; // Wait the server asked for in the last response, if it was rate limited
+            std::shared_ptr<TransactionIDAllocator> transactionIDs{}; // If set, each sent event gets an ID of its own from here instead of using transID
+            std::shared_ptr<Sync::RoomStateStore> stateStore{}; // If set, room state is kept up to date by sync and read from here instead of the server
+            std::shared_ptr<User::DeviceCache> deviceCache{}; // If set, devices of other users are only queried when they aren't cached or have changed
+            std::shared_ptr<User::ProfileCache> profileCache{}; // If set, profiles are read from here and kept up to date by sync instead of asking the server every time
+            std::shared_ptr<Space::HierarchyCache> hierarchyCache{}; // If set, spaces which have been walked recently are not fetched again
+            std::shared_ptr<Event::EventStore> eventStore{}; // If set, room events are stored on disk and history is read from there when it can be
+
+            /**
+             * @brief  Class which makes a client the active one on the calling thread while it exists
+             */
+            class Scope {
+                private:
+                    Client* Previous{nullptr};
+                public:
+                    Scope(Client& theClient);
+                    ~Scope();
+
+                    Scope(const Scope&) = delete;
+                    Scope& operator=(const Scope&) = delete;
+            };
+
+            /**
+             * @brief  Make an API call and return its value or the error it failed with.
+             *
+             * The call gets a copy of this client with the error cleared, so calls made at the same time through
+             * the same client do not overwrite each other's errors. Unless transactionIDs is set, the copy gets its
+             * transaction IDs from an allocator shared by every call in the process, so events sent by calls made at
+             * the same time never share one. Those IDs start from the time in milliseconds, above any transID.
+             *
+             * @param  theFunction Function making the call, for example [&]() { return leet::returnRooms(resp, 10); }
+             * @return Returns a Result holding what theFunction returned, or an APIError if the call failed.
+             */
+            template <typename Function> auto call(Function&& theFunction) -> Result<std::invoke_result_t<Function&>> {
+                using T = std::invoke_result_t<Function&>;
+
+                Client theCall = *this;
+                theCall.Error.clear();
+                theCall.friendlyError.clear();
+                theCall.leetError = LEET_ERROR_NONE;
+                theCall.errorCode = 0;
+                theCall.networkStatusCode = 200;
+                theCall.retryAfter = std::chrono::milliseconds(0);
+
+                if (!theCall.transactionIDs) {
+                    theCall.transactionIDs = returnCallTransactionIDs();
+                }
+
+                Scope theScope(theCall);
+
+                auto returnError = [&]() -> std::optional<APIError> {
+                    if (theCall.errorCode == 0 && theCall.networkStatusCode >= 100 && theCall.networkStatusCode < 400) {
+                        return std::nullopt;
+                    }
+
+                    APIError theError{};
+                    theError.statusCode = theCall.networkStatusCode;
+                    theError.leetError = theCall.leetError;
+                    theError.Error = std::move(theCall.Error);
+                    theError.friendlyError = std::move(theCall.friendlyError);
+                    theError.retryAfter = theCall.retryAfter;
+
+                    return theError;
+                };
+
+                if constexpr (std::is_void_v<T>) {
+                    theFunction();
+
+                    if (auto theError = returnError()) {
+                        return Result<void>(std::move(*theError));
+                    }
+
+                    return Result<void>();
+                } else {
+                    T theValue = theFunction();
+
+                    if (auto theError = returnError()) {
+                        return Result<T>(std::move(*theError));
+                    }
+
+                    return Result<T>(std::move(theValue));
+                }
+            }
+
+            /**
+             * @brief  Make this client active and call the free function of the same name, documented further below.
+             *
+             * call() does the same for any free function, and returns the error as well.
+             */
+            int generateTransID();
+            bool saveTransID(const std::string& File);
+            bool loadTransID(const std::string& File);
+            bool setTransID(int id);
+            std::string returnServerDiscovery(const std::string& Server);
+            std::string returnHomeServerFromString(const std::string& userID);
+            std::vector<std::string> returnSupportedLoginTypes();
+            std::vector<std::string> returnSupportedSpecs();
+            int returnMaxUploadLimit(const User::CredentialsResponse& resp);
+            bool checkError();
+            User::CredentialsResponse registerAccount(const User::Credentials& cred);
+            bool checkRegistrationTokenValidity(const std::string& Token);
+            User::CredentialsResponse loginAccount(const User::Credentials& cred);
+            User::CredentialsResponse refreshAccessToken(User::CredentialsResponse& resp);
+            void invalidateAccessToken(const std::string& Token);
+            User::Profile getUserData(const User::CredentialsResponse& resp, const std::string& userID);
+            std::string getAPI(const std::string& API);
+            std::string invokeRequest_Get(const std::string& URL, const std::string& Authentication);
+            std::string invokeRequest_Delete(const std::string& URL, const std::string& Authentication);
+            std::string invokeRequest_Put(const std::string& URL, const std::string& Data, const std::string& Authentication);
+            std::string invokeRequest_Post(const std::string& URL, const std::string& Data, const std::string& Authentication);
+            std::string invokeRequest_Get(const std::string& URL);
+            std::string invokeRequest_Delete(const std::string& URL);
+            std::string invokeRequest_Put(const std::string& URL, const std::string& Data);
+            std::string invokeRequest_Post(const std::string& URL, const std::string& Data);
+            std::string invokeRequest_Post_File(const std::string& URL, const std::string& File);
+            std::string invokeRequest_Post_File(const std::string& URL, const std::string& File, const std::string& Authentication);
+            std::vector<Batch::Result> invokeBatch(const std::vector<Batch::Request>& requests, const int Concurrency);
+            Room::Room returnRoom(const User::CredentialsResponse& resp, const Room::Room& room);
+            Room::Room upgradeRoom(const User::CredentialsResponse& resp, const Room::Room& room, const int Version);
+            Room::Room createRoom(const User::CredentialsResponse& resp, const Room::RoomConfiguration& conf);
+            void joinRoom(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& Reason);
+            void leaveRoom(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& Reason);
+            void kickUserFromRoom(const User::CredentialsResponse& resp, const Room::Room& room, const User::Profile& profile, const std::string& Reason);
+            void banUserFromRoom(const User::CredentialsResponse& resp, const Room::Room& room, const User::Profile& profile, const std::string& Reason);
+            void unbanUserFromRoom(const User::CredentialsResponse& resp, const Room::Room& room, const User::Profile& profile, const std::string& Reason);
+            void inviteUserToRoom(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& Reason);
+            bool getVisibilityOfRoom(const User::CredentialsResponse& resp, const Room::Room& room);
+            void setVisibilityOfRoom(const User::CredentialsResponse& resp, const Room::Room& room, const bool Visibility);
+            std::vector<Room::Room> returnRooms(const User::CredentialsResponse& resp, const int Limit);
+            std::vector<Room::Room> returnRoomIDs(const User::CredentialsResponse& resp);
+            std::vector<std::string> findRoomAliases(const User::CredentialsResponse& resp, const std::string& roomID);
+            std::string findRoomID(const std::string& Alias);
+            bool removeRoomAlias(const User::CredentialsResponse& resp, const std::string& Alias);
+            std::vector<Space::Space> returnSpaces(const User::CredentialsResponse& resp, const int Limit);
+            const std::vector<Room::Room> returnRoomsInSpace(const User::CredentialsResponse& resp, const std::string& spaceID, const int Limit);
+            Space::Hierarchy returnHierarchy(const User::CredentialsResponse& resp, const std::string& spaceID, const Space::HierarchyConfiguration& conf);
+            std::string findUserID(const std::string& Alias, const std::string& Homeserver);
+            std::string returnUserName(const std::string& userID);
+            std::vector<User::Profile> returnUsersInRoom(const User::CredentialsResponse& resp, const Room::Room& room);
+            std::vector<User::Device> returnDevicesFromUser(const User::CredentialsResponse& resp, const std::vector<User::Profile>& user);
+            User::DeviceListChanges returnDeviceListChanges(const User::CredentialsResponse& resp, const std::string& From, const std::string& To);
+            bool checkIfUsernameIsAvailable(const std::string& Username);
+            void toggleTyping(const User::CredentialsResponse& resp, const int Timeout, const bool Typing, const Room::Room& room);
+            void setReadMarkerPosition(const User::CredentialsResponse& resp, const Room::Room& room,
+                const Event::Event& fullyReadEvent, const Event::Event& readEvent, const Event::Event& privateReadEvent);
+            void sendMessage(const User::CredentialsResponse& resp, const Room::Room& room, const Event::Message& msg);
+            std::vector<Event::Message> returnMessages(const User::CredentialsResponse& resp, const Room::Room& room, const int messageCount);
+            std::vector<Event::Message> returnMessages(const User::CredentialsResponse& resp, const Room::Room& room, const int messageCount, const Filter::RoomEventFilter& filter);
+            Event::MessagePage returnMessagePage(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& From, const std::string& To, const bool Direction, const int Limit, const Filter::RoomEventFilter& filter);
+            Filter::Filter returnFilter(const User::CredentialsResponse& resp, const Filter::FilterConfiguration& filter);
+            Attachment::Attachment uploadFile(const User::CredentialsResponse& resp, const std::string& File);
+            bool downloadFile(const User::CredentialsResponse& resp, const Attachment::Attachment& Attachment, const std::string& outputFile);
+            URL::URLPreview getURLPreview(const User::CredentialsResponse& resp, const std::string& URL, const int64_t time);
+            std::string decodeFile(const User::CredentialsResponse& resp, const Attachment::Attachment& Attachment);
+            Event::Event returnEventFromTimestamp(const User::CredentialsResponse& resp, const Room::Room& room, const int64_t Timestamp, const bool Direction);
+            Event::Event returnLatestEvent(const User::CredentialsResponse& resp, const Room::Room& room);
+            Event::Event getStateFromType(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& eventType, const std::string& stateKey);
+            Event::Event setStateFromType(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& eventType, const std::string& stateKey, const std::string& Body);
+            void redactEvent(const User::CredentialsResponse& resp, const Room::Room& room, const Event::Event& event, const std::string& Reason);
+            void reportEvent(const User::CredentialsResponse& resp, const Room::Room& room, const Event::Event& event, const std::string& Reason, const int Score);
+            Sync::Sync returnSync(const User::CredentialsResponse& resp, const Sync::SyncConfiguration& conf);
+            Sync::SlidingSync returnSlidingSync(const User::CredentialsResponse& resp, const Sync::SlidingSyncConfiguration& conf);
+            VOIP::Credentials returnTurnCredentials(const User::CredentialsResponse& resp);
+            #ifndef LEET_NO_ENCRYPTION
+            Encryption initEncryption();
+            Encryption initEncryptionFromPickle(const std::string& pickleKey, const std::string& pickleData);
+            Encryption uploadKeys(const User::CredentialsResponse& resp, Encryption& enc);
+            Encryption createSessionInRoom(const User::CredentialsResponse& resp, Encryption& enc, const Room::Room& room);
+            void sendEncryptedMessage(const User::CredentialsResponse& resp, Encryption& enc, const Room::Room& room, const Event::Message& msg);
+            #endif // #ifndef LEET_NO_ENCRYPTION
+    };
+
+    inline Client defaultClient{}; // Client used by API calls made without a client of their own
+
+    inline std::string& Homeserver = defaultClient.Homeserver; // Home server used to make API calls. This should be overridden once a home server has been determined.
+    inline std::string& Error = defaultClient.Error; // Error code returned by the server (i.e. M_UNKNOWN)
+    inline std::string& friendlyError = defaultClient.friendlyError; // Human readable error code also returned by the server in most cases (i.e. Unknown error)
+    inline int& leetError = defaultClient.leetError; // libleet specific error
+    inline int& errorCode = defaultClient.errorCode; // Error code returned by libleet functions. If not set to 0, something went wrong.
+    inline int& transID = defaultClient.transID; // Transaction ID. Should be loaded/saved for each session, and incremented for each event
+    inline int& networkStatusCode = defaultClient.networkStatusCode; // Status code returned by the last network request
+    inline Filter::FilterCache filterCache{}; // Filters uploaded by returnFilter()
+    inline int requestConcurrency{8}; // Max number of requests functions such as returnRooms() make at once
+    inline std::size_t keysQueryChunkSize{250}; // Max number of users asked about in a single /keys/query request
+
+    /**
+     * @brief  Get the client used by API calls made from the calling thread.
+     * @return Returns the client made active with Client::Scope, or leet::defaultClient if there is none.
+     */
+    Client& returnClient();
 
     /**
      * @brief  Generate a new transaction ID by simply incrementing the existing ID by 1.
@@ -497,6 +1970,9 @@ namespace leet {
      *
      * If you use an ID that has been used before, the action will be considered a duplicate by
      * the server, and most likely ignored.
+     *
+     * Programs sending from several threads should set Client::transactionIDs instead, which
+     * gives each sent event an ID of its own and takes care of saving it.
      */
     int generateTransID();
     /**
@@ -529,7 +2005,7 @@ namespace leet {
      * @param  id The transaction ID to use.
      * @return Boolean, true if it was successfully assigned, otherwise false is returned.
      */
-    bool constexpr setTransID(int id);
+    bool setTransID(int id);
 
     /**
      * @brief  Saves data to a file.
@@ -623,7 +2099,7 @@ namespace leet {
      * @param  API The Matrix endpoint to call.
      * @return The full API URL string.
      *
-     * Returns a full API URL from a Matrix endpoint. This uses the leet::Homeserver variable and the passed API.
+     * Returns a full API URL from a Matrix endpoint. This uses the Homeserver of the active client (see returnClient()) and the passed API.
      * In other words, it returns https://example.com/_matrix/... from the passed API (_matrix/...)
      */
     std::string getAPI(const std::string& API);
@@ -699,6 +2175,17 @@ namespace leet {
      * @return Returns the output from the request.
      */
     std::string invokeRequest_Post_File(const std::string& URL, const std::string& File, const std::string& Authentication);
+    /**
+     * @brief  Invokes several independent requests concurrently
+     * @param  requests The requests to make.
+     * @param  Concurrency Max number of requests to have in flight at once.
+     * @return Returns one result per request, in the same order as the requests were passed.
+     *
+     * Invokes several independent requests concurrently, reusing pooled connections where possible.
+     * This function does not touch leet::errorCode, leet::Error, leet::friendlyError or leet::networkStatusCode.
+     * Check the errorCode of each result instead.
+     */
+    std::vector<Batch::Result> invokeBatch(const std::vector<Batch::Request>& requests, const int Concurrency);
 
     /**
      * @brief  Gets information about a room based on a room ID.
@@ -785,8 +2272,11 @@ namespace leet {
     /**
      * @brief  Returns a vector of all rooms your user has joined.
      * @param  resp CredentialsResponse object, required for authentication.
-     * @param  Limit Max number of rooms to return.
+     * @param  Limit Max number of rooms to return, 0 or less to return all of them.
      * @return Returns a vector of all rooms your user has joined.
+     *
+     * Rooms known to the state store of the active client are answered from it. The rest are
+     * requested at the same time, up to leet::requestConcurrency at once.
      */
     std::vector<Room::Room> returnRooms(const User::CredentialsResponse& resp, const int Limit);
     /**
@@ -819,17 +2309,26 @@ namespace leet {
     /**
      * @brief  Returns a vector of all spaces your user has joined.
      * @param  resp CredentialsResponse object, required for authentication.
-     * @param  Limit Max number of spaces to return.
-     * @return Returns a vector of all spaces, along with all child rooms your user has joined.
+     * @param  Limit Max number of spaces to return, 0 or less for all of them.
+     * @return Returns a vector of all spaces, each with its direct children in Rooms.
      */
     std::vector<Space::Space> returnSpaces(const User::CredentialsResponse& resp, const int Limit);
     /**
-     * @brief  Returns a vector of all rooms in a space.
+     * @brief  Returns a vector of all rooms in a space, including the rooms in its sub-spaces.
      * @param  resp CredentialsResponse object, required for authentication.
      * @param  spaceID Space ID to get rooms from.
-     * @return Returns a vector of all rooms in the space.
+     * @param  Limit Max number of rooms to return, 0 or less for all of them.
+     * @return Returns a vector of all rooms in the space, starting with the space itself, closest rooms first.
      */
     const std::vector<Room::Room> returnRoomsInSpace(const User::CredentialsResponse& resp, const std::string& spaceID, const int Limit);
+    /**
+     * @brief  Walks the hierarchy of a space, following every page and fetching sub-spaces at the same time.
+     * @param  resp CredentialsResponse object, required for authentication.
+     * @param  spaceID Space ID to start at.
+     * @param  conf How deep to go and which rooms to include.
+     * @return Returns the space and every sub-space found, each with its direct children.
+     */
+    Space::Hierarchy returnHierarchy(const User::CredentialsResponse& resp, const std::string& spaceID, const Space::HierarchyConfiguration& conf);
 
     /**
      * @brief  Converts an incomplete user ID to a full user ID. (i.e. speedie is converted to @speedie:matrix.org)
@@ -860,6 +2359,15 @@ namespace leet {
      */
     std::vector<User::Device> returnDevicesFromUser(const User::CredentialsResponse& resp, const std::vector<User::Profile>& user);
 
+    /**
+     * @brief  Returns the users whose devices have changed between two sync tokens.
+     * @param  resp CredentialsResponse object, required for authentication.
+     * @param  From The sync token to start from, such as the since token of an earlier sync.
+     * @param  To The sync token to end at, such as the next_batch of the latest sync.
+     * @return Returns the users whose devices have changed and the users who have left.
+     */
+    User::DeviceListChanges returnDeviceListChanges(const User::CredentialsResponse& resp, const std::string& From, const std::string& To);
+
     /**
      * @brief  Returns a boolean for whether a username is available on the home server or not.
      * @param  Username String to check for.
@@ -902,6 +2410,27 @@ namespace leet {
      * @return Returns a Event::Message vector which represents the retrieved messages.
      */
     std::vector<Event::Message> returnMessages(const User::CredentialsResponse& resp, const Room::Room& room, const int messageCount);
+    /**
+     * @brief  Returns a Event::Message vector from a room.
+     * @param  resp CredentialsResponse object, required for authentication.
+     * @param  room Room object, room that the messages should be retrieved from.
+     * @param  messageCount Number of messages to retrieve from the room.
+     * @param  filter Filter to apply to the messages.
+     * @return Returns a Event::Message vector which represents the retrieved messages.
+     */
+    std::vector<Event::Message> returnMessages(const User::CredentialsResponse& resp, const Room::Room& room, const int messageCount, const Filter::RoomEventFilter& filter);
+    /**
+     * @brief  Returns a page of messages from a room, along with the token the next page starts at.
+     * @param  resp CredentialsResponse object, required for authentication.
+     * @param  room Room object, room that the messages should be retrieved from.
+     * @param  From Token to start at, or an empty string to start at the newest event when paging backwards, or the oldest when paging forward.
+     * @param  To Token to stop at, or an empty string to not stop until Limit messages have been returned.
+     * @param  Direction true to page forward, false to page backwards.
+     * @param  Limit Number of messages to retrieve.
+     * @param  filter Filter to apply to the messages.
+     * @return Returns a Event::MessagePage which represents the retrieved messages.
+     */
+    Event::MessagePage returnMessagePage(const User::CredentialsResponse& resp, const Room::Room& room, const std::string& From, const std::string& To, const bool Direction, const int Limit, const Filter::RoomEventFilter& filter);
 
     /**
      * @brief  Returns a filter ID which can be used when requesting data.
@@ -1009,6 +2538,14 @@ namespace leet {
      * @return Returns a Sync object with the fields.
      */
     Sync::Sync returnSync(const User::CredentialsResponse& resp, const Sync::SyncConfiguration& conf);
+    /**
+     * @brief  Get changes to the requested room lists and subscriptions using sliding sync.
+     * @param  resp CredentialsResponse object, required for authentication.
+     * @param  conf Sliding sync configuration. Position should be set to SlidingSync::Position from the previous call.
+     *         If the call fails with Error set to M_UNKNOWN_POS, the server has forgotten the position and Position must be reset.
+     * @return Returns a SlidingSync object with the fields.
+     */
+    Sync::SlidingSync returnSlidingSync(const User::CredentialsResponse& resp, const Sync::SlidingSyncConfiguration& conf);
 
     /**
      * @brief  Get TURN server credentials
@@ -7,6 +7,16 @@
  */
 
 #pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
 
 namespace leetRequest {
     enum { /* supported protocols */
@@ -19,6 +29,15 @@ namespace leetRequest {
         LEET_REQUEST_REQTYPE_PUT,
         LEET_REQUEST_REQTYPE_DELETE,
     };
+    enum { /* endpoint classes, used for traffic shaping */
+        LEET_REQUEST_CLASS_AUTO = -1, // Determine the class from the endpoint
+        LEET_REQUEST_CLASS_ANY, // Every request to a host, regardless of class
+        LEET_REQUEST_CLASS_OTHER,
+        LEET_REQUEST_CLASS_SEND,
+        LEET_REQUEST_CLASS_SYNC,
+        LEET_REQUEST_CLASS_MEDIA,
+        LEET_REQUEST_CLASS_KEYS,
+    };
     /**
      * @brief  Class representing a parsed URL
      */
@@ -50,6 +69,88 @@ namespace leetRequest {
         public:
             int statusCode{200};
             std::string Body{};
+            std::string networkError{}; // Set if the request could not be made, in which case statusCode is 0
+            std::string contentType{}; // Content-Type returned by the server
+            std::uint64_t bodySize{0}; // Number of body bytes received
+            bool Streamed{false}; // Whether the body was passed to the body consumer rather than stored in Body
+            bool timedOut{false}; // Whether the request failed because a deadline passed
+            bool Cancelled{false}; // Whether the request failed because it was cancelled
+    };
+    /**
+     * @brief  Class representing how long each phase of a request may take
+     *
+     * A value of zero means there is no deadline for that phase.
+     */
+    class Deadlines {
+        private:
+        public:
+            std::chrono::milliseconds connectTimeout{10000}; // Resolving the host and connecting to it
+            std::chrono::milliseconds handshakeTimeout{10000}; // The TLS handshake
+            std::chrono::milliseconds sendTimeout{120000}; // Writing the request, including the body
+            std::chrono::milliseconds headerTimeout{60000}; // Waiting for the response header after the request has been written
+            std::chrono::milliseconds bodyTimeout{60000}; // Waiting for each chunk of the response body
+    };
+    /**
+     * @brief  Class which can be used to cancel requests from another thread
+     *
+     * Copies of a token share the same state, so a copy can be given to a request
+     * while the original is kept around to call cancel() on. Once cancelled, a token
+     * stays cancelled, and any request using it fails immediately.
+     */
+    class CancellationToken {
+        private:
+            class State {
+                public:
+                    std::mutex stateMutex{};
+                    std::condition_variable cancelCondition{};
+                    bool Cancelled{false};
+                    int nextID{0};
+                    std::map<int, std::function<void()>> Callbacks{};
+            };
+
+            std::shared_ptr<State> state{std::make_shared<State>()};
+        public:
+            /**
+             * @brief  Cancel all requests using this token
+             */
+            void cancel();
+            /**
+             * @brief  Check if the token has been cancelled
+             * @return Returns true if cancel() has been called.
+             */
+            bool isCancelled() const;
+            /**
+             * @brief  Wait until the token is cancelled or a timeout has passed
+             * @param  Timeout How long to wait.
+             * @return Returns true if the token has been cancelled.
+             */
+            bool waitFor(const std::chrono::nanoseconds Timeout) const;
+            /**
+             * @brief  Register a function to be called when the token is cancelled
+             * @param  Callback The function to call. If the token has already been cancelled, it is called right away.
+             * @return Returns an ID which can be passed to unsubscribe().
+             */
+            int subscribe(std::function<void()> Callback);
+            /**
+             * @brief  Remove a function registered with subscribe()
+             * @param  ID The ID returned by subscribe().
+             */
+            void unsubscribe(const int ID);
+    };
+    /**
+     * @brief  Class representing the default limits for response bodies
+     *
+     * A response with a body larger than the limit is treated as a failed request.
+     * Bodies handed to a body consumer are subject to the same limits, but they are never
+     * held in memory as a whole.
+     */
+    class BodyLimits {
+        private:
+        public:
+            std::uint64_t jsonLimit{256ULL * 1024 * 1024}; // Limit for application/json responses
+            std::uint64_t mediaLimit{1024ULL * 1024 * 1024}; // Limit for responses from media endpoints
+            std::uint64_t defaultLimit{64ULL * 1024 * 1024}; // Limit for anything else
+            std::uint64_t streamThreshold{1024 * 1024}; // Bodies larger than this are passed to the body consumer, if there is one
     };
     /**
      * @brief  Class representing a network request
@@ -75,6 +176,21 @@ namespace leetRequest {
             std::string Filename{};
             std::string outputFile{};
 
+            int endpointClass{LEET_REQUEST_CLASS_AUTO}; // Traffic shaping class, see returnEndpointClass()
+
+            std::int64_t bodyLimit{-1}; // Max response body size in bytes, -1 means the limit from leetRequest::bodyLimits is used
+            std::int64_t streamThreshold{-1}; // Stream bodies larger than this to bodyConsumer, -1 means leetRequest::bodyLimits.streamThreshold is used
+            /* Called with each chunk of the body once the body has grown past the stream threshold.
+             * Return false to stop reading. If set, Response::Body will be empty for streamed responses unless keepStreamedBody is set.
+             */
+            std::function<bool(const char* Data, const std::size_t Length)> bodyConsumer{};
+            bool keepStreamedBody{false}; // Keep streamed bodies in Response::Body as well
+
+            Deadlines Timeouts; // Deadlines for each phase, defaults to leetRequest::defaultDeadlines
+            CancellationToken cancellationToken{}; // Token which can be used to cancel the request from another thread
+
+            Request();
+
             /**
              * @brief  Set an HTTP header
              * @param  Header The header to set
@@ -96,10 +212,215 @@ namespace leetRequest {
              * @return Returns a Response object
              */
             Response makeRequest();
+            /**
+             * @brief  Make a network request, reading the body while it is being received
+             * @param  Reader Function which reads the body from the stream it is given. It runs on another thread while the body is received.
+             * @return Returns a Response object. Body is empty unless keepStreamedBody is set.
+             */
+            Response makeRequest(const std::function<void(std::istream&)>& Reader);
             const bool downloadFile();
     };
 
+    /**
+     * @brief  Class representing a single token bucket
+     *
+     * Tokens are refilled continuously at Rate tokens per second, up to Burst tokens.
+     * The balance may go negative when more tokens are consumed than are available,
+     * in which case later reservations have to wait until the debt has been paid back.
+     */
+    class TokenBucket {
+        private:
+        public:
+            double Rate{0}; // Tokens added per second, 0 means unlimited
+            double Burst{0}; // Max number of tokens that can be saved up
+            double Tokens{0}; // Current balance
+            std::chrono::steady_clock::time_point lastRefill{};
+
+            /**
+             * @brief  Take tokens from the bucket
+             * @param  Count Number of tokens to take.
+             * @param  Now The current time.
+             * @return Returns how long the caller has to wait before the tokens are actually available.
+             */
+            std::chrono::nanoseconds reserve(const double Count, const std::chrono::steady_clock::time_point Now);
+    };
+    /**
+     * @brief  Class representing the limits for a host or an endpoint class
+     */
+    class TrafficLimit {
+        private:
+        public:
+            double requestsPerSecond{0}; // Max requests per second, 0 means unlimited
+            double requestBurst{1}; // Number of requests that may be made at once before the limit kicks in
+            double bytesPerSecond{0}; // Max bytes per second, 0 means unlimited
+            double byteBurst{65536}; // Number of bytes that may be transferred at once before the limit kicks in
+    };
+    /**
+     * @brief  Class which enforces traffic limits before requests are made
+     *
+     * Limits are set per host and per endpoint class. A request has to get past both the
+     * bucket for its class and the LEET_REQUEST_CLASS_ANY bucket for its host. An empty host
+     * applies the limit to every host, each host still getting its own buckets. Bytes of
+     * LEET_REQUEST_CLASS_MEDIA requests are only charged to the media bucket, so large
+     * downloads don't leave debt behind which other requests to the host have to wait for.
+     *
+     * Request bodies are charged before the request is made, response bodies are
+     * charged after they have been received.
+     */
+    class TrafficShaper {
+        private:
+            class Buckets {
+                public:
+                    TokenBucket Requests{};
+                    TokenBucket Bytes{};
+            };
+
+            std::mutex shaperMutex{};
+            std::map<std::string, TrafficLimit> Limits{};
+            std::map<std::string, Buckets> activeBuckets{};
+
+            Buckets* findBuckets(const std::string& Host, const int endpointClass);
+            void applyLimit(Buckets& buckets, const TrafficLimit& Limit);
+        public:
+            /**
+             * @brief  Set a limit for a host and endpoint class
+             * @param  Host The host to limit. An empty string applies the limit to all hosts.
+             * @param  endpointClass The endpoint class to limit, or LEET_REQUEST_CLASS_ANY to limit all requests.
+             * @param  Limit The limit to apply.
+             */
+            void setLimit(const std::string& Host, const int endpointClass, const TrafficLimit& Limit);
+            /**
+             * @brief  Remove all limits
+             */
+            void clearLimits();
+            /**
+             * @brief  Reserve capacity for a request
+             * @param  Host The host the request is made to.
+             * @param  endpointClass The endpoint class of the request.
+             * @param  Bytes Number of bytes that will be sent.
+             * @return Returns how long the caller has to wait before making the request.
+             */
+            std::chrono::nanoseconds reserve(const std::string& Host, const int endpointClass, const std::size_t Bytes);
+            /**
+             * @brief  Charge bytes which have been received
+             * @param  Host The host the response came from.
+             * @param  endpointClass The endpoint class of the request.
+             * @param  Bytes Number of bytes received.
+             */
+            void consume(const std::string& Host, const int endpointClass, const std::size_t Bytes);
+            /**
+             * @brief  Reserve capacity for a request and sleep until it is available
+             * @param  Host The host the request is made to.
+             * @param  endpointClass The endpoint class of the request.
+             * @param  Bytes Number of bytes that will be sent.
+             */
+            void waitFor(const std::string& Host, const int endpointClass, const std::size_t Bytes);
+            /**
+             * @brief  Reserve capacity for a request and wait until it is available or the token is cancelled
+             * @param  Host The host the request is made to.
+             * @param  endpointClass The endpoint class of the request.
+             * @param  Bytes Number of bytes that will be sent.
+             * @param  Token Token which stops the wait when cancelled. boost::system::system_error is thrown if it is.
+             */
+            void waitFor(const std::string& Host, const int endpointClass, const std::size_t Bytes, const CancellationToken& Token);
+    };
+
+    class Connection; // Defined in Request.cpp
+
+    /**
+     * @brief  Class which keeps connections open so that they can be reused by later requests
+     *
+     * Connections are returned to the pool after a response has been read, unless the
+     * server asked for the connection to be closed. Any number of connections may be
+     * in use at once, only the number of idle connections per host is limited.
+     */
+    class ConnectionPool {
+        private:
+            std::mutex poolMutex{};
+            std::map<std::string, std::vector<std::shared_ptr<Connection>>> idleConnections{};
+        public:
+            std::size_t maxIdlePerHost{16}; // Max number of idle connections to keep per host
+            std::chrono::seconds idleTimeout{30}; // Idle connections older than this are closed rather than reused
+
+            /**
+             * @brief  Take an idle connection from the pool
+             * @param  Host The host to connect to.
+             * @param  Port The port to connect to.
+             * @return Returns a connection, or nullptr if there is no idle connection to the host.
+             */
+            std::shared_ptr<Connection> acquire(const std::string& Host, const int Port);
+            /**
+             * @brief  Return a connection to the pool
+             * @param  connection The connection, which must not be in use anymore.
+             */
+            void release(std::shared_ptr<Connection> connection);
+            /**
+             * @brief  Close all idle connections
+             */
+            void clear();
+    };
+
+    class AsyncState; // Defined in Request.cpp
+
+    /**
+     * @brief  Class which makes requests asynchronously, all of them on the thread running its event loop
+     *
+     * Requests may be started from any thread, and are made over connections kept by the
+     * client itself. Response bodies are always read into Response::Body, bodyConsumer and
+     * streamThreshold are not used. Callbacks are called from the thread running the loop,
+     * and no other request makes progress while one is running.
+     */
+    class AsyncClient {
+        private:
+            std::shared_ptr<AsyncState> State;
+        public:
+            std::size_t maxIdlePerHost{16}; // Max number of idle connections to keep per host, read when run() is called
+
+            AsyncClient();
+            ~AsyncClient();
+
+            AsyncClient(const AsyncClient&) = delete;
+            AsyncClient& operator=(const AsyncClient&) = delete;
+
+            /**
+             * @brief  Start a network request
+             * @param  theRequest The request to make. It is copied, so it may go out of scope right away.
+             * @param  Callback Function called with the response once the request has finished or failed.
+             */
+            void makeRequest(const Request& theRequest, std::function<void(const Response&)> Callback);
+            /**
+             * @brief  Call a function from the thread running the loop
+             * @param  Function The function to call.
+             */
+            void post(std::function<void()> Function);
+            /**
+             * @brief  Call a function from the thread running the loop after a delay
+             * @param  Delay How long to wait.
+             * @param  Function The function to call.
+             */
+            void postAfter(const std::chrono::milliseconds Delay, std::function<void()> Function);
+            /**
+             * @brief  Run the event loop until stop() is called. Only one thread may run the loop at a time.
+             */
+            void run();
+            /**
+             * @brief  Make run() return as soon as possible. Requests in progress are not finished.
+             */
+            void stop();
+    };
+
     inline std::string userCert{}; // User-specified root certificate string
+    inline TrafficShaper trafficShaper{}; // Traffic shaper used by all requests
+    inline ConnectionPool connectionPool{}; // Connection pool used by all requests
+    inline BodyLimits bodyLimits{}; // Body limits used by requests that do not specify their own
+    inline Deadlines defaultDeadlines{}; // Deadlines new requests start out with
+
+    /**
+     * @brief  Determine the traffic shaping class of an endpoint
+     * @param  Endpoint The endpoint, for example /_matrix/client/v3/sync
+     * @return Returns one of the LEET_REQUEST_CLASS_* values.
+     */
+    int returnEndpointClass(const std::string& Endpoint);
 
     std::string getRootCertificates();
 }
@@ -12,15 +12,149 @@
 #include <chrono>
 #include <string>
 #include <ctime>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <set>
+#include <limits>
 #include <nlohmann/json.hpp>
 
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <libleet.hpp>
 #include <net/Request.hpp>
 
 namespace leetFunction { // contains functions that are used in libleet API functions
-    void getSessionsFromSync(const leet::User::CredentialsResponse& resp, leet::Sync::Sync& sync, nlohmann::json& it);
-    void getRoomEventsFromSync(const leet::User::CredentialsResponse& resp, leet::Sync::Sync& sync, nlohmann::json& it);
-    void getInvitesFromSync(const leet::User::CredentialsResponse& resp, leet::Sync::Sync& sync, nlohmann::json& it);
+    thread_local leet::Client* activeClient{nullptr}; // Client made active on this thread with leet::Client::Scope
+
+    void getSessionFromEvent(std::vector<leet::Sync::MegolmSession>& megolmSessions, nlohmann::json& itEvent);
+    void getInviteFromEvent(const leet::User::CredentialsResponse& resp, leet::Sync::RoomEvents::InviteEvent& theInviteEvent, nlohmann::json& eventIt);
+    leet::Batch::Result invokeBatchRequest(const leet::Batch::Request& request);
+    leetRequest::Request returnSyncRequest(const std::string& Homeserver, const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf);
+    leetRequest::Response requestSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf, const std::function<void(std::istream&)>& Reader = nullptr);
+    std::chrono::milliseconds returnRetryAfter(const leetRequest::Response& response);
+    void setResponseStatus(const leetRequest::Response& response);
+    std::string returnTransactionID();
+    std::shared_ptr<leet::Client> returnClientCopy();
+    bool isStateFiltered(const leet::Sync::SyncConfiguration& conf);
+    bool isTimelineFiltered(const leet::Sync::SyncConfiguration& conf);
+    leet::Room::Room getRoomFromHierarchy(nlohmann::json& theRoom);
+    void fetchSpaces(const leet::User::CredentialsResponse& resp, const std::vector<std::string>& spaceIDs, const leet::Space::HierarchyConfiguration& conf, const bool withChildren, leet::Space::Hierarchy& theHierarchy);
+    std::vector<leet::User::Device> getDevicesFromKeys(const std::string& userID, nlohmann::json& deviceList);
+    std::map<std::string, std::vector<leet::User::Device>> queryDevices(const leet::User::CredentialsResponse& resp, const std::vector<std::string>& userIDs);
+    void addDevicesToProfiles(const leet::User::CredentialsResponse& resp, std::vector<leet::User::Profile>& profiles);
+    void updateStateStore(const leet::Sync::Sync& sync, const leet::Sync::SyncConfiguration& conf, const bool fullState);
+    void updateDeviceCache(const leet::User::CredentialsResponse& resp, const leet::Sync::Sync& sync, const std::string& Since);
+    void updateProfileCache(const leet::Sync::Sync& sync);
+    void updateHierarchyCache(const leet::Sync::Sync& sync);
+    void updateEventStore(const leet::Sync::Sync& sync, const leet::Sync::SyncConfiguration& conf);
+    template <typename Input> bool decodeSync(const leet::User::CredentialsResponse& resp, Input&& Body, leet::Sync::Sync& sync, std::vector<leet::Sync::SyncEvent>* Events);
+    leet::Event::Message getMessageFromEvent(nlohmann::json& theEvent);
+    leet::Event::MessagePage requestMessages(const leet::User::CredentialsResponse& resp, const std::string& roomID, const std::string& Query, std::vector<std::string>* rawEvents);
+    leet::Sync::RoomEvent getRoomEventFromEvent(nlohmann::json& theEvent);
+    std::string encodeURL(const std::string& Input);
+    void addEventFilterToJSON(nlohmann::json& Output, const leet::Filter::EventFilter& filter);
+    void addRoomEventFilterToJSON(nlohmann::json& Output, const leet::Filter::RoomEventFilter& filter);
+    nlohmann::json returnFilterJSON(const leet::Filter::FilterConfiguration& filter);
+    std::string returnFilterHash(const std::string& filterJSON);
+    std::uint64_t returnStableHash(const std::string& Input);
+    std::string returnRedacts(const nlohmann::json& theEvent);
+    nlohmann::json returnRedactedEvent(const nlohmann::json& theEvent, const nlohmann::json& theRedaction);
+    bool isUnknownFilter(const leetRequest::Response& response, const leet::Sync::SyncConfiguration& conf);
+    void waitIdle(const int Attempt);
+    std::string findNextBatch(const std::string& Body);
+
+    /**
+     * @brief  SAX handler which picks events out of a response without building a DOM for the whole response
+     *
+     * Only objects at paths accepted by isWanted are built, one at a time, and handed to onEvent.
+     * Everything else is skipped as it is read.
+     */
+    class EventDecoder : public nlohmann::json_sax<nlohmann::json> {
+        private:
+            std::vector<std::string> Path{}; // Key at each level of the document, "[]" for array levels
+            std::vector<nlohmann::json*> Captured{}; // Containers of the event currently being built
+            nlohmann::json Event{};
+
+            nlohmann::json* addValue(nlohmann::json&& Value) {
+                nlohmann::json* Parent = Captured.back();
+
+                if (Parent->is_array()) {
+                    Parent->push_back(std::move(Value));
+                    return &Parent->back();
+                }
+
+                return &((*Parent)[Path.back()] = std::move(Value));
+            }
+            bool addScalar(nlohmann::json&& Value) {
+                if (!Captured.empty()) {
+                    addValue(std::move(Value));
+                } else if (onValue) {
+                    onValue(Path, Value);
+                }
+
+                return true;
+            }
+            bool startContainer(nlohmann::json&& Value, const std::string& Key) {
+                if (!Captured.empty()) {
+                    Captured.push_back(addValue(std::move(Value)));
+                } else if (Value.is_object() && isWanted && isWanted(Path)) {
+                    Event = std::move(Value);
+                    Captured.push_back(&Event);
+                }
+
+                Path.push_back(Key);
+
+                return true;
+            }
+            bool endContainer() {
+                Path.pop_back();
+
+                if (!Captured.empty()) {
+                    Captured.pop_back();
+
+                    if (Captured.empty() && onEvent) {
+                        onEvent(Path, Event);
+                    }
+                }
+
+                return true;
+            }
+        public:
+            std::string nextBatch{};
+            std::function<bool(const std::vector<std::string>&)> isWanted{}; // Given the path of an object, returns true if it should be built
+            std::function<void(const std::vector<std::string>&, nlohmann::json&)> onEvent{}; // Called with each built object and its path
+            std::function<void(const std::vector<std::string>&, const nlohmann::json&)> onValue{}; // Called with each value outside of built objects and its path
+
+            bool null() override { return addScalar(nullptr); }
+            bool boolean(bool val) override { return addScalar(val); }
+            bool number_integer(number_integer_t val) override { return addScalar(val); }
+            bool number_unsigned(number_unsigned_t val) override { return addScalar(val); }
+            bool number_float(number_float_t val, const string_t&) override { return addScalar(val); }
+            bool binary(binary_t& val) override { return addScalar(nlohmann::json::binary(val)); }
+            bool string(string_t& val) override {
+                if (Captured.empty() && Path.size() == 1 && !Path[0].compare("next_batch")) {
+                    nextBatch = val;
+                }
+
+                return addScalar(std::move(val));
+            }
+            bool start_object(std::size_t) override { return startContainer(nlohmann::json::object(), ""); }
+            bool end_object() override { return endContainer(); }
+            bool start_array(std::size_t) override { return startContainer(nlohmann::json::array(), "[]"); }
+            bool end_array() override { return endContainer(); }
+            bool key(string_t& val) override { Path.back() = val; return true; }
+            bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+    };
 }
 
 #ifndef LEET_NO_ENCRYPTION
@@ -140,7 +274,7 @@ void leet::olmAccount::createIdentity() {
     }
 
     for (auto &output : identityJson) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
         if (output["curve25519"].is_string())
             curve25519 = output["curve25519"].get<std::string>();
@@ -483,9 +617,11 @@ void leet::olmAccount::createSession(const leet::User::CredentialsResponse& resp
         }
     }
 
-    const std::string putOutput {
-        leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/sendToDevice/m.room.encrypted/" + std::to_string(leet::transID)), eventToSend.dump(), resp.accessToken)
-    };
+    const std::string transactionID { leetFunction::returnTransactionID() };
+
+    if (transactionID.compare("")) {
+        leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/sendToDevice/m.room.encrypted/" + transactionID), eventToSend.dump(), resp.accessToken);
+    }
 
     free(utilityMemory);
     utilityMemoryAllocated = false;
@@ -649,15 +785,15 @@ leet::User::CredentialsResponse leet::refreshAccessToken(leet::User::Credentials
     }
 
     for (auto& output : refreshOutput) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
         if (output["access_token"].is_string()) resp.accessToken = output["access_token"].get<std::string>();
         if (output["refresh_token"].is_string()) resp.refreshToken = output["refresh_token"].get<std::string>();
         if (output["expires_in_ms"].is_number_integer()) resp.Expiration = output["expires_in_ms"].get<int>();
         if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
         }
     }
 
@@ -674,7 +810,7 @@ bool leet::checkRegistrationTokenValidity(const std::string& Token) {
     }
 
     for (auto& output : body) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
         if (output["valid"].is_boolean()) {
             bool theBool = output["valid"].get<bool>();
@@ -682,9 +818,9 @@ bool leet::checkRegistrationTokenValidity(const std::string& Token) {
         }
 
         if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
         }
     }
 
@@ -701,7 +837,7 @@ leet::User::CredentialsResponse leet::registerAccount(const leet::User::Credenti
 
         if (theUsername.at(0) == '@' || !theUsername.compare("")) {
             return resp;
-            leet::errorCode = 1;
+            leet::returnClient().errorCode = 1;
         }
     }
 
@@ -726,9 +862,9 @@ leet::User::CredentialsResponse leet::registerAccount(const leet::User::Credenti
     }
 
     for (auto& output : registerOutput) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
-        resp.Homeserver = leet::Homeserver = cred.Homeserver;
+        resp.Homeserver = leet::returnClient().Homeserver = cred.Homeserver;
 
         if (output["access_token"].is_string()) resp.accessToken = output["access_token"].get<std::string>();
         if (output["device_id"].is_string()) resp.deviceID = output["device_id"].get<std::string>();
@@ -737,9 +873,9 @@ leet::User::CredentialsResponse leet::registerAccount(const leet::User::Credenti
         if (output["expires_in_ms"].is_number_integer()) resp.Expiration = output["expires_in_ms"].get<int>();
 
         if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
         }
     }
 
@@ -778,9 +914,9 @@ leet::User::CredentialsResponse leet::loginAccount(const leet::User::Credentials
     nlohmann::json loginOutput = { nlohmann::json::parse(leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/login"), list.dump())) };
 
     for (auto& output : loginOutput) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
-        resp.Homeserver = leet::Homeserver = cred.Homeserver;
+        resp.Homeserver = leet::returnClient().Homeserver = cred.Homeserver;
 
         if (output["access_token"].is_string()) resp.accessToken = output["access_token"].get<std::string>();
         if (output["device_id"].is_string()) resp.deviceID = output["device_id"].get<std::string>();
@@ -789,9 +925,9 @@ leet::User::CredentialsResponse leet::loginAccount(const leet::User::Credentials
         if (output["expires_in_ms"].is_number_integer()) resp.Expiration = output["expires_in_ms"].get<int>();
 
         if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
         }
     }
 
@@ -823,7 +959,7 @@ std::string leet::invokeRequest_Get(const std::string& URL) {
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -849,7 +985,7 @@ std::string leet::invokeRequest_Put(const std::string& URL, const std::string& D
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -875,7 +1011,7 @@ std::string leet::invokeRequest_Post(const std::string& URL, const std::string&
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -901,7 +1037,7 @@ std::string leet::invokeRequest_Get(const std::string& URL, const std::string& A
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -926,7 +1062,7 @@ std::string leet::invokeRequest_Delete(const std::string& URL) {
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -952,7 +1088,7 @@ std::string leet::invokeRequest_Delete(const std::string& URL, const std::string
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -979,7 +1115,7 @@ std::string leet::invokeRequest_Put(const std::string& URL, const std::string& D
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -1006,7 +1142,7 @@ std::string leet::invokeRequest_Post(const std::string& URL, const std::string&
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -1037,7 +1173,7 @@ std::string leet::invokeRequest_Post_File(const std::string& URL, const std::str
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
@@ -1067,10 +1203,117 @@ std::string leet::invokeRequest_Post_File(const std::string& URL, const std::str
 
     leetRequest::Response response = request.makeRequest();
 
-    leet::networkStatusCode = response.statusCode;
+    leetFunction::setResponseStatus(response);
     return response.Body;
 }
 
+leet::Batch::Result leetFunction::invokeBatchRequest(const leet::Batch::Request& theRequest) {
+    leet::Batch::Result result;
+    leetRequest::URL url;
+    leetRequest::Request request;
+
+    url.parseURLFromString(theRequest.URL);
+
+    request.Host = url.Host;
+    request.Endpoint = url.Endpoint;
+    request.Query = url.Query;
+    request.Port = url.Port;
+    request.Protocol = url.Protocol;
+    request.userAgent = "LIBLEET_USER_AGENT";
+
+    switch (theRequest.Type) {
+        case leet::LEET_REQUEST_POST:
+            request.Type = leetRequest::LEET_REQUEST_REQTYPE_POST;
+            request.Body = theRequest.Body;
+            break;
+        case leet::LEET_REQUEST_PUT:
+            request.Type = leetRequest::LEET_REQUEST_REQTYPE_PUT;
+            request.Body = theRequest.Body;
+            break;
+        case leet::LEET_REQUEST_DELETE:
+            request.Type = leetRequest::LEET_REQUEST_REQTYPE_DELETE;
+            break;
+        default:
+            request.Type = leetRequest::LEET_REQUEST_REQTYPE_GET;
+            break;
+    }
+
+    if (theRequest.Authentication.compare("")) {
+        request.setAuthenticationHeader("Bearer " + theRequest.Authentication);
+    }
+
+    leetRequest::Response response = request.makeRequest();
+
+    result.statusCode = response.statusCode;
+    result.Body = std::move(response.Body);
+
+    if (result.statusCode == 0) {
+        result.errorCode = 1;
+        result.friendlyError = response.networkError;
+        return result;
+    }
+
+    if (result.statusCode < 200 || result.statusCode >= 300) {
+        result.errorCode = 1;
+    }
+
+    if (result.Body.find("\"errcode\"") == std::string::npos) {
+        return result;
+    }
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = nlohmann::json::parse(result.Body);
+    } catch (const nlohmann::json::parse_error& e) {
+        return result;
+    }
+
+    if (requestResponse.is_object() && requestResponse.contains("errcode") && requestResponse["errcode"].is_string()) {
+        result.errorCode = 1;
+        result.Error = requestResponse["errcode"].get<std::string>();
+        if (requestResponse.contains("error") && requestResponse["error"].is_string()) result.friendlyError = requestResponse["error"].get<std::string>();
+    }
+
+    return result;
+}
+
+std::vector<leet::Batch::Result> leet::invokeBatch(const std::vector<leet::Batch::Request>& requests, const int Concurrency) {
+    std::vector<leet::Batch::Result> results(requests.size());
+    std::atomic<std::size_t> nextRequest{0};
+
+    if (requests.empty()) {
+        return results;
+    }
+
+    // Each worker takes the next request that nobody has started on yet
+    auto Worker = [&]() {
+        for (std::size_t it = nextRequest++; it < requests.size(); it = nextRequest++) {
+            try {
+                results[it] = leetFunction::invokeBatchRequest(requests[it]);
+            } catch (const std::exception& e) {
+                results[it].errorCode = 1;
+                results[it].friendlyError = e.what();
+            }
+        }
+    };
+
+    const std::size_t Workers = std::clamp<std::size_t>(static_cast<std::size_t>(std::max(Concurrency, 1)), 1, requests.size());
+    std::vector<std::thread> Threads;
+
+    for (std::size_t it{1}; it < Workers; ++it) {
+        Threads.emplace_back(Worker);
+    }
+
+    Worker(); // the calling thread does its share of the work too
+
+    for (auto& it : Threads) {
+        it.join();
+    }
+
+    return results;
+}
+
 std::string leet::findUserID(const std::string& Alias, const std::string& Homeserver) {
     if (Alias.at(0) != '@')
         return "@" + Alias + ":" + Homeserver;
@@ -1086,7 +1329,7 @@ std::string leet::returnUserName(const std::string& userID) {
 }
 
 leet::User::Profile leet::getUserData(const leet::User::CredentialsResponse& resp, const std::string& userID) {
-    leet::errorCode = 0;
+    leet::returnClient().errorCode = 0;
     leet::User::Profile profile;
 
     if (userID.at(0) != '@') {
@@ -1096,31 +1339,42 @@ leet::User::Profile leet::getUserData(const leet::User::CredentialsResponse& res
     profile.userID = leet::findUserID(userID, resp.Homeserver);
 
     if (profile.userID.empty()) {
-        leet::errorCode = 1;
-        leet::friendlyError = "Failed to get User ID";
+        leet::returnClient().errorCode = 1;
+        leet::returnClient().friendlyError = "Failed to get User ID";
         return profile;
     }
 
-    const std::string Output = invokeRequest_Get(leet::getAPI("/_matrix/client/v3/profile/" + profile.userID));
+    const std::shared_ptr<leet::User::ProfileCache> profileCache = leet::returnClient().profileCache;
+    std::optional<leet::User::Profile> cachedProfile = profileCache ? profileCache->findProfile(profile.userID) : std::nullopt;
 
-    nlohmann::json requestResponse{};
+    if (cachedProfile) {
+        profile = std::move(*cachedProfile);
+    } else {
+        const std::string Output = invokeRequest_Get(leet::getAPI("/_matrix/client/v3/profile/" + profile.userID));
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return profile;
-    }
+        nlohmann::json requestResponse{};
 
-    for (auto& output : requestResponse) {
-        if (output["avatar_url"].is_string()) profile.avatarURL = output["avatar_url"].get<std::string>();
-        if (output["displayname"].is_string()) profile.displayName = output["displayname"].get<std::string>();
+        try {
+            requestResponse = { nlohmann::json::parse(Output) };
+        } catch (const nlohmann::json::parse_error& e) {
+            return profile;
+        }
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
+        for (auto& output : requestResponse) {
+            if (output["avatar_url"].is_string()) profile.avatarURL = output["avatar_url"].get<std::string>();
+            if (output["displayname"].is_string()) profile.displayName = output["displayname"].get<std::string>();
+
+            if (output["errcode"].is_string()) {
+                leet::returnClient().errorCode = 1;
+                leet::returnClient().Error = output["errcode"].get<std::string>();
+
+                if (output["error"].is_string())
+                    leet::returnClient().friendlyError = output["error"].get<std::string>();
+            }
+        }
 
-            if (output["error"].is_string())
-                leet::friendlyError = output["error"].get<std::string>();
+        if (profileCache && !leet::returnClient().errorCode) {
+            profileCache->addProfile(profile);
         }
     }
 
@@ -1133,1599 +1387,5769 @@ leet::User::Profile leet::getUserData(const leet::User::CredentialsResponse& res
     return profile;
 }
 
-std::vector<leet::User::Device> leet::returnDevicesFromUser(const leet::User::CredentialsResponse& resp, const std::vector<leet::User::Profile>& user) {
+std::vector<leet::User::Device> leetFunction::getDevicesFromKeys(const std::string& userID, nlohmann::json& deviceList) {
     std::vector<leet::User::Device> devices;
 
-    nlohmann::json Body{};
-    nlohmann::json deviceKeys{};
+    for (auto it = deviceList.begin(); it != deviceList.end(); ++it) {
+        leet::User::Device device;
 
-    for (auto& theUser : user) {
-        deviceKeys[theUser.userID] = nlohmann::json::array();
-        Body["device_keys"] = deviceKeys;
-        Body["timeout"] = 10000;
-    }
+        device.userID = userID;
+        device.deviceID = it.key();
 
-    const std::string Output = leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/keys/query"), Body.dump(), resp.accessToken);
-    nlohmann::json returnOutput{};
+        nlohmann::json::json_pointer curve25519Pointer("/keys/curve25519:" + device.deviceID);
+        if (it.value().contains(curve25519Pointer)) {
+            device.curve25519Key = it.value()["keys"]["curve25519:" + device.deviceID];
+        }
+        nlohmann::json::json_pointer ed25519Pointer("/keys/ed25519:" + device.deviceID);
+        if (it.value().contains(ed25519Pointer)) {
+            device.ed25519Key = it.value()["keys"]["ed25519:" + device.deviceID];
+        }
+        nlohmann::json::json_pointer ed25519SigPointer("/signatures/" + userID + "/ed25519:" + device.deviceID);
+        if (it.value().contains(ed25519SigPointer)) {
+            device.ed25519Signature = it.value()["signatures"][userID]["ed25519:" + device.deviceID];
+        }
+        if (it.value().contains("/unsigned/device_display_name"_json_pointer)) {
+            device.deviceDisplayName = it.value()["unsigned"]["device_display_name"];
+        }
 
-    try {
-        returnOutput = nlohmann::json::parse(Output);
-    } catch (const nlohmann::json::parse_error& e) {
-        return devices;
+        device.olm = false;
+        device.megolm = false;
+
+        if (std::find(it.value()["algorithms"].begin(), it.value()["algorithms"].end(), "m.olm.v1.curve25519-aes-sha2") != it.value()["algorithms"].end())
+            device.olm = true;
+
+        if (std::find(it.value()["algorithms"].begin(), it.value()["algorithms"].end(), "m.megolm.v1.aes-sha2") != it.value()["algorithms"].end())
+            device.megolm = true;
+
+        devices.push_back(device);
     }
 
-    for (auto& userID : user) {
-        auto& deviceList = returnOutput["device_keys"][userID.userID];
+    return devices;
+}
 
-        for (auto it = deviceList.begin(); it != deviceList.end(); ++it) {
-            leet::User::Device device;
+std::map<std::string, std::vector<leet::User::Device>> leetFunction::queryDevices(const leet::User::CredentialsResponse& resp, const std::vector<std::string>& userIDs) {
+    std::map<std::string, std::vector<leet::User::Device>> devices;
+    std::map<std::string, std::vector<leet::User::Device>> queriedDevices;
+    std::vector<leet::Batch::Request> requests;
+    std::vector<std::string> staleUsers;
 
-            device.userID = userID.userID;
-            device.deviceID = it.key();
+    const std::shared_ptr<leet::User::DeviceCache> deviceCache = leet::returnClient().deviceCache;
+    const std::uint64_t queriedAt = deviceCache ? deviceCache->returnGeneration() : 0;
 
-            nlohmann::json::json_pointer curve25519Pointer("/keys/curve25519:" + device.deviceID);
-            if (it.value().contains(curve25519Pointer)) {
-                device.curve25519Key = it.value()["keys"]["curve25519:" + device.deviceID];
-            }
-            nlohmann::json::json_pointer ed25519Pointer("/keys/ed25519:" + device.deviceID);
-            if (it.value().contains(ed25519Pointer)) {
-                device.ed25519Key = it.value()["keys"]["ed25519:" + device.deviceID];
-            }
-            nlohmann::json::json_pointer ed25519SigPointer("/signatures/" + userID.userID + "/ed25519:" + device.deviceID);
-            if (it.value().contains(ed25519SigPointer)) {
-                device.ed25519Signature = it.value()["signatures"][userID.userID]["ed25519:" + device.deviceID];
-            }
-            if (it.value().contains("/unsigned/device_display_name"_json_pointer)) {
-                device.deviceDisplayName = it.value()["unsigned"]["device_display_name"];
+    // Only users which aren't cached or whose devices have changed are queried
+    if (deviceCache) {
+        for (auto& userID : userIDs) {
+            if (auto cachedDevices = deviceCache->findDevices(userID)) {
+                devices[userID] = std::move(*cachedDevices);
+            } else {
+                staleUsers.push_back(userID);
             }
+        }
+    }
 
-            device.olm = false;
-            device.megolm = false;
+    const std::vector<std::string>& queriedUsers = deviceCache ? staleUsers : userIDs;
 
-            if (std::find(it.value()["algorithms"].begin(), it.value()["algorithms"].end(), "m.olm.v1.curve25519-aes-sha2") != it.value()["algorithms"].end())
-                device.olm = true;
+    // /keys/query takes many users at once, so the users are split into chunks which are queried at the same time
+    const std::size_t chunkSize = std::max<std::size_t>(leet::keysQueryChunkSize, 1);
 
-            if (std::find(it.value()["algorithms"].begin(), it.value()["algorithms"].end(), "m.megolm.v1.aes-sha2") != it.value()["algorithms"].end())
-                device.megolm = true;
+    for (std::size_t first{0}; first < queriedUsers.size(); first += chunkSize) {
+        nlohmann::json Body{};
+        nlohmann::json& deviceKeys = Body["device_keys"];
 
-            devices.push_back(device);
+        for (std::size_t it = first; it < std::min(first + chunkSize, queriedUsers.size()); ++it) {
+            deviceKeys[queriedUsers[it]] = nlohmann::json::array();
         }
+
+        Body["timeout"] = 10000;
+
+        leet::Batch::Request request;
+        request.Type = leet::LEET_REQUEST_POST;
+        request.URL = leet::getAPI("/_matrix/client/v3/keys/query");
+        request.Body = Body.dump();
+        request.Authentication = resp.accessToken;
+
+        requests.push_back(request);
     }
 
-    return devices;
-}
+    const std::vector<leet::Batch::Result> results = leet::invokeBatch(requests, leet::requestConcurrency);
 
-bool leet::checkIfUsernameIsAvailable(const std::string& Username) {
-    leet::errorCode = 0;
+    for (auto& result : results) {
+        if (result.errorCode) {
+            continue;
+        }
 
-    std::string theUsername = Username;
+        nlohmann::json returnOutput{};
 
-    if (Username.at(0) == '@') {
-        theUsername = leet::returnUserName(Username);
+        try {
+            returnOutput = nlohmann::json::parse(result.Body);
+        } catch (const nlohmann::json::parse_error& e) {
+            continue;
+        }
 
-        if (theUsername.at(0) == '@' || !theUsername.compare("")) {
-            return false;
-            leet::errorCode = 1;
+        if (!returnOutput["device_keys"].is_object()) {
+            continue;
+        }
+
+        for (auto it = returnOutput["device_keys"].begin(); it != returnOutput["device_keys"].end(); ++it) {
+            queriedDevices[it.key()] = leetFunction::getDevicesFromKeys(it.key(), it.value());
         }
     }
 
-    const std::string API { leet::getAPI("/_matrix/client/v3/register/available?username=" + theUsername) };
-    const std::string Output = invokeRequest_Get(API);
+    if (deviceCache && !queriedDevices.empty()) {
+        deviceCache->addDevices(queriedDevices, queriedAt);
+    }
 
-    nlohmann::json requestResponse{};
+    devices.merge(queriedDevices);
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return false; // fallback to false is probably safest?
+    return devices;
+}
+
+std::vector<leet::User::Device> leet::returnDevicesFromUser(const leet::User::CredentialsResponse& resp, const std::vector<leet::User::Profile>& user) {
+    std::vector<leet::User::Device> devices;
+    std::vector<std::string> userIDs;
+
+    for (auto& theUser : user) {
+        userIDs.push_back(theUser.userID);
     }
 
-    for (auto& output : requestResponse) {
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-            return false;
-        }
+    std::map<std::string, std::vector<leet::User::Device>> userDevices = leetFunction::queryDevices(resp, userIDs);
 
-        if (output["available"].is_boolean()) {
-            return output["available"].get<bool>();
+    for (auto& theUser : user) {
+        auto it = userDevices.find(theUser.userID);
+
+        if (it != userDevices.end()) {
+            devices.insert(devices.end(), it->second.begin(), it->second.end());
         }
     }
 
-    return false;
+    return devices;
 }
 
-std::vector<leet::User::Profile> leet::returnUsersInRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
-    std::vector<leet::User::Profile> vector;
+leet::User::DeviceListChanges leet::returnDeviceListChanges(const leet::User::CredentialsResponse& resp, const std::string& From, const std::string& To) {
+    leet::User::DeviceListChanges changes{};
 
-    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/joined_members"), resp.accessToken);
+    leet::returnClient().errorCode = 0;
+
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/keys/changes?from=" + From + "&to=" + To), resp.accessToken);
     nlohmann::json returnOutput{};
 
     try {
         returnOutput = nlohmann::json::parse(Output);
     } catch (const nlohmann::json::parse_error& e) {
-        return vector;
+        leet::returnClient().errorCode = 1;
+        return changes;
     }
 
-    auto& users = returnOutput["joined"];
+    if (returnOutput["errcode"].is_string()) {
+        leet::returnClient().errorCode = 1;
+        leet::returnClient().Error = returnOutput["errcode"].get<std::string>();
+        if (returnOutput["error"].is_string()) leet::returnClient().friendlyError = returnOutput["error"].get<std::string>();
 
-    for (auto it = users.begin(); it != users.end(); ++it) {
-        leet::User::Profile profile;
+        return changes;
+    }
 
-        if (it.value().contains("avatar_url") && !it.value()["avatar_url"].is_null()) profile.avatarURL = it.value()["avatar_url"];
-        if (it.value().contains("display_name") && !it.value()["display_name"].is_null()) profile.displayName = it.value()["display_name"];
+    if (returnOutput["changed"].is_array()) {
+        for (auto& it : returnOutput["changed"]) {
+            if (it.is_string()) changes.Changed.push_back(it.get<std::string>());
+        }
+    }
 
-        profile.userID = it.key();
+    if (returnOutput["left"].is_array()) {
+        for (auto& it : returnOutput["left"]) {
+            if (it.is_string()) changes.Left.push_back(it.get<std::string>());
+        }
+    }
 
-        leet::User::Profile userProfile;
-        userProfile.userID = it.key();
-        std::vector<leet::User::Profile> User = { userProfile };
-        profile.Devices = leet::returnDevicesFromUser(resp, User);
+    return changes;
+}
 
-        vector.push_back(profile);
+void leet::User::DeviceCache::loadFromFile() {
+    if (Loaded) {
+        return;
     }
 
-    return vector;
-}
+    Loaded = true;
 
-std::vector<std::string> leet::findRoomAliases(const leet::User::CredentialsResponse& resp, const std::string& roomID) {
-    std::vector<std::string> ret;
-    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/rooms/" + roomID + "/aliases"), resp.accessToken);
+    if (!cacheFile.compare("") || !std::filesystem::exists(cacheFile)) {
+        return;
+    }
 
-    nlohmann::json requestResponse{};
+    std::ifstream inputFile(cacheFile);
+    nlohmann::json theCache{};
 
     try {
-        requestResponse = { nlohmann::json::parse(Output) };
+        theCache = nlohmann::json::parse(inputFile);
     } catch (const nlohmann::json::parse_error& e) {
-        return ret;
+        return;
     }
 
-    for (auto& output : requestResponse) {
-        if (!output["aliases"].is_null()) {
-            leet::errorCode = 0;
-            return output["aliases"].get<std::vector<std::string>>();
-        } else if (!output["errcode"].is_null()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+    if (!theCache.is_object() || !theCache["users"].is_object()) {
+        return;
+    }
 
-            return ret;
-        }
+    if (theCache["token"].is_string()) {
+        Token = theCache["token"].get<std::string>();
     }
 
-    return ret;
-}
+    for (auto& it : theCache["users"].items()) {
+        if (!it.value()["devices"].is_array()) {
+            continue;
+        }
 
-std::string leet::findRoomID(const std::string& Alias) {
-    std::string ret = Alias;
-    leet::errorCode = 0;
+        Entry theEntry{};
 
-    if (ret.at(0) == '!') { // It's a proper room ID already
-        return ret;
-    }
+        for (auto& theDevice : it.value()["devices"]) {
+            leet::User::Device device{};
 
-    // Replace the '#' character with '%23' so that Matrix is happy
-    ret.replace(0, 1, "%23");
+            device.userID = it.key();
+            device.deviceID = theDevice.value("device_id", "");
+            device.curve25519Key = theDevice.value("curve25519", "");
+            device.ed25519Key = theDevice.value("ed25519", "");
+            device.ed25519Signature = theDevice.value("signature", "");
+            device.deviceDisplayName = theDevice.value("display_name", "");
+            device.olm = theDevice.value("olm", false);
+            device.megolm = theDevice.value("megolm", false);
 
-    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/directory/room/") + ret);
-    nlohmann::json requestResponse{};
+            theEntry.Devices.push_back(device);
+        }
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return "";
-    }
+        // Without a token it is unknown what has changed since the devices were saved
+        theEntry.Stale = !Token.compare("") || it.value().value("stale", false);
 
-    for (auto& output : requestResponse) {
-        if (output["room_id"].is_string()) {
-            leet::errorCode = 0;
-            return output["room_id"].get<std::string>();
-        } else if (!output["errcode"].is_null()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+        Users[it.key()] = std::move(theEntry);
+    }
+}
 
-            return "";
-        }
+void leet::User::DeviceCache::saveToFile() {
+    if (!cacheFile.compare("")) {
+        return;
     }
 
-    return "";
-}
+    nlohmann::json theCache = nlohmann::json::object();
 
-bool leet::removeRoomAlias(const leet::User::CredentialsResponse& resp, const std::string& Alias) {
-    std::string ret = Alias;
-    leet::errorCode = 0;
+    theCache["token"] = Token;
+    theCache["users"] = nlohmann::json::object();
 
-    if (ret.at(0) != '!') {
-        leet::errorCode = 1;
-        return false;
-    }
+    for (auto& it : Users) {
+        nlohmann::json& theUser = theCache["users"][it.first];
 
-    // Replace the '#' character with '%23' so that Matrix is happy
-    ret.replace(0, 1, "%23");
+        theUser["stale"] = it.second.Stale;
+        theUser["devices"] = nlohmann::json::array();
 
-    const std::string Output = leet::invokeRequest_Delete(leet::getAPI("/_matrix/client/v3/directory/room/" + ret), resp.accessToken);
-    nlohmann::json requestResponse{};
+        for (auto& device : it.second.Devices) {
+            nlohmann::json theDevice{};
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return false;
-    }
+            theDevice["device_id"] = device.deviceID;
+            theDevice["curve25519"] = device.curve25519Key;
+            theDevice["ed25519"] = device.ed25519Key;
+            theDevice["signature"] = device.ed25519Signature;
+            theDevice["display_name"] = device.deviceDisplayName;
+            theDevice["olm"] = device.olm;
+            theDevice["megolm"] = device.megolm;
 
-    if (leet::networkStatusCode == 200) {
-        return true;
+            theUser["devices"].push_back(theDevice);
+        }
     }
 
-    for (auto& output : requestResponse) {
-        if (!output["errcode"].is_null()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+    const std::filesystem::path file{ cacheFile };
 
-            return false;
-        }
+    if (file.has_parent_path()) {
+        std::error_code ec;
+        std::filesystem::create_directories(file.parent_path(), ec);
     }
 
-    return false;
-}
-
-std::vector<leet::Room::Room> leet::returnRooms(const leet::User::CredentialsResponse& resp, const int Limit) {
-    std::vector<leet::Room::Room> vector;
-    std::vector<leet::Room::Room> vectorWithVal;
+    const std::string temporaryFile = cacheFile + ".tmp";
+    std::ofstream outputFile(temporaryFile, std::ios::trunc);
 
-    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/joined_rooms"), resp.accessToken);
-    nlohmann::json returnOutput{};
+    outputFile << theCache.dump();
+    outputFile.close();
 
-    try {
-        returnOutput = nlohmann::json::parse(Output);
-    } catch (const nlohmann::json::parse_error& e) {
-        return vector;
+    if (outputFile) {
+        std::error_code ec;
+        std::filesystem::rename(temporaryFile, cacheFile, ec);
     }
+}
 
-    auto& rooms = returnOutput["joined_rooms"];
+std::optional<std::vector<leet::User::Device>> leet::User::DeviceCache::findDevices(const std::string& userID) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    for (auto it = rooms.begin(); it != rooms.end(); ++it) {
-        leet::Room::Room room;
-        room.roomID = it.value();
-        vector.push_back(room);
-    }
+    loadFromFile();
 
-    for (auto& it : vector) {
-        leet::Room::Room room = leet::returnRoom(resp, it);
+    const auto it = Users.find(userID);
 
-        vectorWithVal.push_back(room);
+    if (it == Users.end() || it->second.Stale) {
+        return std::nullopt;
     }
 
-    return vectorWithVal;
+    return it->second.Devices;
 }
 
-leet::Room::Room leet::returnRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
-    leet::Room::Room theRoom;
-    nlohmann::json returnOutput{};
+std::uint64_t leet::User::DeviceCache::returnGeneration() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    try {
-        returnOutput = nlohmann::json::parse(leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v1/rooms/" + room.roomID + "/hierarchy"), resp.accessToken));
-    } catch (const nlohmann::json::parse_error& e) {
-        return theRoom;
-    }
+    return Generation;
+}
 
-    auto& roomOutput = returnOutput["rooms"];
+void leet::User::DeviceCache::addDevices(const std::map<std::string, std::vector<leet::User::Device>>& userDevices, const std::uint64_t queriedAt) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    for (auto i = roomOutput.begin(); i != roomOutput.end(); ++i) {
-        if (i.value().contains("room_id")) theRoom.roomID = i.value()["room_id"];
-        if (i.value().contains("join_rule")) theRoom.joinRule = i.value()["join_rule"];
-        if (i.value().contains("avatar_url")) theRoom.avatarURL = i.value()["avatar_url"];
-        if (i.value().contains("canonical_alias")) theRoom.Alias = i.value()["canonical_alias"];
-        if (i.value().contains("name")) theRoom.Name = i.value()["name"];
-        if (i.value().contains("num_joined_members")) theRoom.memberCount = i.value()["num_joined_members"];
-        if (i.value().contains("topic")) theRoom.Topic = i.value()["topic"];
-        if (i.value().contains("guest_can_join")) theRoom.guestCanJoin = i.value()["guest_can_join"];
-        if (i.value().contains("world_readable")) theRoom.worldReadable = i.value()["world_readable"];
-        if (i.value().contains("room_type")) theRoom.roomType = i.value()["room_type"];
+    loadFromFile();
+
+    for (auto& it : userDevices) {
+        const auto theUser = Users.find(it.first);
+        const std::uint64_t changedAt = theUser != Users.end() ? theUser->second.changedAt : uncachedChangedAt;
+
+        Entry& theEntry = Users[it.first];
+
+        // A change which arrived while the query was running may not be part of what it returned
+        theEntry.Devices = it.second;
+        theEntry.Stale = changedAt > queriedAt;
+        theEntry.changedAt = changedAt;
     }
 
-    return theRoom;
+    saveToFile();
 }
 
-leet::Room::Room leet::upgradeRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int Version) {
-    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/upgrade" };
+void leet::User::DeviceCache::update(const leet::User::DeviceListChanges& Changes, const std::string& nextToken) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    nlohmann::json body{};
+    loadFromFile();
 
-    body["new_version"] = std::to_string(Version);
+    bool Modified{false};
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI(APIUrl), body.dump(), resp.accessToken) };
+    if (!Changes.Changed.empty() || !Changes.Left.empty()) {
+        Generation++;
+    }
 
-    nlohmann::json requestResponse{};
+    for (auto& userID : Changes.Changed) {
+        const auto it = Users.find(userID);
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    }  catch (const nlohmann::json::parse_error& e) {
-        return room;
-    }
+        if (it == Users.end()) {
+            uncachedChangedAt = Generation;
+            continue;
+        }
 
-    std::string theRoomID{};
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        it->second.changedAt = Generation;
 
-        if (output["replacement_room"].is_string()) theRoomID = output["replacement_room"].get<std::string>();
-        if (output["errcode"].is_string()) leet::Error = output["errcode"].get<std::string>();
-        if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+        if (!it->second.Stale) {
+            it->second.Stale = true;
+            Modified = true;
+        }
     }
 
-    if (!theRoomID.compare("")) {
-        leet::Room::Room theRoom;
-        theRoom.roomID = theRoomID;
-        return leet::returnRoom(resp, theRoom);
+    for (auto& userID : Changes.Left) {
+        Modified = Users.erase(userID) || Modified;
+        uncachedChangedAt = Generation;
     }
 
-    return room;
+    Token = nextToken;
+
+    // The token alone is not worth a write, the changes since the saved token are asked for after a restart
+    if (Modified) {
+        saveToFile();
+    }
 }
 
-leet::Room::Room leet::createRoom(const leet::User::CredentialsResponse& resp, const leet::Room::RoomConfiguration& conf) {
-    leet::Room::Room theRoom{};
-    nlohmann::json theJson{};
+void leet::User::DeviceCache::invalidate(const std::string& nextToken) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    theJson["creation_content"]["m.federate"] = conf.Federate;
-    theJson["name"] = conf.Name;
-    theJson["room_alias_name"] = conf.Alias;
-    theJson["topic"] = conf.Topic;
-    theJson["is_direct"] = conf.directMessage;
+    loadFromFile();
 
-    if (conf.Preset == LEET_PRESET_PUBLIC) {
-        theJson["preset"] = "public_chat";
-    } else if (conf.Preset == LEET_PRESET_PRIVATE) {
-        theJson["preset"] = "private_chat";
-    } else if (conf.Preset == LEET_PRESET_TRUSTED_PRIVATE) {
-        theJson["preset"] = "trusted_private_chat";
+    Generation++;
+    uncachedChangedAt = Generation;
+
+    for (auto& it : Users) {
+        it.second.Stale = true;
+        it.second.changedAt = Generation;
     }
 
-    const std::string Output = leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/createRoom"), theJson.dump(), resp.accessToken);
-    nlohmann::json requestResponse{};
+    Token = nextToken;
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return theRoom;
-    }
+    saveToFile();
+}
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+std::string leet::User::DeviceCache::returnToken() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-        if (output["room_id"].is_string()) theRoom.roomID = output["room_id"].get<std::string>();
-        if (output["errcode"].is_string()) leet::Error = output["errcode"].get<std::string>();
-        if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-    }
+    loadFromFile();
 
-    return leet::returnRoom(resp, theRoom);
+    return Token;
 }
 
-std::vector<leet::Room::Room> leet::returnRoomIDs(const leet::User::CredentialsResponse& resp) {
-    std::vector<leet::Room::Room> vector;
+void leet::User::DeviceCache::clear() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/joined_rooms"), resp.accessToken);
-    nlohmann::json returnOutput{};
+    Loaded = true;
+    Users.clear();
+    Token.clear();
+    uncachedChangedAt = ++Generation;
 
-    try {
-        returnOutput = nlohmann::json::parse(Output);
-    } catch (const nlohmann::json::parse_error& e) {
-        return vector;
-    }
+    saveToFile();
+}
 
-    auto& rooms = returnOutput["joined_rooms"];
+void leet::User::ProfileCache::insert(const leet::User::Profile& userProfile) {
+    Entry theEntry{};
 
-    for (auto it = rooms.begin(); it != rooms.end(); ++it) {
-        leet::Room::Room room;
-        room.roomID = it.value();
-        vector.push_back(room);
-    }
+    theEntry.userProfile.userID = userProfile.userID;
+    theEntry.userProfile.displayName = userProfile.displayName;
+    theEntry.userProfile.avatarURL = userProfile.avatarURL;
+    theEntry.Added = std::chrono::steady_clock::now();
 
-    return vector;
-}
+    const auto it = Index.find(userProfile.userID);
 
-const std::vector<leet::Room::Room> leet::returnRoomsInSpace(const leet::User::CredentialsResponse& resp, const std::string& spaceID, const int Limit) {
-    std::vector<leet::Room::Room> rooms;
-    if (spaceID.at(0) != '!') {
-        return rooms;
+    if (it != Index.end()) {
+        *it->second = std::move(theEntry);
+        Entries.splice(Entries.begin(), Entries, it->second);
+
+        return;
     }
 
-    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v1/rooms/" + spaceID + "/hierarchy?limit=" + std::to_string(Limit)), resp.accessToken) };
-    nlohmann::json returnOutput{};
+    Entries.push_front(std::move(theEntry));
+    Index[userProfile.userID] = Entries.begin();
 
-    try {
-        returnOutput = nlohmann::json::parse(Output);
-    } catch (const nlohmann::json::parse_error& e) {
-        return rooms;
+    while (Entries.size() > std::max<std::size_t>(maxSize, 1)) {
+        Index.erase(Entries.back().userProfile.userID);
+        Entries.pop_back();
     }
+}
 
-    auto& room = returnOutput["rooms"];
+std::optional<leet::User::Profile> leet::User::ProfileCache::findProfile(const std::string& userID) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    for (auto it = room.begin(); it != room.end(); ++it) {
-        leet::Room::Room room;
+    const auto it = Index.find(userID);
 
-        if (it.value().contains("room_id")) room.roomID = it.value()["room_id"];
-        if (it.value().contains("join_rule")) room.joinRule = it.value()["join_rule"];
-        if (it.value().contains("avatar_url")) room.avatarURL = it.value()["avatar_url"];
-        if (it.value().contains("canonical_alias")) room.Alias = it.value()["canonical_alias"];
-        if (it.value().contains("name")) room.Name = it.value()["name"];
-        if (it.value().contains("num_joined_members")) room.memberCount = it.value()["num_joined_members"];
-        if (it.value().contains("topic")) room.Topic = it.value()["topic"];
-        if (it.value().contains("guest_can_join")) room.guestCanJoin = it.value()["guest_can_join"];
-        if (it.value().contains("world_readable")) room.worldReadable = it.value()["world_readable"];
-        if (it.value().contains("room_type")) room.roomType = it.value()["room_type"];
+    if (it == Index.end()) {
+        return std::nullopt;
+    }
+
+    if (std::chrono::steady_clock::now() - it->second->Added > maxAge) {
+        Entries.erase(it->second);
+        Index.erase(it);
 
-        rooms.push_back(room);
+        return std::nullopt;
     }
 
-    return rooms;
+    Entries.splice(Entries.begin(), Entries, it->second);
+
+    return it->second->userProfile;
 }
 
-std::vector<leet::Space::Space> leet::returnSpaces(const leet::User::CredentialsResponse& resp, const int Limit) {
-    std::vector<leet::Space::Space> spaces;
-    std::vector<leet::Room::Room> rooms = leet::returnRoomIDs(resp);
+void leet::User::ProfileCache::addProfile(const leet::User::Profile& userProfile) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-    for (auto& room : rooms) { // each room id
-        leet::Space::Space space;
-        std::vector<leet::Room::Room> roomsInSpace = leet::returnRoomsInSpace(resp, room.roomID, Limit);
+    insert(userProfile);
+}
 
-        for (auto& roomInSpace : roomsInSpace) { // each room in the space
-            if (roomInSpace.roomType.compare("m.space")) {
-                space.Rooms.push_back(roomInSpace);
-                continue;
-            }
+void leet::User::ProfileCache::addProfiles(const std::vector<leet::User::Profile>& userProfiles) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-            space.spaceID = roomInSpace.roomID;
-            space.joinRule = roomInSpace.joinRule;
-            space.avatarURL = roomInSpace.avatarURL;
-            space.Alias = roomInSpace.Alias;
-            space.Name = roomInSpace.Name;
-            space.memberCount = roomInSpace.memberCount;
-            space.Topic = roomInSpace.Topic;
-            space.guestCanJoin = roomInSpace.guestCanJoin;
-            space.worldReadable = roomInSpace.worldReadable;
+    for (auto& userProfile : userProfiles) {
+        insert(userProfile);
+    }
+}
 
-            space.Rooms.push_back(roomInSpace);
+void leet::User::ProfileCache::removeProfile(const std::string& userID) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
 
-            break;
-        }
+    const auto it = Index.find(userID);
 
-        spaces.push_back(space);
+    if (it != Index.end()) {
+        Entries.erase(it->second);
+        Index.erase(it);
     }
+}
 
-    return spaces;
+void leet::User::ProfileCache::clear() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    Entries.clear();
+    Index.clear();
 }
 
-void leet::toggleTyping(const leet::User::CredentialsResponse& resp, const int Timeout, const bool Typing, const leet::Room::Room& room) {
-    nlohmann::json list{};
+bool leet::checkIfUsernameIsAvailable(const std::string& Username) {
+    leet::returnClient().errorCode = 0;
 
-    list["timeout"] = Timeout;
-    list["typing"] = Typing;
+    std::string theUsername = Username;
 
-    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/typing/" + resp.userID), list.dump(), resp.accessToken) };
+    if (Username.at(0) == '@') {
+        theUsername = leet::returnUserName(Username);
+
+        if (theUsername.at(0) == '@' || !theUsername.compare("")) {
+            return false;
+            leet::returnClient().errorCode = 1;
+        }
+    }
+
+    const std::string API { leet::getAPI("/_matrix/client/v3/register/available?username=" + theUsername) };
+    const std::string Output = invokeRequest_Get(API);
 
     nlohmann::json requestResponse{};
 
     try {
         requestResponse = { nlohmann::json::parse(Output) };
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return false; // fallback to false is probably safest?
     }
 
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
-
         if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+            return false;
         }
-    }
-}
 
-void leet::inviteUserToRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
-    nlohmann::json request{};
+        if (output["available"].is_boolean()) {
+            return output["available"].get<bool>();
+        }
+    }
 
-    request["reason"] = Reason;
-    request["user_id"] = resp.userID;
+    return false;
+}
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/invite"), request.dump(), resp.accessToken) };
-    nlohmann::json requestResponse{};
+void leetFunction::addDevicesToProfiles(const leet::User::CredentialsResponse& resp, std::vector<leet::User::Profile>& profiles) {
+    std::vector<std::string> userIDs;
+    userIDs.reserve(profiles.size());
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return;
+    for (auto& profile : profiles) {
+        userIDs.push_back(profile.userID);
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    std::map<std::string, std::vector<leet::User::Device>> userDevices = leetFunction::queryDevices(resp, userIDs);
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+    for (auto& profile : profiles) {
+        auto it = userDevices.find(profile.userID);
+
+        if (it != userDevices.end()) {
+            profile.Devices = std::move(it->second);
         }
     }
 }
 
-void leet::joinRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
-    nlohmann::json body{};
+std::vector<leet::User::Profile> leet::returnUsersInRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    std::vector<leet::User::Profile> vector;
 
-    if (!Reason.compare("")) {
-        body["reason"] = Reason;
-    }
+    if (leet::returnClient().stateStore) {
+        if (auto storedMembers = leet::returnClient().stateStore->findMembers(room.roomID)) {
+            vector = std::move(*storedMembers);
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/join"), body.dump(), resp.accessToken) };
+            if (leet::returnClient().profileCache) {
+                leet::returnClient().profileCache->addProfiles(vector);
+            }
 
-    nlohmann::json requestResponse{};
+            leetFunction::addDevicesToProfiles(resp, vector);
+
+            return vector;
+        }
+    }
+
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/joined_members"), resp.accessToken);
+    nlohmann::json returnOutput{};
 
     try {
-        requestResponse = { nlohmann::json::parse(Output) };
+        returnOutput = nlohmann::json::parse(Output);
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return vector;
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    auto& users = returnOutput["joined"];
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-        }
-    }
+    for (auto it = users.begin(); it != users.end(); ++it) {
+        leet::User::Profile profile;
 
-    // You may want to refresh your room list and call /sync after this
-}
+        if (it.value().contains("avatar_url") && !it.value()["avatar_url"].is_null()) profile.avatarURL = it.value()["avatar_url"];
+        if (it.value().contains("display_name") && !it.value()["display_name"].is_null()) profile.displayName = it.value()["display_name"];
 
-void leet::leaveRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
-    nlohmann::json body{};
+        profile.userID = it.key();
 
-    if (!Reason.compare("")) {
-        body["reason"] = Reason;
+        vector.push_back(profile);
     }
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/leave"), body.dump(), resp.accessToken) };
+    if (leet::returnClient().profileCache) {
+        leet::returnClient().profileCache->addProfiles(vector);
+    }
+
+    leetFunction::addDevicesToProfiles(resp, vector);
+
+    return vector;
+}
+
+std::vector<std::string> leet::findRoomAliases(const leet::User::CredentialsResponse& resp, const std::string& roomID) {
+    std::vector<std::string> ret;
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/rooms/" + roomID + "/aliases"), resp.accessToken);
 
     nlohmann::json requestResponse{};
 
     try {
         requestResponse = { nlohmann::json::parse(Output) };
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return ret;
     }
 
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        if (!output["aliases"].is_null()) {
+            leet::returnClient().errorCode = 0;
+            return output["aliases"].get<std::vector<std::string>>();
+        } else if (!output["errcode"].is_null()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            return ret;
         }
     }
+
+    return ret;
 }
 
-void leet::kickUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
-    nlohmann::json body{};
+std::string leet::findRoomID(const std::string& Alias) {
+    std::string ret = Alias;
+    leet::returnClient().errorCode = 0;
 
-    if (!Reason.compare("")) {
-        body["reason"] = Reason;
+    if (ret.at(0) == '!') { // It's a proper room ID already
+        return ret;
     }
 
-    body["user_id"] = profile.userID;
-
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/kick"), body.dump(), resp.accessToken) };
+    // Replace the '#' character with '%23' so that Matrix is happy
+    ret.replace(0, 1, "%23");
 
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/directory/room/") + ret);
     nlohmann::json requestResponse{};
 
     try {
         requestResponse = { nlohmann::json::parse(Output) };
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return "";
     }
 
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        if (output["room_id"].is_string()) {
+            leet::returnClient().errorCode = 0;
+            return output["room_id"].get<std::string>();
+        } else if (!output["errcode"].is_null()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+            return "";
         }
     }
+
+    return "";
 }
 
-void leet::banUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
-    nlohmann::json body{};
+bool leet::removeRoomAlias(const leet::User::CredentialsResponse& resp, const std::string& Alias) {
+    std::string ret = Alias;
+    leet::returnClient().errorCode = 0;
 
-    if (!Reason.compare("")) {
-        body["reason"] = Reason;
+    if (ret.at(0) != '!') {
+        leet::returnClient().errorCode = 1;
+        return false;
     }
 
-    body["user_id"] = profile.userID;
-
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/ban"), body.dump(), resp.accessToken) };
+    // Replace the '#' character with '%23' so that Matrix is happy
+    ret.replace(0, 1, "%23");
 
+    const std::string Output = leet::invokeRequest_Delete(leet::getAPI("/_matrix/client/v3/directory/room/" + ret), resp.accessToken);
     nlohmann::json requestResponse{};
 
     try {
         requestResponse = { nlohmann::json::parse(Output) };
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return false;
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
-
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-        }
+    if (leet::returnClient().networkStatusCode == 200) {
+        return true;
     }
-}
 
-void leet::unbanUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
-    nlohmann::json body{};
+    for (auto& output : requestResponse) {
+        if (!output["errcode"].is_null()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
 
-    if (!Reason.compare("")) {
-        body["reason"] = Reason;
+            return false;
+        }
     }
 
-    body["user_id"] = profile.userID;
+    return false;
+}
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/unban"), body.dump(), resp.accessToken) };
+std::vector<leet::Room::Room> leet::returnRooms(const leet::User::CredentialsResponse& resp, const int Limit) {
+    std::vector<leet::Room::Room> vector;
 
-    nlohmann::json requestResponse{};
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/joined_rooms"), resp.accessToken);
+    nlohmann::json returnOutput{};
 
     try {
-        requestResponse = { nlohmann::json::parse(Output) };
+        returnOutput = nlohmann::json::parse(Output);
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return vector;
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    auto& rooms = returnOutput["joined_rooms"];
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-        }
+    if (!rooms.is_array()) {
+        return vector;
     }
-}
 
-bool leet::getVisibilityOfRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
-    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/directory/list/room/" + room.roomID), resp.accessToken) };
+    const std::size_t Count = Limit > 0 ? std::min<std::size_t>(rooms.size(), static_cast<std::size_t>(Limit)) : rooms.size();
 
-    nlohmann::json requestResponse{};
+    vector.resize(Count);
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return false;
+    std::vector<leet::Batch::Request> requests;
+    std::vector<std::size_t> requestIndex; // request -> index in vector
+
+    // Rooms the state store knows about are answered right away, only the rest are requested
+    for (std::size_t it{0}; it < Count; ++it) {
+        vector[it].roomID = rooms[it].get<std::string>();
+
+        if (leet::returnClient().stateStore) {
+            if (auto storedRoom = leet::returnClient().stateStore->findRoom(vector[it].roomID)) {
+                vector[it] = *storedRoom;
+                continue;
+            }
+        }
+
+        leet::Batch::Request request;
+        request.Type = leet::LEET_REQUEST_GET;
+        request.URL = leet::getAPI("/_matrix/client/v1/rooms/" + vector[it].roomID + "/hierarchy?max_depth=0&limit=1");
+        request.Authentication = resp.accessToken;
+
+        requests.push_back(request);
+        requestIndex.push_back(it);
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    const std::vector<leet::Batch::Result> results = leet::invokeBatch(requests, leet::requestConcurrency);
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-            if (output["visibility"].is_string()) {
-                if (output["visibility"].get<std::string>().compare("private")) {
-                    return true;
-                } else {
-                    return false;
-                }
+    for (std::size_t it{0}; it < results.size(); ++it) {
+        if (results[it].errorCode) {
+            continue;
+        }
+
+        try {
+            nlohmann::json roomOutput = nlohmann::json::parse(results[it].Body);
+
+            if (roomOutput["rooms"].is_array() && !roomOutput["rooms"].empty()) {
+                vector[requestIndex[it]] = leetFunction::getRoomFromHierarchy(roomOutput["rooms"][0]);
             }
+        } catch (const nlohmann::json::parse_error& e) {
         }
     }
 
-    return false;
+    leet::returnClient().errorCode = 0;
+
+    return vector;
 }
 
-void leet::setVisibilityOfRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const bool Visibility) {
-    nlohmann::json body{};
+leet::Room::Room leetFunction::getRoomFromHierarchy(nlohmann::json& theRoom) {
+    leet::Room::Room room;
 
-    body["visibility"] = Visibility ? "public" : "private";
+    if (theRoom.contains("room_id")) room.roomID = theRoom["room_id"];
+    if (theRoom.contains("join_rule")) room.joinRule = theRoom["join_rule"];
+    if (theRoom.contains("avatar_url")) room.avatarURL = theRoom["avatar_url"];
+    if (theRoom.contains("canonical_alias")) room.Alias = theRoom["canonical_alias"];
+    if (theRoom.contains("name")) room.Name = theRoom["name"];
+    if (theRoom.contains("num_joined_members")) room.memberCount = theRoom["num_joined_members"];
+    if (theRoom.contains("topic")) room.Topic = theRoom["topic"];
+    if (theRoom.contains("guest_can_join")) room.guestCanJoin = theRoom["guest_can_join"];
+    if (theRoom.contains("world_readable")) room.worldReadable = theRoom["world_readable"];
+    if (theRoom.contains("room_type")) room.roomType = theRoom["room_type"];
 
-    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/directory/list/room/" + room.roomID), body.dump(), resp.accessToken) };
+    return room;
+}
 
-    nlohmann::json requestResponse{};
+leet::Room::Room leet::returnRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    leet::Room::Room theRoom;
+    nlohmann::json returnOutput{};
+
+    if (leet::returnClient().stateStore) {
+        if (auto storedRoom = leet::returnClient().stateStore->findRoom(room.roomID)) {
+            leet::returnClient().errorCode = 0;
+            return *storedRoom;
+        }
+    }
 
     try {
-        requestResponse = { nlohmann::json::parse(Output) };
+        returnOutput = nlohmann::json::parse(leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v1/rooms/" + room.roomID + "/hierarchy"), resp.accessToken));
     } catch (const nlohmann::json::parse_error& e) {
-        return;
+        return theRoom;
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    auto& roomOutput = returnOutput["rooms"];
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-        }
+    for (auto i = roomOutput.begin(); i != roomOutput.end(); ++i) {
+        theRoom = leetFunction::getRoomFromHierarchy(i.value());
     }
+
+    return theRoom;
 }
 
-void leet::setReadMarkerPosition(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room,
-        const leet::Event::Event& fullyReadEvent, const leet::Event::Event& readEvent, const leet::Event::Event& privateReadEvent) {
+leet::Room::Room leet::upgradeRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int Version) {
+    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/upgrade" };
+
     nlohmann::json body{};
 
-    body["m.fully_read"] = fullyReadEvent.eventID;
-    body["m.read"] = readEvent.eventID;
-    body["m.read.private"] = privateReadEvent.eventID;
+    body["new_version"] = std::to_string(Version);
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/read_markers"), body.dump(), resp.accessToken) };
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI(APIUrl), body.dump(), resp.accessToken) };
 
     nlohmann::json requestResponse{};
 
     try {
         requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return;
+    }  catch (const nlohmann::json::parse_error& e) {
+        return room;
     }
 
+    std::string theRoomID{};
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-        }
+        if (output["replacement_room"].is_string()) theRoomID = output["replacement_room"].get<std::string>();
+        if (output["errcode"].is_string()) leet::returnClient().Error = output["errcode"].get<std::string>();
+        if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
     }
-}
-
-template <typename T> T leet::saveToFile(const std::string& File, T Data) {
-    std::filesystem::path file{ File };
-    std::ofstream outputFile;
 
-    if (!std::filesystem::create_directories(file.parent_path()) && !std::filesystem::is_directory(file.parent_path())) {
-        throw("Failed to create directory");
+    if (!theRoomID.compare("")) {
+        leet::Room::Room theRoom;
+        theRoom.roomID = theRoomID;
+        return leet::returnRoom(resp, theRoom);
     }
 
-    outputFile.open(File);
-    outputFile << Data;
-    outputFile.close();
-
-    return T();
+    return room;
 }
 
-template <typename T> T leet::loadFromFile(const std::string& File) {
-    std::filesystem::path file{ File };
-    std::string line;
-    if (std::filesystem::exists(file)) {
-        std::ifstream inputFile(File);
+leet::Room::Room leet::createRoom(const leet::User::CredentialsResponse& resp, const leet::Room::RoomConfiguration& conf) {
+    leet::Room::Room theRoom{};
+    nlohmann::json theJson{};
 
-        if (!inputFile.is_open()) {
-            return false;
-        }
+    theJson["creation_content"]["m.federate"] = conf.Federate;
+    theJson["name"] = conf.Name;
+    theJson["room_alias_name"] = conf.Alias;
+    theJson["topic"] = conf.Topic;
+    theJson["is_direct"] = conf.directMessage;
 
-        while (std::getline(inputFile, line)) {
-            T ret = std::stoi(line);
+    if (conf.Preset == LEET_PRESET_PUBLIC) {
+        theJson["preset"] = "public_chat";
+    } else if (conf.Preset == LEET_PRESET_PRIVATE) {
+        theJson["preset"] = "private_chat";
+    } else if (conf.Preset == LEET_PRESET_TRUSTED_PRIVATE) {
+        theJson["preset"] = "trusted_private_chat";
+    }
 
-            inputFile.close();
-            return ret;
-        }
+    const std::string Output = leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/createRoom"), theJson.dump(), resp.accessToken);
+    nlohmann::json requestResponse{};
 
-        inputFile.close();
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return theRoom;
     }
 
-    return false;
-}
-
-bool leet::saveTransID(const std::string& File) {
-    leet::saveToFile<int>(File, leet::transID);
-    return true;
-}
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
 
-bool leet::loadTransID(const std::string& File) {
-    return (leet::transID = leet::loadFromFile<int>(File));
-}
+        if (output["room_id"].is_string()) theRoom.roomID = output["room_id"].get<std::string>();
+        if (output["errcode"].is_string()) leet::returnClient().Error = output["errcode"].get<std::string>();
+        if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+    }
 
-bool constexpr leet::setTransID(int id) {
-    return (leet::transID = id);
+    return leet::returnRoom(resp, theRoom);
 }
 
-leet::Attachment::Attachment leet::uploadFile(const leet::User::CredentialsResponse& resp, const std::string& File) {
-    leet::Attachment::Attachment theAttachment;
-    const std::string Output = leet::invokeRequest_Post_File(leet::getAPI("/_matrix/media/v3/upload"), File, resp.accessToken);
+std::vector<leet::Room::Room> leet::returnRoomIDs(const leet::User::CredentialsResponse& resp) {
+    std::vector<leet::Room::Room> vector;
 
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/joined_rooms"), resp.accessToken);
     nlohmann::json returnOutput{};
+
     try {
-        returnOutput = { nlohmann::json::parse(Output) };
+        returnOutput = nlohmann::json::parse(Output);
     } catch (const nlohmann::json::parse_error& e) {
-        return theAttachment;
+        return vector;
     }
 
-    for (auto& output : returnOutput) {
-        leet::errorCode = 0;
-        leet::Error = "";
-
-        if (output["content_uri"].is_string()) {
-            theAttachment.URL = output["content_uri"].get<std::string>();
-            return theAttachment;
-        }
+    auto& rooms = returnOutput["joined_rooms"];
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-            return theAttachment;
-        }
+    for (auto it = rooms.begin(); it != rooms.end(); ++it) {
+        leet::Room::Room room;
+        room.roomID = it.value();
+        vector.push_back(room);
     }
 
-    return theAttachment;
+    return vector;
 }
 
-std::string leet::decodeFile(const leet::User::CredentialsResponse& resp, const leet::Attachment::Attachment& Attachment) {
-    std::string Server{};
-    std::string ID{};
-    std::string File{Attachment.URL};
-    std::size_t it = File.find("mxc://");
+void leetFunction::fetchSpaces(const leet::User::CredentialsResponse& resp, const std::vector<std::string>& spaceIDs, const leet::Space::HierarchyConfiguration& conf, const bool withChildren, leet::Space::Hierarchy& theHierarchy) {
+    /**
+     * @brief Class that represents a space whose pages are still being fetched
+     */
+    class Walk {
+        private:
+        public:
+            std::string spaceID{};
+            std::string nextBatch{}; // Token of the next page, empty for the first page
+            leet::Room::Room Summary{};
+            std::vector<std::string> childOrder{}; // Children in the order of the m.space.child events of the space
+            std::map<std::string, leet::Room::Room> Children{};
+    };
 
-    if (it != std::string::npos) {
-        it += 6;
-        std::size_t nextSlash = File.find("/", it);
+    const std::shared_ptr<leet::Space::HierarchyCache> hierarchyCache = leet::returnClient().hierarchyCache;
+    std::vector<Walk> Pending{};
 
-        if (nextSlash != std::string::npos) {
-            Server = File.substr(it, nextSlash - it);
-            ID = File.substr(nextSlash + 1);
-        } else {
-            leet::errorCode = 1;
-            return "";
+    for (auto& spaceID : spaceIDs) {
+        if (hierarchyCache && withChildren) {
+            if (auto cachedSpace = hierarchyCache->findSpace(spaceID, conf.suggestedOnly)) {
+                theHierarchy.Spaces[spaceID] = std::move(*cachedSpace);
+                continue;
+            }
         }
-    }
 
-    return leet::getAPI("/_matrix/media/v3/download/" + Server + "/" + ID + "?allow_redirect=false");
-}
+        Walk theWalk{};
+        theWalk.spaceID = spaceID;
+        theWalk.Summary.roomID = spaceID;
 
-bool leet::downloadFile(const leet::User::CredentialsResponse& resp, const leet::Attachment::Attachment& Attachment, const std::string& outputFile) {
-    std::string Server{};
-    std::string ID{};
-    std::string File{Attachment.URL};
-    std::size_t it = File.find("mxc://");
+        Pending.push_back(theWalk);
+    }
 
-    if (it != std::string::npos) {
-        it += 6;
-        std::size_t nextSlash = File.find("/", it);
+    // Each round asks for the next page of every space at the same time, the pages of a single space have to be fetched one by one
+    while (!Pending.empty()) {
+        std::vector<leet::Batch::Request> requests;
 
-        if (nextSlash != std::string::npos) {
-            Server = File.substr(it, nextSlash - it);
-            ID = File.substr(nextSlash + 1);
-        } else {
-            leet::errorCode = 1;
-            return false;
+        for (auto& theWalk : Pending) {
+            leet::Batch::Request request;
+            request.Type = leet::LEET_REQUEST_GET;
+            request.URL = leet::getAPI("/_matrix/client/v1/rooms/" + theWalk.spaceID + "/hierarchy?max_depth=" + (withChildren ? "1" : "0")
+                + "&limit=" + std::to_string(std::max(conf.pageSize, 1)) + (conf.suggestedOnly ? "&suggested_only=true" : "")
+                + (theWalk.nextBatch.compare("") ? "&from=" + leetFunction::encodeURL(theWalk.nextBatch) : ""));
+            request.Authentication = resp.accessToken;
+
+            requests.push_back(request);
         }
-    }
 
-    // Now that we have what we need, let's make a request
-    const std::string API { leet::getAPI("/_matrix/media/v3/download/" + Server + "/" + ID + "?allow_redirect=false") };
-    std::filesystem::path file{ outputFile };
+        const std::vector<leet::Batch::Result> results = leet::invokeBatch(requests, leet::requestConcurrency);
+        std::vector<Walk> stillPending{};
 
-    if (!std::filesystem::create_directories(file.parent_path()) && !std::filesystem::is_directory(file.parent_path())) {
-        leet::errorCode = 1;
-        return false;
-    }
+        for (std::size_t it{0}; it < results.size(); ++it) {
+            Walk& theWalk = Pending[it];
+            nlohmann::json returnOutput{};
 
-    /*
-    std::ofstream of(outputFile, std::ios::binary);
-    cpr::Response response = cpr::Download(of, cpr::Url{API});
+            if (results[it].errorCode) {
+                theHierarchy.Complete = false;
+                continue;
+            }
+
+            try {
+                returnOutput = nlohmann::json::parse(results[it].Body);
+            } catch (const nlohmann::json::parse_error& e) {
+                theHierarchy.Complete = false;
+                continue;
+            }
+
+            if (returnOutput["rooms"].is_array()) {
+                for (auto& theRoom : returnOutput["rooms"]) {
+                    leet::Room::Room room = leetFunction::getRoomFromHierarchy(theRoom);
+
+                    if (room.roomID.compare(theWalk.spaceID)) {
+                        theWalk.Children[room.roomID] = room;
+                        continue;
+                    }
+
+                    theWalk.Summary = room;
+
+                    if (!theRoom["children_state"].is_array()) {
+                        continue;
+                    }
+
+                    for (auto& childEvent : theRoom["children_state"]) {
+                        if (childEvent["state_key"].is_string()) {
+                            theWalk.childOrder.push_back(childEvent["state_key"].get<std::string>());
+                        }
+                    }
+                }
+            }
+
+            if (returnOutput["next_batch"].is_string() && returnOutput["next_batch"].get<std::string>().compare("")) {
+                theWalk.nextBatch = returnOutput["next_batch"].get<std::string>();
+                stillPending.push_back(std::move(theWalk));
+                continue;
+            }
+
+            leet::Space::Space theSpace{};
+
+            static_cast<leet::Room::Room&>(theSpace) = theWalk.Summary;
+            theSpace.spaceID = theWalk.spaceID;
+            theSpace.roomType = theWalk.Summary.roomType;
+
+            // Children the server returned without an m.space.child event in the space, if any, go last
+            for (auto& childID : theWalk.childOrder) {
+                auto child = theWalk.Children.find(childID);
+
+                if (child != theWalk.Children.end()) {
+                    theSpace.Rooms.push_back(std::move(child->second));
+                    theWalk.Children.erase(child);
+                }
+            }
+
+            for (auto& child : theWalk.Children) {
+                theSpace.Rooms.push_back(std::move(child.second));
+            }
+
+            if (hierarchyCache && withChildren) {
+                hierarchyCache->addSpace(theSpace, conf.suggestedOnly);
+            }
+
+            theHierarchy.Spaces[theWalk.spaceID] = std::move(theSpace);
+        }
+
+        Pending = std::move(stillPending);
+    }
+}
+
+leet::Space::Hierarchy leet::returnHierarchy(const leet::User::CredentialsResponse& resp, const std::string& spaceID, const leet::Space::HierarchyConfiguration& conf) {
+    leet::Space::Hierarchy theHierarchy{};
+
+    theHierarchy.spaceID = spaceID;
+
+    if (spaceID.empty() || spaceID.at(0) != '!') {
+        theHierarchy.Complete = false;
+        return theHierarchy;
+    }
+
+    std::vector<std::string> Level{ spaceID };
+    std::size_t roomCount{0};
+
+    // The hierarchy is walked one level at a time, so all sub-spaces at the same depth are fetched at the same time
+    for (int Depth{0}; !Level.empty(); ++Depth) {
+        const bool withChildren = conf.maxDepth < 0 || Depth < conf.maxDepth;
+
+        leetFunction::fetchSpaces(resp, Level, conf, withChildren, theHierarchy);
+
+        if (!withChildren) {
+            break;
+        }
+
+        std::vector<std::string> nextLevel{};
+
+        for (auto& levelID : Level) {
+            auto theSpace = theHierarchy.Spaces.find(levelID);
+
+            if (theSpace == theHierarchy.Spaces.end()) {
+                continue;
+            }
+
+            roomCount += theSpace->second.Rooms.size();
+
+            for (auto& child : theSpace->second.Rooms) {
+                if (!child.roomType.compare("m.space") && !theHierarchy.Spaces.count(child.roomID)
+                    && std::find(nextLevel.begin(), nextLevel.end(), child.roomID) == nextLevel.end()) {
+                    nextLevel.push_back(child.roomID);
+                }
+            }
+        }
+
+        if (conf.maxRooms > 0 && roomCount >= static_cast<std::size_t>(conf.maxRooms)) {
+            break;
+        }
+
+        Level = std::move(nextLevel);
+    }
+
+    leet::returnClient().errorCode = theHierarchy.Complete ? 0 : 1;
+
+    return theHierarchy;
+}
+
+const std::vector<leet::Room::Room> leet::returnRoomsInSpace(const leet::User::CredentialsResponse& resp, const std::string& spaceID, const int Limit) {
+    std::vector<leet::Room::Room> rooms;
+    if (spaceID.empty() || spaceID.at(0) != '!') {
+        return rooms;
+    }
+
+    leet::Space::HierarchyConfiguration conf{};
+    conf.maxRooms = Limit > 0 ? Limit : 0;
+
+    const leet::Space::Hierarchy theHierarchy = leet::returnHierarchy(resp, spaceID, conf);
+    const auto theSpace = theHierarchy.Spaces.find(spaceID);
+
+    if (theSpace == theHierarchy.Spaces.end()) {
+        return rooms;
+    }
+
+    std::set<std::string> Added{ spaceID };
+    std::deque<const leet::Space::Space*> Queue{ &theSpace->second };
+
+    rooms.push_back(theSpace->second);
+
+    // Breadth first, so the rooms closest to the space come first
+    while (!Queue.empty() && (Limit <= 0 || rooms.size() < static_cast<std::size_t>(Limit))) {
+        const leet::Space::Space* currentSpace = Queue.front();
+        Queue.pop_front();
+
+        for (auto& child : currentSpace->Rooms) {
+            if (!Added.insert(child.roomID).second) {
+                continue;
+            }
+
+            rooms.push_back(child);
+
+            auto childSpace = theHierarchy.Spaces.find(child.roomID);
+
+            if (childSpace != theHierarchy.Spaces.end()) {
+                Queue.push_back(&childSpace->second);
+            }
+        }
+    }
+
+    if (Limit > 0 && rooms.size() > static_cast<std::size_t>(Limit)) {
+        rooms.resize(Limit);
+    }
+
+    return rooms;
+}
+
+std::vector<leet::Space::Space> leet::returnSpaces(const leet::User::CredentialsResponse& resp, const int Limit) {
+    std::vector<leet::Space::Space> spaces;
+    std::vector<leet::Room::Room> rooms = leet::returnRoomIDs(resp);
+    std::vector<std::string> roomIDs;
+
+    // Rooms the state store knows are not spaces don't have to be asked about
+    for (auto& room : rooms) {
+        if (leet::returnClient().stateStore) {
+            if (auto storedRoom = leet::returnClient().stateStore->findRoom(room.roomID)) {
+                if (storedRoom->roomType.compare("m.space")) {
+                    continue;
+                }
+            }
+        }
+
+        roomIDs.push_back(room.roomID);
+    }
+
+    leet::Space::Hierarchy theHierarchy{};
+    leetFunction::fetchSpaces(resp, roomIDs, leet::Space::HierarchyConfiguration{}, true, theHierarchy);
+
+    for (auto& roomID : roomIDs) {
+        auto theSpace = theHierarchy.Spaces.find(roomID);
+
+        if (theSpace == theHierarchy.Spaces.end() || theSpace->second.roomType.compare("m.space")) {
+            continue;
+        }
+
+        spaces.push_back(std::move(theSpace->second));
+
+        if (Limit > 0 && spaces.size() >= static_cast<std::size_t>(Limit)) {
+            break;
+        }
+    }
+
+    leet::returnClient().errorCode = 0;
+
+    return spaces;
+}
+
+std::optional<leet::Space::Space> leet::Space::HierarchyCache::findSpace(const std::string& spaceID, const bool suggestedOnly) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    const auto it = Spaces.find(spaceID + (suggestedOnly ? "/suggested" : "/all"));
+
+    if (it == Spaces.end() || std::chrono::steady_clock::now() - it->second.Fetched > maxAge) {
+        return std::nullopt;
+    }
+
+    return it->second.theSpace;
+}
+
+void leet::Space::HierarchyCache::addSpace(const leet::Space::Space& theSpace, const bool suggestedOnly) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    Entry& theEntry = Spaces[theSpace.spaceID + (suggestedOnly ? "/suggested" : "/all")];
+
+    theEntry.theSpace = theSpace;
+    theEntry.Fetched = std::chrono::steady_clock::now();
+}
+
+void leet::Space::HierarchyCache::removeSpace(const std::string& spaceID) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    Spaces.erase(spaceID + "/suggested");
+    Spaces.erase(spaceID + "/all");
+}
+
+void leet::Space::HierarchyCache::clear() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    Spaces.clear();
+}
+
+void leet::toggleTyping(const leet::User::CredentialsResponse& resp, const int Timeout, const bool Typing, const leet::Room::Room& room) {
+    nlohmann::json list{};
+
+    list["timeout"] = Timeout;
+    list["typing"] = Typing;
+
+    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/typing/" + resp.userID), list.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+void leet::inviteUserToRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
+    nlohmann::json request{};
+
+    request["reason"] = Reason;
+    request["user_id"] = resp.userID;
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/invite"), request.dump(), resp.accessToken) };
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+void leet::joinRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
+    nlohmann::json body{};
+
+    if (!Reason.compare("")) {
+        body["reason"] = Reason;
+    }
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/join"), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+
+    // You may want to refresh your room list and call /sync after this
+}
+
+void leet::leaveRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
+    nlohmann::json body{};
+
+    if (!Reason.compare("")) {
+        body["reason"] = Reason;
+    }
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/leave"), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+void leet::kickUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
+    nlohmann::json body{};
+
+    if (!Reason.compare("")) {
+        body["reason"] = Reason;
+    }
+
+    body["user_id"] = profile.userID;
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/kick"), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+void leet::banUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
+    nlohmann::json body{};
+
+    if (!Reason.compare("")) {
+        body["reason"] = Reason;
+    }
+
+    body["user_id"] = profile.userID;
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/ban"), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+void leet::unbanUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
+    nlohmann::json body{};
+
+    if (!Reason.compare("")) {
+        body["reason"] = Reason;
+    }
+
+    body["user_id"] = profile.userID;
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/unban"), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+bool leet::getVisibilityOfRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/directory/list/room/" + room.roomID), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return false;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+            if (output["visibility"].is_string()) {
+                if (output["visibility"].get<std::string>().compare("private")) {
+                    return true;
+                } else {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+void leet::setVisibilityOfRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const bool Visibility) {
+    nlohmann::json body{};
+
+    body["visibility"] = Visibility ? "public" : "private";
+
+    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/directory/list/room/" + room.roomID), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+void leet::setReadMarkerPosition(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room,
+        const leet::Event::Event& fullyReadEvent, const leet::Event::Event& readEvent, const leet::Event::Event& privateReadEvent) {
+    nlohmann::json body{};
+
+    body["m.fully_read"] = fullyReadEvent.eventID;
+    body["m.read"] = readEvent.eventID;
+    body["m.read.private"] = privateReadEvent.eventID;
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/read_markers"), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+template <typename T> T leet::saveToFile(const std::string& File, T Data) {
+    std::filesystem::path file{ File };
+    std::ofstream outputFile;
+
+    if (!std::filesystem::create_directories(file.parent_path()) && !std::filesystem::is_directory(file.parent_path())) {
+        throw("Failed to create directory");
+    }
+
+    outputFile.open(File);
+    outputFile << Data;
+    outputFile.close();
+
+    return T();
+}
+
+template <typename T> T leet::loadFromFile(const std::string& File) {
+    std::filesystem::path file{ File };
+    std::string line;
+    if (std::filesystem::exists(file)) {
+        std::ifstream inputFile(File);
+
+        if (!inputFile.is_open()) {
+            return false;
+        }
+
+        while (std::getline(inputFile, line)) {
+            T ret = std::stoi(line);
+
+            inputFile.close();
+            return ret;
+        }
+
+        inputFile.close();
+    }
+
+    return false;
+}
+
+std::string leetFunction::returnTransactionID() {
+    leet::Client& theClient = leet::returnClient();
+
+    if (!theClient.transactionIDs) {
+        return std::to_string(theClient.transID);
+    }
+
+    const std::int64_t ID = theClient.transactionIDs->allocate();
+
+    // Falling back to transID could reuse an ID the allocator has handed out, so the event is not sent at all
+    if (ID < 0) {
+        theClient.errorCode = 1;
+        theClient.friendlyError = "Failed to reserve a transaction ID";
+
+        return "";
+    }
+
+    return std::to_string(ID);
+}
+
+bool leet::TransactionIDAllocator::open(const std::string& theFile, const std::int64_t First) {
+    std::lock_guard<std::mutex> lock(reserveMutex);
+
+    File = theFile;
+    std::int64_t Start = First;
+
+    if (File.compare("") && std::filesystem::exists(File)) {
+        std::ifstream inputFile(File);
+
+        if (!(inputFile >> Start)) {
+            return false;
+        }
+    }
+
+    Next = Start;
+    Reserved = Start;
+
+    return true;
+}
+
+bool leet::TransactionIDAllocator::reserve(const std::int64_t ID) {
+    std::lock_guard<std::mutex> lock(reserveMutex);
+
+    // Another thread may have reserved the block while this one was waiting for the lock
+    if (ID < Reserved.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    const std::int64_t End = ID + std::max<std::int64_t>(blockSize, 1);
+
+    if (File.compare("")) {
+        const std::filesystem::path filePath{ File };
+        const std::string tempFile = File + ".tmp";
+
+        if (filePath.has_parent_path()) {
+            std::error_code ec;
+            std::filesystem::create_directories(filePath.parent_path(), ec);
+        }
+
+        /* Written to a temporary file first and renamed over the old one, so a crash
+         * in the middle of writing leaves the previous block behind rather than nothing.
+         */
+        std::FILE* outputFile = std::fopen(tempFile.c_str(), "w");
+
+        if (!outputFile) {
+            return false;
+        }
+
+        const std::string Data = std::to_string(End) + "\n";
+        bool Written = std::fwrite(Data.data(), 1, Data.size(), outputFile) == Data.size() && !std::fflush(outputFile);
+
+#ifdef _WIN32
+        Written = Written && !_commit(_fileno(outputFile));
+#else
+        Written = Written && !fsync(fileno(outputFile));
+#endif
+
+        if (std::fclose(outputFile) || !Written) {
+            return false;
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tempFile, File, ec);
+
+        if (ec) {
+            return false;
+        }
+
+#ifndef _WIN32
+        // The rename itself is only durable once the directory has been synced
+        const std::string Directory = filePath.has_parent_path() ? filePath.parent_path().string() : ".";
+        const int directoryDescriptor = ::open(Directory.c_str(), O_RDONLY);
+
+        if (directoryDescriptor >= 0) {
+            fsync(directoryDescriptor);
+            close(directoryDescriptor);
+        }
+#endif
+    }
+
+    Reserved.store(End, std::memory_order_release);
+
+    return true;
+}
+
+std::shared_ptr<leet::TransactionIDAllocator> leet::Client::returnCallTransactionIDs() {
+    static const std::shared_ptr<leet::TransactionIDAllocator> theAllocator = []() {
+        auto theAllocator = std::make_shared<leet::TransactionIDAllocator>();
+        const std::int64_t Now = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        // Above every value transID can hold, and later than the IDs of a previous run unless it sent more than one event per millisecond
+        theAllocator->open("", std::max<std::int64_t>(Now, static_cast<std::int64_t>(std::numeric_limits<int>::max()) + 1));
+
+        return theAllocator;
+    }();
+
+    return theAllocator;
+}
+
+std::int64_t leet::TransactionIDAllocator::allocate() {
+    const std::int64_t ID = Next.fetch_add(1, std::memory_order_relaxed);
+
+    if (ID >= Reserved.load(std::memory_order_acquire) && !reserve(ID)) {
+        return -1;
+    }
+
+    return ID;
+}
+
+bool leet::saveTransID(const std::string& File) {
+    leet::saveToFile<int>(File, leet::returnClient().transID);
+    return true;
+}
+
+bool leet::loadTransID(const std::string& File) {
+    return (leet::returnClient().transID = leet::loadFromFile<int>(File));
+}
+
+bool leet::setTransID(int id) {
+    return (leet::returnClient().transID = id);
+}
+
+leet::Attachment::Attachment leet::uploadFile(const leet::User::CredentialsResponse& resp, const std::string& File) {
+    leet::Attachment::Attachment theAttachment;
+    const std::string Output = leet::invokeRequest_Post_File(leet::getAPI("/_matrix/media/v3/upload"), File, resp.accessToken);
+
+    nlohmann::json returnOutput{};
+    try {
+        returnOutput = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return theAttachment;
+    }
+
+    for (auto& output : returnOutput) {
+        leet::returnClient().errorCode = 0;
+        leet::returnClient().Error = "";
+
+        if (output["content_uri"].is_string()) {
+            theAttachment.URL = output["content_uri"].get<std::string>();
+            return theAttachment;
+        }
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+            return theAttachment;
+        }
+    }
+
+    return theAttachment;
+}
+
+std::string leet::decodeFile(const leet::User::CredentialsResponse& resp, const leet::Attachment::Attachment& Attachment) {
+    std::string Server{};
+    std::string ID{};
+    std::string File{Attachment.URL};
+    std::size_t it = File.find("mxc://");
+
+    if (it != std::string::npos) {
+        it += 6;
+        std::size_t nextSlash = File.find("/", it);
+
+        if (nextSlash != std::string::npos) {
+            Server = File.substr(it, nextSlash - it);
+            ID = File.substr(nextSlash + 1);
+        } else {
+            leet::returnClient().errorCode = 1;
+            return "";
+        }
+    }
+
+    return leet::getAPI("/_matrix/media/v3/download/" + Server + "/" + ID + "?allow_redirect=false");
+}
+
+bool leet::downloadFile(const leet::User::CredentialsResponse& resp, const leet::Attachment::Attachment& Attachment, const std::string& outputFile) {
+    std::string Server{};
+    std::string ID{};
+    std::string File{Attachment.URL};
+    std::size_t it = File.find("mxc://");
+
+    if (it != std::string::npos) {
+        it += 6;
+        std::size_t nextSlash = File.find("/", it);
+
+        if (nextSlash != std::string::npos) {
+            Server = File.substr(it, nextSlash - it);
+            ID = File.substr(nextSlash + 1);
+        } else {
+            leet::returnClient().errorCode = 1;
+            return false;
+        }
+    }
+
+    // Now that we have what we need, let's make a request
+    const std::string API { leet::getAPI("/_matrix/media/v3/download/" + Server + "/" + ID + "?allow_redirect=false") };
+    std::filesystem::path file{ outputFile };
+
+    if (!std::filesystem::create_directories(file.parent_path()) && !std::filesystem::is_directory(file.parent_path())) {
+        leet::returnClient().errorCode = 1;
+        return false;
+    }
+
+    /*
+    std::ofstream of(outputFile, std::ios::binary);
+    cpr::Response response = cpr::Download(of, cpr::Url{API});
     if (response.status_code == 200) {
         return true;
     }
-    */
+    */
+    leetRequest::URL url;
+    leetRequest::Request request;
+
+    url.parseURLFromString(API);
+
+    request.Host = url.Host;
+    request.Endpoint = url.Endpoint;
+    request.Query = url.Query;
+    request.Port = url.Port;
+    request.Protocol = url.Protocol;
+    request.Type = leetRequest::LEET_REQUEST_REQTYPE_GET;
+    request.userAgent = "LIBLEET_USER_AGENT";
+    request.outputFile = outputFile;
+
+    return request.downloadFile();
+}
+
+leet::URL::URLPreview leet::getURLPreview(const leet::User::CredentialsResponse& resp, const std::string& URL, const int64_t time) {
+    leet::URL::URLPreview preview;
+    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/media/v3/preview_url?ts=" + std::to_string(time) + "&url=" + URL), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return preview;
+    }
+
+    preview.URL = URL;
+    preview.Time = time;
+
+    for (auto& output : requestResponse) {
+        if (output["og:image"].is_string()) preview.imageURL = output["og:image"].get<std::string>();
+        if (output["og:image:type"].is_string()) preview.Type = output["og:image:type"].get<std::string>();
+        if (output["og:image:width"].is_number_integer()) preview.imageWidth = output["og:image:width"].get<int>();
+        if (output["og:image:height"].is_number_integer()) preview.imageHeight = output["og:image:height"].get<int>();
+        if (output["matrix:image:size"].is_number_integer()) preview.imageSize = output["matrix:image:size"].get<int>();
+        if (output["og:title"].is_string()) preview.Title = output["og:title"].get<std::string>();
+        if (output["og:description"].is_string()) preview.Description = output["og:description"].get<std::string>();
+    }
+
+    return preview;
+}
+
+int64_t leet::returnUnixTimestamp() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+leet::Event::Event leet::returnEventFromTimestamp(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int64_t Timestamp, const bool Direction) {
+    leet::Event::Event event;
+    std::string Dir = Direction ? "f" : "b";
+
+    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v1/rooms/" + room.roomID + "/timestamp_to_event" + "?ts=" + std::to_string(Timestamp) + "&dir=" + Dir), resp.accessToken);
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return event;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["event_id"].is_string()) event.eventID = output["event_id"].get<std::string>();
+        if (output["origin_server_ts"].is_number_integer()) event.Age = output["origin_server_ts"].get<int>();
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+            break;
+        }
+    }
+
+    return event;
+}
+
+leet::Event::Event leet::returnLatestEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    return leet::returnEventFromTimestamp(resp, room, leet::returnUnixTimestamp(), true);
+}
+
+void leet::redactEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Event& event, const std::string& Reason) {
+
+    nlohmann::json body{};
+
+    if (Reason.compare("")) {
+        body["reason"] = Reason;
+    }
+
+    const std::string transactionID { leetFunction::returnTransactionID() };
+
+    if (!transactionID.compare("")) {
+        return;
+    }
+
+    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/redact/" + event.eventID + "/" + transactionID), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+
+}
+
+void leet::reportEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Event& event, const std::string& Reason, const int Score) {
+    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/report/" + event.eventID };
+
+    nlohmann::json body{};
+
+    body["reason"] = Reason;
+    if (Score > 0 || Score < -100) {
+        body["score"] = 0;
+    } else {
+        body["score"] = Score;
+    }
+
+    const std::string Output { leet::invokeRequest_Post(leet::getAPI(APIUrl), body.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    }  catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) leet::returnClient().Error = output["errcode"].get<std::string>();
+        if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+    }
+}
+
+void leet::sendMessage(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Message& msg) {
+    const std::string eventType { "m.room.message" };
+    const std::string transactionID { leetFunction::returnTransactionID() };
+
+    if (!transactionID.compare("")) {
+        return;
+    }
+
+    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/send/" + eventType + "/" + transactionID };
+    std::string messageType { "m.text" };
+
+    switch (msg.msgType) {
+        case leet::LEET_MESSAGETYPE_IMAGE:
+            messageType = "m.image";
+            break;
+        case leet::LEET_MESSAGETYPE_AUDIO:
+            messageType = "m.audio";
+            break;
+        case leet::LEET_MESSAGETYPE_VIDEO:
+            messageType = "m.video";
+            break;
+        case leet::LEET_MESSAGETYPE_FILE:
+            messageType = "m.file";
+            break;
+        case leet::LEET_MESSAGETYPE_NOTICE:
+            messageType = "m.notice";
+            break;
+        case leet::LEET_MESSAGETYPE_EMOTE:
+            messageType = "m.emote";
+            break;
+        case leet::LEET_MESSAGETYPE_STRING:
+            messageType = msg.messageType;
+            if (!messageType.compare("")) {
+                messageType = "m.text";
+            }
+            break;
+        default:
+            messageType = "m.text";
+            break;
+    }
+
+    nlohmann::json list{};
+
+    // attachment
+    if (!messageType.compare("m.image") || !messageType.compare("m.audio") || !messageType.compare("m.video") || !messageType.compare("m.file")) {
+        if (msg.attachmentURL.at(0) != 'm' || msg.attachmentURL.at(1) != 'x' || msg.attachmentURL.at(2) != 'c') {
+            leet::returnClient().errorCode = 1;
+            return;
+        }
+
+        list["type"] = "m.room.message";
+        list["room_id"] = room.roomID;
+
+        if ((msg.bodyType == leet::LEET_BODYTYPE_BASIC) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
+            list["body"] = msg.messageText;
+        }
+
+        if ((msg.bodyType == leet::LEET_BODYTYPE_FORMATTED) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
+            list["formatted_body"] = msg.formattedText;
+
+            if (!msg.Format.compare("")) {
+                list["format"] = "org.matrix.custom.html";
+            } else {
+                list["format"] = msg.Format;
+            }
+        }
+
+        list["msgtype"] = messageType;
+        list["url"] = msg.attachmentURL;
+
+        list["m.mentions"]["user_ids"] = msg.mentionedUserIDs;
+
+        if (msg.replyEvent.eventID.compare("")) {
+            list["m.relates_to"]["m.in_reply_to"]["event_id"] = msg.replyEvent.eventID;
+        }
+    } else { // plain text/formatted text
+        list["type"] = "m.room.message";
+        list["room_id"] = room.roomID;
+        list["body"] = msg.messageText;
+        list["msgtype"] = messageType;
+
+        if ((msg.bodyType == leet::LEET_BODYTYPE_BASIC) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
+            list["body"] = msg.messageText;
+        }
+
+        if ((msg.bodyType == leet::LEET_BODYTYPE_FORMATTED) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
+            list["formatted_body"] = msg.formattedText;
+
+            if (!msg.Format.compare("")) {
+                list["format"] = "org.matrix.custom.html";
+            } else {
+                list["format"] = msg.Format;
+            }
+        }
+
+        list["m.mentions"]["user_ids"] = msg.mentionedUserIDs;
+
+        if (msg.replyEvent.eventID.compare("")) {
+            list["m.relates_to"]["m.in_reply_to"]["event_id"] = msg.replyEvent.eventID;
+        }
+    }
+
+    const std::string Output { leet::invokeRequest_Put(leet::getAPI(APIUrl), list.dump(), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+
+// TODO: support other message types than m.text
+#ifndef LEET_NO_ENCRYPTION
+void leet::sendEncryptedMessage(const leet::User::CredentialsResponse& resp, leet::Encryption& enc, const leet::Room::Room& room, const leet::Event::Message& msg) {
+    std::string eventType { "m.room.encrypted" };
+    const std::string transactionID { leetFunction::returnTransactionID() };
+
+    if (!transactionID.compare("")) {
+        return;
+    }
+
+    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/send/" + eventType + "/" + transactionID };
+
+    nlohmann::json Body{};
+
+    Body["type"] = "m.room.message";
+    Body["room_id"] = room.roomID;
+
+    if ((msg.bodyType == leet::LEET_BODYTYPE_BASIC) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
+        Body["body"] = msg.messageText;
+    }
+
+    if ((msg.bodyType == leet::LEET_BODYTYPE_FORMATTED) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
+        Body["formatted_body"] = msg.formattedText;
+
+        if (!msg.Format.compare("")) {
+            Body["format"] = "org.matrix.custom.html";
+        } else {
+            Body["format"] = msg.Format;
+        }
+    }
+
+    Body["content"]["msgtype"] = "m.text";
+    Body["m.mentions"]["user_ids"] = msg.mentionedUserIDs;
+
+    if (msg.replyEvent.eventID.compare("")) {
+        Body["m.relates_to"]["m.in_reply_to"]["event_id"] = msg.replyEvent.eventID;
+    }
+
+    const std::string Output { leet::invokeRequest_Put(leet::getAPI(APIUrl), enc.account.encryptMessage(resp, Body.dump()), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+}
+#endif
+
+leet::Event::Event leet::getStateFromType(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& eventType, const std::string& stateKey) {
+    leet::Event::Event event;
+    leet::returnClient().errorCode = 0;
+
+    if (leet::returnClient().stateStore) {
+        if (auto storedEvent = leet::returnClient().stateStore->findState(room.roomID, eventType, stateKey)) {
+            event.eventID = storedEvent->eventID;
+            event.eventContent = storedEvent->eventContent;
+            event.Age = storedEvent->originServerTS;
+
+            return event;
+        }
+    }
+
+    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/state/" + eventType + "/" + stateKey), resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    }  catch (const nlohmann::json::parse_error& e) {
+        return event;
+    }
+
+    event.eventContent = Output;
+
+    for (auto& output : requestResponse) {
+        if (output["event_id"].is_string()) event.eventID = output["event_id"].get<std::string>();
+        if (output["origin_server_ts"].is_number_integer()) event.Age = output["origin_server_ts"].get<int>();
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+        }
+
+        if (output["error"].is_string())
+            leet::returnClient().friendlyError = output["error"].get<std::string>();
+    }
+
+    return event;
+}
+
+leet::Event::Event leet::setStateFromType(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& eventType, const std::string& stateKey, const std::string& Body) {
+    leet::Event::Event event;
+    leet::returnClient().errorCode = 0;
+    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/state/" + eventType + "/" + stateKey), Body, resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return event;
+    }
+
+    for (auto& output : requestResponse) {
+        if (output["event_id"].is_string()) event.eventID = output["event_id"].get<std::string>();
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            leet::returnClient().errorCode = 1;
+        }
+
+        if (output["error"].is_string())
+            leet::returnClient().friendlyError = output["error"].get<std::string>();
+    }
+
+    return event;
+}
+
+leet::Event::Message leetFunction::getMessageFromEvent(nlohmann::json& theEvent) {
+    leet::Event::Message message;
+
+    message.Encrypted = false;
+
+    if (theEvent.contains("/type"_json_pointer)) message.Type = theEvent["type"];
+
+    // Encrypted message
+    if (!message.Type.compare("m.room.encrypted")) {
+        message.Encrypted = true;
+        message.megolm = false;
+
+        if (theEvent.contains("/content/ciphertext"_json_pointer)) message.cipherText = theEvent["content"]["ciphertext"];
+        if (theEvent.contains("/content/sender_key"_json_pointer)) message.senderKey = theEvent["content"]["sender_key"];
+        if (theEvent.contains("/content/device_id"_json_pointer)) message.deviceID = theEvent["content"]["device_id"];
+        if (theEvent.contains("/content/session_id"_json_pointer)) message.sessionID = theEvent["content"]["session_id"];
+        if (theEvent.contains("/content/algorithm"_json_pointer)) if (theEvent["content"]["algorithm"] == "m.megolm.v1.aes-sha2") message.megolm = true;
+    }
+
+    if (theEvent.contains("/content/msgtype"_json_pointer)) message.messageType = theEvent["content"]["msgtype"];
+    if (theEvent.contains("/sender"_json_pointer)) message.Sender = theEvent["sender"];
+
+    if (theEvent.contains("/content/body"_json_pointer)) message.messageText = theEvent["content"]["body"];
+    if (theEvent.contains("/content/formatted_body"_json_pointer)) message.formattedText = theEvent["content"]["formatted_body"];
+    if (theEvent.contains("/content/format"_json_pointer)) message.Format = theEvent["content"]["format"];
+    if (theEvent.contains("/content/info/mimetype"_json_pointer)) message.mimeType = theEvent["content"]["info"]["mimetype"];
+    if (theEvent.contains("/event_id"_json_pointer)) message.eventID = theEvent["event_id"];
+    if (theEvent.contains("/origin_server_ts"_json_pointer)) message.Age = theEvent["origin_server_ts"];
+
+    // Attachments
+    if (theEvent.contains("/content/info/size"_json_pointer)) message.attachmentSize = theEvent["content"]["info"]["size"];
+    if (theEvent.contains("/content/info/duration"_json_pointer)) message.attachmentLength = theEvent["content"]["info"]["duration"];
+    if (theEvent.contains("/content/info/w"_json_pointer)) message.attachmentWidth = theEvent["content"]["info"]["w"];
+    if (theEvent.contains("/content/info/h"_json_pointer)) message.attachmentHeight = theEvent["content"]["info"]["h"];
+    if (theEvent.contains("/content/url"_json_pointer)) message.attachmentURL = theEvent["content"]["url"];
+
+    // Handle thumbnails
+    if (!message.messageType.compare("m.video")) {
+        if (theEvent.contains("/content/info/thumbnail_info/w"_json_pointer)) message.thumbnailWidth = theEvent["content"]["info"]["thumbnail_info"]["w"];
+        if (theEvent.contains("/content/info/thumbnail_info/h"_json_pointer)) message.thumbnailHeight = theEvent["content"]["info"]["thumbnail_info"]["h"];
+        if (theEvent.contains("/content/info/thumbnail_info/size"_json_pointer)) message.thumbnailSize = theEvent["content"]["info"]["thumbnail_info"]["size"];
+        if (theEvent.contains("/content/info/thumbnail_info/mimetype"_json_pointer)) message.thumbnailMimeType = theEvent["content"]["info"]["thumbnail_info"]["mimetype"];
+        if (theEvent.contains("/content/info/thumbnail_url"_json_pointer)) message.thumbnailURL = theEvent["content"]["info"]["thumbnail_url"];
+    }
+
+    return message;
+}
+
+std::vector<leet::Event::Message> leet::returnMessages(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int messageCount) {
+    return leet::returnMessages(resp, room, messageCount, leet::Filter::RoomEventFilter{});
+}
+
+std::vector<leet::Event::Message> leet::returnMessages(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int messageCount, const leet::Filter::RoomEventFilter& filter) {
+    std::vector<leet::Event::Message> vector;
+    nlohmann::json filterJSON = nlohmann::json::object();
+
+    leetFunction::addRoomEventFilterToJSON(filterJSON, filter);
+
+    // The store can't apply filters, so only unfiltered history is read from and added to it
+    const std::shared_ptr<leet::Event::EventStore> eventStore = filterJSON.empty() && messageCount > 0 ? leet::returnClient().eventStore : nullptr;
+    std::vector<std::string> storedEvents{};
+
+    if (eventStore) {
+        if (auto latestEvents = eventStore->findLatestEvents(room.roomID, static_cast<std::size_t>(messageCount))) {
+            for (auto& it : *latestEvents) {
+                try {
+                    nlohmann::json theEvent = nlohmann::json::parse(it);
+                    vector.push_back(leetFunction::getMessageFromEvent(theEvent));
+                } catch (const nlohmann::json::parse_error& e) {
+                }
+            }
+
+            leet::returnClient().errorCode = 0;
+
+            return vector;
+        }
+    }
+
+    const std::string Query { "dir=b&limit=" + std::to_string(messageCount) +
+        (filterJSON.empty() ? "" : "&filter=" + leetFunction::encodeURL(filterJSON.dump())) };
+
+    vector = std::move(leetFunction::requestMessages(resp, room.roomID, Query, eventStore ? &storedEvents : nullptr).Messages);
+
+    if (eventStore && leet::returnClient().networkStatusCode == 200 && !storedEvents.empty()) {
+        eventStore->addMessages(room.roomID, storedEvents);
+    }
+
+    return vector;
+}
+
+leet::Event::MessagePage leet::returnMessagePage(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& From, const std::string& To, const bool Direction, const int Limit, const leet::Filter::RoomEventFilter& filter) {
+    nlohmann::json filterJSON = nlohmann::json::object();
+
+    leetFunction::addRoomEventFilterToJSON(filterJSON, filter);
+
+    const std::string Query { std::string(Direction ? "dir=f" : "dir=b") + "&limit=" + std::to_string(Limit) +
+        (From.compare("") ? "&from=" + leetFunction::encodeURL(From) : "") +
+        (To.compare("") ? "&to=" + leetFunction::encodeURL(To) : "") +
+        (filterJSON.empty() ? "" : "&filter=" + leetFunction::encodeURL(filterJSON.dump())) };
+
+    return leetFunction::requestMessages(resp, room.roomID, Query, nullptr);
+}
+
+leet::Event::MessagePage leetFunction::requestMessages(const leet::User::CredentialsResponse& resp, const std::string& roomID, const std::string& Query, std::vector<std::string>* rawEvents) {
+    leet::Event::MessagePage thePage{};
+    std::string errorCode{};
+    std::string errorMessage{};
+
+    leet::returnClient().errorCode = 0;
+
+    leetRequest::URL url;
+    leetRequest::Request request;
+
+    url.parseURLFromString(leet::getAPI("/_matrix/client/v3/rooms/" + roomID + "/messages?" + Query));
+
+    request.Host = url.Host;
+    request.Endpoint = url.Endpoint;
+    request.Query = url.Query;
+    request.Port = url.Port;
+    request.Protocol = url.Protocol;
+    request.Type = leetRequest::LEET_REQUEST_REQTYPE_GET;
+    request.userAgent = "LIBLEET_USER_AGENT";
+    request.setAuthenticationHeader("Bearer " + resp.accessToken);
+
+    // Each message is decoded as soon as it has been received
+    leetRequest::Response response = request.makeRequest([&](std::istream& Body) {
+        leetFunction::EventDecoder Decoder{};
+
+        Decoder.isWanted = [](const std::vector<std::string>& Path) {
+            return Path.size() == 2 && !Path[0].compare("chunk");
+        };
+        Decoder.onEvent = [&](const std::vector<std::string>&, nlohmann::json& theEvent) {
+            if (rawEvents) {
+                rawEvents->push_back(theEvent.dump());
+            }
+
+            thePage.Messages.push_back(leetFunction::getMessageFromEvent(theEvent));
+        };
+        Decoder.onValue = [&](const std::vector<std::string>& Path, const nlohmann::json& Value) {
+            if (Path.size() != 1 || !Value.is_string()) {
+                return;
+            }
+
+            if (!Path[0].compare("start")) thePage.Start = Value.get<std::string>();
+            if (!Path[0].compare("end")) thePage.End = Value.get<std::string>();
+            if (!Path[0].compare("errcode")) errorCode = Value.get<std::string>();
+            if (!Path[0].compare("error")) errorMessage = Value.get<std::string>();
+        };
+
+        if (!nlohmann::json::sax_parse(Body, &Decoder)) {
+            leet::returnClient().errorCode = 1;
+            thePage = leet::Event::MessagePage{};
+
+            if (rawEvents) {
+                rawEvents->clear();
+            }
+        }
+    });
+
+    leetFunction::setResponseStatus(response);
+
+    // Covers requests which never got a response as well, the body of which is never read
+    if (response.statusCode != 200) {
+        leet::returnClient().errorCode = 1;
+    }
+
+    if (errorCode.compare("")) {
+        leet::returnClient().errorCode = 1;
+        leet::returnClient().Error = errorCode;
+        leet::returnClient().friendlyError = errorMessage;
+    }
+
+    return thePage;
+}
+
+leet::Event::Paginator::Paginator(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const bool Direction, const std::string& From) : From(From), Credentials(resp), roomID(room.roomID), Direction(Direction) {
+    theClient = leetFunction::returnClientCopy();
+}
+
+leet::Event::Paginator::~Paginator() {
+    if (Prefetched.valid()) {
+        Prefetched.wait();
+    }
+}
+
+void leet::Event::Paginator::requestPage() {
+    leet::Room::Room theRoom{};
+    theRoom.roomID = roomID;
+
+    // The request gets state of its own through call(), so a prefetch doesn't overwrite errors of calls made meanwhile
+    Prefetched = std::async(std::launch::async, [theClient = theClient, resp = Credentials, theRoom, From = From, To = To, Direction = Direction, Limit = pageSize, filter = filter]() {
+        return theClient->call([&]() { return leet::returnMessagePage(resp, theRoom, From, To, Direction, Limit, filter); });
+    });
+}
+
+std::vector<leet::Event::Message> leet::Event::Paginator::next() {
+    leet::Client& theCaller = leet::returnClient();
+
+    if (!Prefetched.valid()) {
+        if (Finished) {
+            theCaller.errorCode = 0;
+            return {};
+        }
+
+        requestPage();
+    }
+
+    leet::Result<leet::Event::MessagePage> thePage = Prefetched.get();
+
+    if (!thePage) {
+        const leet::APIError& theError = thePage.error();
+
+        theCaller.errorCode = 1;
+        theCaller.networkStatusCode = theError.statusCode;
+        theCaller.leetError = theError.leetError;
+        theCaller.Error = theError.Error;
+        theCaller.friendlyError = theError.friendlyError;
+        theCaller.retryAfter = theError.retryAfter;
+
+        return {};
+    }
+
+    theCaller.errorCode = 0;
+    theCaller.networkStatusCode = 200;
+
+    // The end token is left out once there are no more events. A page can be empty while more follow, if a filter left out all of its events.
+    From = thePage.value().End;
+    Finished = !From.compare("");
+
+    if (prefetch && !Finished) {
+        requestPage();
+    }
+
+    return std::move(thePage.value().Messages);
+}
+
+bool leet::Event::Paginator::hasMore() const {
+    return !Finished;
+}
+
+std::string leet::Event::Paginator::returnToken() const {
+    return Finished ? "" : From;
+}
+
+leet::Event::Backfill::~Backfill() {
+    stop();
+}
+
+void leet::Event::Backfill::addRoom(const std::string& roomID) {
+    std::lock_guard<std::mutex> lock(backfillMutex);
+
+    loadCheckpoint();
+
+    if (Rooms.count(roomID)) {
+        return;
+    }
+
+    Rooms[roomID] = Progress{};
+    Queue.push_back(roomID);
+
+    backfillCondition.notify_one();
+}
+
+void leet::Event::Backfill::addRooms(const std::vector<leet::Room::Room>& rooms) {
+    for (auto& it : rooms) {
+        addRoom(it.roomID);
+    }
+}
+
+void leet::Event::Backfill::setErrorCallback(std::function<void(const std::string&, const leet::APIError&)> Function) {
+    std::lock_guard<std::mutex> lock(backfillMutex);
+    errorCallback = std::move(Function);
+}
+
+void leet::Event::Backfill::start() {
+    if (Running.exchange(true)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(backfillMutex);
+
+        loadCheckpoint();
+
+        // Rooms which were given up on get another chance
+        for (auto& it : Rooms) {
+            if (it.second.Failed) {
+                it.second.Failed = false;
+                it.second.Attempts = 0;
+                it.second.retryAt = std::chrono::steady_clock::time_point{};
+
+                Queue.push_back(it.first);
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(bucketMutex);
+
+        Bucket = leetRequest::TokenBucket{};
+        Bucket.Rate = requestsPerSecond;
+        Bucket.Burst = std::max(requestBurst, 1.0);
+    }
+
+    theClient = leetFunction::returnClientCopy();
+
+    for (std::size_t i{0}; i < std::max<std::size_t>(Concurrency, 1); i++) {
+        Workers.emplace_back(&leet::Event::Backfill::workerLoop, this);
+    }
+}
+
+void leet::Event::Backfill::stop() {
+    {
+        std::lock_guard<std::mutex> lock(backfillMutex);
+        Running = false;
+    }
+
+    backfillCondition.notify_all();
+
+    for (auto& it : Workers) {
+        if (it.joinable()) {
+            it.join();
+        }
+    }
+
+    Workers.clear();
+
+    saveCheckpoint(true);
+}
+
+void leet::Event::Backfill::wait() {
+    std::unique_lock<std::mutex> lock(backfillMutex);
+
+    backfillCondition.wait(lock, [&]() {
+        return !Running || (Queue.empty() && Active == 0);
+    });
+}
+
+std::size_t leet::Event::Backfill::returnRemaining() {
+    std::lock_guard<std::mutex> lock(backfillMutex);
+    std::size_t Remaining{0};
+
+    for (auto& it : Rooms) {
+        if (!it.second.Finished && !it.second.Failed) {
+            Remaining++;
+        }
+    }
+
+    return Remaining;
+}
+
+std::vector<std::string> leet::Event::Backfill::returnFailedRooms() {
+    std::lock_guard<std::mutex> lock(backfillMutex);
+    std::vector<std::string> failedRooms{};
+
+    for (auto& it : Rooms) {
+        if (it.second.Failed) {
+            failedRooms.push_back(it.first);
+        }
+    }
+
+    return failedRooms;
+}
+
+void leet::Event::Backfill::workerLoop() {
+    std::unique_lock<std::mutex> lock(backfillMutex);
+
+    while (Running) {
+        const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+
+        if (Now < pausedUntil) {
+            backfillCondition.wait_until(lock, pausedUntil);
+            continue;
+        }
+
+        // The first room which isn't waiting for a backoff is next
+        std::chrono::steady_clock::time_point nextRetry = std::chrono::steady_clock::time_point::max();
+        auto nextRoom = Queue.begin();
+
+        for (; nextRoom != Queue.end(); nextRoom++) {
+            const std::chrono::steady_clock::time_point retryAt = Rooms[*nextRoom].retryAt;
+
+            if (retryAt <= Now) {
+                break;
+            }
+
+            nextRetry = std::min(nextRetry, retryAt);
+        }
+
+        if (nextRoom == Queue.end()) {
+            if (Queue.empty()) {
+                backfillCondition.wait(lock);
+            } else {
+                backfillCondition.wait_until(lock, nextRetry);
+            }
+
+            continue;
+        }
+
+        const std::string roomID = *nextRoom;
+        Progress& theProgress = Rooms[roomID];
+
+        Queue.erase(nextRoom);
+        Active++;
+
+        const std::string From = theProgress.Token;
+
+        lock.unlock();
+
+        std::chrono::nanoseconds Wait{0};
+
+        {
+            std::lock_guard<std::mutex> bucketLock(bucketMutex);
+            Wait = Bucket.reserve(1, std::chrono::steady_clock::now());
+        }
+
+        if (Wait.count() > 0) {
+            std::this_thread::sleep_for(Wait);
+        }
+
+        leet::Room::Room theRoom{};
+        theRoom.roomID = roomID;
+
+        // Each request gets state of its own through call(), so the workers don't overwrite each other's errors
+        leet::Result<leet::Event::MessagePage> thePage = theClient->call([&]() {
+            return leet::returnMessagePage(Credentials, theRoom, From, "", Direction, pageSize, filter);
+        });
+
+        // The page is handed over before the room moves past it, so a page is never skipped if the process dies here
+        if (thePage && Sink) {
+            Sink(roomID, thePage.value().Messages);
+        }
+
+        std::function<void(const std::string&, const leet::APIError&)> theErrorCallback{};
+
+        lock.lock();
+
+        Active--;
+
+        if (thePage) {
+            theProgress.Attempts = 0;
+            theProgress.Token = thePage.value().End;
+
+            // A filter can leave a page empty while older events remain, so only a missing end token finishes the room
+            theProgress.Finished = !theProgress.Token.compare("");
+
+            if (!theProgress.Finished) {
+                Queue.push_back(roomID);
+            }
+        } else {
+            const leet::APIError& theError = thePage.error();
+
+            // Being rate limited says nothing about the room, so it doesn't count as a failed attempt
+            const bool rateLimited = theError.statusCode == 429;
+
+            if (!theError.isRetryable() || (!rateLimited && ++theProgress.Attempts >= maxAttempts)) {
+                theProgress.Failed = true;
+                theErrorCallback = errorCallback;
+            } else {
+                const int Shift = static_cast<int>(std::min<std::size_t>(theProgress.Attempts > 0 ? theProgress.Attempts - 1 : 0, 16));
+                const std::chrono::milliseconds Backoff = theError.retryAfter.count() > 0 ? theError.retryAfter : std::min(minimumBackoff * (1 << Shift), maximumBackoff);
+
+                theProgress.retryAt = std::chrono::steady_clock::now() + Backoff;
+
+                // The rate limit applies to the account, so every room waits
+                if (rateLimited) {
+                    pausedUntil = std::max(pausedUntil, theProgress.retryAt);
+                }
+
+                Queue.push_back(roomID);
+            }
+        }
+
+        lock.unlock();
+
+        if (theErrorCallback) {
+            theErrorCallback(roomID, thePage.error());
+        }
+
+        saveCheckpoint(false);
+
+        lock.lock();
+
+        backfillCondition.notify_all();
+    }
+}
+
+void leet::Event::Backfill::loadCheckpoint() {
+    if (Loaded) {
+        return;
+    }
+
+    Loaded = true;
+
+    if (!checkpointFile.compare("") || !std::filesystem::exists(checkpointFile)) {
+        return;
+    }
+
+    std::ifstream inputFile(checkpointFile);
+    nlohmann::json theCheckpoint{};
+
+    try {
+        theCheckpoint = nlohmann::json::parse(inputFile);
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    if (!theCheckpoint.is_object() || !theCheckpoint["rooms"].is_object()) {
+        return;
+    }
+
+    for (auto& it : theCheckpoint["rooms"].items()) {
+        if (!it.value().is_object() || Rooms.count(it.key())) {
+            continue;
+        }
+
+        Progress theProgress{};
+
+        theProgress.Token = it.value().value("token", "");
+        theProgress.Finished = it.value().value("finished", false);
+
+        if (!theProgress.Finished) {
+            Queue.push_back(it.key());
+        }
+
+        Rooms[it.key()] = std::move(theProgress);
+    }
+}
+
+void leet::Event::Backfill::saveCheckpoint(const bool Force) {
+    if (!checkpointFile.compare("")) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> fileLock(checkpointMutex);
+    const std::chrono::steady_clock::time_point Now = std::chrono::steady_clock::now();
+
+    if (!Force && Now - lastCheckpoint < checkpointInterval) {
+        return;
+    }
+
+    lastCheckpoint = Now;
+
+    nlohmann::json theCheckpoint = nlohmann::json::object();
+    theCheckpoint["rooms"] = nlohmann::json::object();
+
+    {
+        std::lock_guard<std::mutex> lock(backfillMutex);
+
+        for (auto& it : Rooms) {
+            nlohmann::json& theRoom = theCheckpoint["rooms"][it.first];
+
+            theRoom["token"] = it.second.Token;
+            theRoom["finished"] = it.second.Finished;
+        }
+    }
+
+    const std::filesystem::path file{ checkpointFile };
+
+    if (file.has_parent_path()) {
+        std::error_code ec;
+        std::filesystem::create_directories(file.parent_path(), ec);
+    }
+
+    const std::string temporaryFile = checkpointFile + ".tmp";
+    std::ofstream outputFile(temporaryFile, std::ios::trunc);
+
+    outputFile << theCheckpoint.dump();
+    outputFile.close();
+
+    if (outputFile) {
+        std::error_code ec;
+        std::filesystem::rename(temporaryFile, checkpointFile, ec);
+    }
+}
+
+/**
+ * @brief  Class which owns the files of an EventStore and the indexes built from them
+ *
+ * The index file starts with a Header, followed by fixed size Records. Records are only ever appended,
+ * and a record is written before the count in the header includes it, so a crash can't leave a half
+ * written record behind. The maps from room and event to record are rebuilt from the records on open.
+ */
+class leet::Event::EventStore::Storage {
+    private:
+    public:
+        /**
+         * @brief Class that represents the header of the index file
+         */
+        class Header {
+            private:
+            public:
+                char Magic[8]{};
+                std::uint32_t Version{};
+                std::uint32_t recordSize{};
+                std::uint64_t recordCount{}; // Records which have been completely written
+                char Token[488]{}; // Token of the last stored sync, empty if there is none
+        };
+        /**
+         * @brief Class that represents a record in the index file, pointing at one event in the log
+         */
+        class Record {
+            private:
+            public:
+                std::uint64_t roomHash{};
+                std::uint64_t eventHash{};
+                std::int64_t Position{}; // Position within the room, newer events have higher positions
+                std::uint64_t Offset{}; // Offset of the event in the log segment
+                std::uint32_t Segment{};
+                std::uint32_t Length{}; // 0 for records which only start a new run
+                std::uint32_t Flags{};
+                std::uint32_t Reserved{};
+        };
+
+        static constexpr std::uint32_t indexVersion{1};
+        static constexpr std::uint32_t runStart{1}; // The run of the room starts over at this record
+        static constexpr std::uint32_t Replacement{2}; // The record replaces an earlier version of the event, such as one which has been redacted since
+
+        std::string Directory{};
+        char* Index{nullptr}; // Header followed by the records
+        std::uint64_t indexCapacity{0}; // Records which fit in Index
+#ifdef _WIN32
+        std::vector<char> indexBuffer{};
+        std::fstream indexFile{};
+#else
+        int indexDescriptor{-1};
+        std::size_t mappedSize{0};
+#endif
+        std::ofstream logFile{};
+        std::uint32_t logSegment{0};
+        std::uint64_t logSize{0};
+        std::map<std::uint32_t, std::ifstream> Segments{}; // Segments opened for reading
+
+        std::unordered_map<std::uint64_t, std::map<std::int64_t, std::uint64_t>> Rooms{}; // Room hash -> position -> record, the current run of each room
+        std::unordered_map<std::uint64_t, std::uint64_t> Events{}; // Event hash -> latest record of the event
+
+        ~Storage() {
+            logFile.close();
+#ifdef _WIN32
+            indexFile.close();
+#else
+            if (Index) {
+                msync(Index, mappedSize, MS_ASYNC);
+                munmap(Index, mappedSize);
+            }
+
+            if (indexDescriptor >= 0) {
+                ::close(indexDescriptor);
+            }
+#endif
+        }
+
+        Header& header() {
+            return *reinterpret_cast<Header*>(Index);
+        }
+        Record& record(const std::uint64_t Number) {
+            return reinterpret_cast<Record*>(Index + sizeof(Header))[Number];
+        }
+        std::string segmentPath(const std::uint32_t Segment) const {
+            char Name[32];
+            std::snprintf(Name, sizeof(Name), "events.%06u.log", static_cast<unsigned int>(Segment));
+
+            return (std::filesystem::path(Directory) / Name).string();
+        }
+        void writeHeader() {
+#ifdef _WIN32
+            indexFile.seekp(0);
+            indexFile.write(Index, sizeof(Header));
+            indexFile.flush();
+#endif
+        }
+
+        bool openIndex() {
+            const std::string indexPath = (std::filesystem::path(Directory) / "index.bin").string();
+
+#ifdef _WIN32
+            if (!std::filesystem::exists(indexPath)) {
+                std::ofstream createdFile(indexPath, std::ios::binary);
+            }
+
+            indexFile.open(indexPath, std::ios::in | std::ios::out | std::ios::binary);
+
+            if (!indexFile) {
+                return false;
+            }
+
+            indexBuffer.assign(std::istreambuf_iterator<char>(indexFile), std::istreambuf_iterator<char>());
+            indexFile.clear();
+
+            if (indexBuffer.size() < sizeof(Header)) {
+                indexBuffer.assign(sizeof(Header), 0);
+            }
+
+            Index = indexBuffer.data();
+            indexCapacity = (indexBuffer.size() - sizeof(Header)) / sizeof(Record);
+#else
+            indexDescriptor = ::open(indexPath.c_str(), O_RDWR | O_CREAT, 0644);
+
+            if (indexDescriptor < 0) {
+                return false;
+            }
+
+            struct stat indexStat{};
+
+            if (fstat(indexDescriptor, &indexStat)) {
+                return false;
+            }
+
+            std::size_t Size = static_cast<std::size_t>(indexStat.st_size);
+
+            if (Size < sizeof(Header) + sizeof(Record)) {
+                Size = sizeof(Header) + 4096 * sizeof(Record);
+
+                if (ftruncate(indexDescriptor, static_cast<off_t>(Size))) {
+                    return false;
+                }
+            }
+
+            void* Mapping = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, indexDescriptor, 0);
+
+            if (Mapping == MAP_FAILED) {
+                return false;
+            }
+
+            Index = static_cast<char*>(Mapping);
+            mappedSize = Size;
+            indexCapacity = (Size - sizeof(Header)) / sizeof(Record);
+#endif
+
+            Header& theHeader = header();
+
+            if (!theHeader.recordSize) {
+                std::memcpy(theHeader.Magic, "LEETEVTS", sizeof(theHeader.Magic));
+                theHeader.Version = indexVersion;
+                theHeader.recordSize = sizeof(Record);
+                theHeader.recordCount = 0;
+
+                writeHeader();
+            } else if (std::memcmp(theHeader.Magic, "LEETEVTS", sizeof(theHeader.Magic)) || theHeader.Version != indexVersion || theHeader.recordSize != sizeof(Record)) {
+                return false;
+            }
+
+            theHeader.recordCount = std::min(theHeader.recordCount, indexCapacity);
+
+            return true;
+        }
+        bool growIndex() {
+#ifndef _WIN32
+            const std::size_t Size = sizeof(Header) + indexCapacity * 2 * sizeof(Record);
+
+            if (ftruncate(indexDescriptor, static_cast<off_t>(Size))) {
+                return false;
+            }
+
+            void* Mapping = mmap(nullptr, Size, PROT_READ | PROT_WRITE, MAP_SHARED, indexDescriptor, 0);
+
+            if (Mapping == MAP_FAILED) {
+                return false;
+            }
+
+            munmap(Index, mappedSize);
+
+            Index = static_cast<char*>(Mapping);
+            mappedSize = Size;
+            indexCapacity *= 2;
+#endif
+            return true;
+        }
+        bool appendRecord(const Record& theRecord) {
+            const std::uint64_t Number = header().recordCount;
+
+#ifdef _WIN32
+            indexBuffer.resize(sizeof(Header) + Number * sizeof(Record));
+            indexBuffer.insert(indexBuffer.end(), reinterpret_cast<const char*>(&theRecord), reinterpret_cast<const char*>(&theRecord) + sizeof(Record));
+
+            Index = indexBuffer.data();
+            indexCapacity = Number + 1;
+
+            indexFile.seekp(static_cast<std::streamoff>(sizeof(Header) + Number * sizeof(Record)));
+            indexFile.write(reinterpret_cast<const char*>(&theRecord), sizeof(Record));
+
+            if (!indexFile) {
+                return false;
+            }
+#else
+            if (Number >= indexCapacity && !growIndex()) {
+                return false;
+            }
+
+            record(Number) = theRecord;
+#endif
+
+            header().recordCount = Number + 1;
+            writeHeader();
+
+            applyRecord(Number);
+
+            return true;
+        }
+        void applyRecord(const std::uint64_t Number) {
+            const Record& theRecord = record(Number);
+            auto& Run = Rooms[theRecord.roomHash];
+
+            if (theRecord.Flags & runStart) {
+                Run.clear();
+            }
+
+            if (!theRecord.Length) {
+                return;
+            }
+
+            // A replacement only takes the place of the event in the run if the run still holds it
+            if (theRecord.Flags & Replacement) {
+                const auto Replaced = Events.find(theRecord.eventHash);
+
+                if (Replaced != Events.end() && isInRun(theRecord.roomHash, Replaced->second)) {
+                    Run[theRecord.Position] = Number;
+                }
+
+                Events[theRecord.eventHash] = Number;
+
+                return;
+            }
+
+            Run[theRecord.Position] = Number;
+            Events[theRecord.eventHash] = Number;
+        }
+        bool load() {
+            std::map<std::uint32_t, std::uint64_t> segmentSizes{};
+
+            for (std::uint32_t Segment{0}; std::filesystem::exists(segmentPath(Segment)); ++Segment) {
+                segmentSizes[Segment] = std::filesystem::file_size(segmentPath(Segment));
+                logSegment = Segment;
+            }
+
+            logSize = segmentSizes.count(logSegment) ? segmentSizes[logSegment] : 0;
+
+            // Records of events which never made it to the log, because of a crash, are dropped
+            std::uint64_t Count{0};
+
+            for (; Count < header().recordCount; ++Count) {
+                const Record& theRecord = record(Count);
+
+                if (theRecord.Length) {
+                    const auto segmentSize = segmentSizes.find(theRecord.Segment);
+
+                    if (segmentSize == segmentSizes.end() || theRecord.Offset + theRecord.Length > segmentSize->second) {
+                        break;
+                    }
+                }
+
+                applyRecord(Count);
+            }
+
+            header().recordCount = Count;
+            writeHeader();
+
+            logFile.open(segmentPath(logSegment), std::ios::binary | std::ios::app);
+
+            return logFile.is_open();
+        }
+
+        bool isInRun(const std::uint64_t roomHash, const std::uint64_t Number) {
+            const Record& theRecord = record(Number);
+
+            if (theRecord.roomHash != roomHash) {
+                return false;
+            }
+
+            const auto& Run = Rooms[roomHash];
+            const auto it = Run.find(theRecord.Position);
+
+            return it != Run.end() && it->second == Number;
+        }
+        std::size_t findInChunk(const std::vector<std::pair<std::string, std::string>>& Chunk, const std::uint64_t eventHash) {
+            for (std::size_t it{0}; it < Chunk.size(); ++it) {
+                if (leetFunction::returnStableHash(Chunk[it].first) == eventHash) {
+                    return it;
+                }
+            }
+
+            return Chunk.size();
+        }
+        void writeEvent(const std::string& eventJSON, Record& theRecord, const std::uint64_t segmentSize) {
+            if (logSize > 0 && logSize + eventJSON.size() + 1 > segmentSize) {
+                logFile.close();
+                logFile.open(segmentPath(++logSegment), std::ios::binary | std::ios::app);
+                logSize = 0;
+            }
+
+            theRecord.Segment = logSegment;
+            theRecord.Offset = logSize;
+            theRecord.Length = static_cast<std::uint32_t>(eventJSON.size());
+
+            logFile.write(eventJSON.data(), static_cast<std::streamsize>(eventJSON.size()));
+            logFile.put('\n');
+            logSize += eventJSON.size() + 1;
+        }
+        /**
+         * @brief  Store events of a room at Position, Position + Step and so on, skipping events already in the run of the room.
+         */
+        void addEvents(const std::uint64_t roomHash, const std::vector<std::pair<std::string, std::string>>& theEvents, std::int64_t Position, const std::int64_t Step, bool newRun, const std::uint64_t segmentSize) {
+            std::vector<Record> Pending{};
+
+            for (auto& [eventID, eventJSON] : theEvents) {
+                Record theRecord{};
+
+                theRecord.roomHash = roomHash;
+                theRecord.eventHash = leetFunction::returnStableHash(eventID);
+
+                const auto Existing = Events.find(theRecord.eventHash);
+
+                if (Existing != Events.end()) {
+                    if (!newRun && isInRun(roomHash, Existing->second)) {
+                        continue;
+                    }
+
+                    // The event is already in the log, from a run which has started over since
+                    theRecord.Segment = record(Existing->second).Segment;
+                    theRecord.Offset = record(Existing->second).Offset;
+                    theRecord.Length = record(Existing->second).Length;
+                } else {
+                    writeEvent(eventJSON, theRecord, segmentSize);
+                }
+
+                theRecord.Position = Position;
+                theRecord.Flags = newRun ? runStart : 0;
+
+                Position += Step;
+                newRun = false;
+
+                Pending.push_back(theRecord);
+            }
+
+            // The events have to be in the log before any record points at them
+            logFile.flush();
+
+            if (!logFile) {
+                return;
+            }
+
+            for (auto& theRecord : Pending) {
+                if (!appendRecord(theRecord)) {
+                    return;
+                }
+            }
+        }
+        /**
+         * @brief  Replace a stored event with its redacted form, if it has been stored and isn't redacted yet.
+         */
+        void redactEvent(const std::string& eventID, const nlohmann::json& theRedaction, const std::uint64_t segmentSize) {
+            const auto Existing = Events.find(leetFunction::returnStableHash(eventID));
+
+            if (Existing == Events.end()) {
+                return;
+            }
+
+            const std::optional<std::string> storedEvent = readEvent(Existing->second);
+            nlohmann::json theEvent{};
+
+            try {
+                theEvent = nlohmann::json::parse(storedEvent.value_or(""));
+            } catch (const nlohmann::json::parse_error& e) {
+                return;
+            }
+
+            if (!theEvent.is_object() || theEvent.value("event_id", "").compare(eventID) ||
+                (theEvent.contains("unsigned") && theEvent["unsigned"].is_object() && theEvent["unsigned"].contains("redacted_because"))) {
+                return;
+            }
+
+            const std::string eventJSON = leetFunction::returnRedactedEvent(theEvent, theRedaction).dump();
+            Record theRecord = record(Existing->second);
+
+            theRecord.Flags = Replacement;
+
+            writeEvent(eventJSON, theRecord, segmentSize);
+
+            // The event has to be in the log before the record points at it
+            logFile.flush();
+
+            if (logFile) {
+                appendRecord(theRecord);
+            }
+        }
+        /**
+         * @brief  Store a chunk of events returned by /messages, newest first, around the run of the room.
+         */
+        void addChunk(const std::string& roomID, const std::vector<std::pair<std::string, std::string>>& Chunk, const std::uint64_t segmentSize) {
+            const std::uint64_t roomHash = leetFunction::returnStableHash(roomID);
+            const auto& Run = Rooms[roomHash];
+
+            const std::size_t newestKnown = Run.empty() ? Chunk.size() : findInChunk(Chunk, record(Run.rbegin()->second).eventHash);
+
+            // The chunk starts at the newest event, so if it doesn't reach the newest event of the run, the run is out of date
+            if (newestKnown == Chunk.size()) {
+                addEvents(roomHash, std::vector<std::pair<std::string, std::string>>(Chunk.rbegin(), Chunk.rend()), Run.empty() ? 0 : Run.rbegin()->first + 1, 1, true, segmentSize);
+                return;
+            }
+
+            // Events newer than the run, which sync hasn't delivered yet
+            if (newestKnown > 0) {
+                addEvents(roomHash, std::vector<std::pair<std::string, std::string>>(Chunk.rend() - newestKnown, Chunk.rend()), Run.rbegin()->first + 1, 1, false, segmentSize);
+            }
+
+            // Events older than the run
+            const std::size_t oldestKnown = findInChunk(Chunk, record(Run.begin()->second).eventHash);
+
+            if (oldestKnown + 1 < Chunk.size()) {
+                addEvents(roomHash, std::vector<std::pair<std::string, std::string>>(Chunk.begin() + oldestKnown + 1, Chunk.end()), Run.begin()->first - 1, -1, false, segmentSize);
+            }
+        }
+        void startAllRuns() {
+            std::vector<Record> Pending{};
+
+            for (auto& [roomHash, Run] : Rooms) {
+                if (Run.empty()) {
+                    continue;
+                }
+
+                Record theRecord{};
+
+                theRecord.roomHash = roomHash;
+                theRecord.Position = Run.rbegin()->first + 1;
+                theRecord.Flags = runStart;
+
+                Pending.push_back(theRecord);
+            }
+
+            for (auto& theRecord : Pending) {
+                appendRecord(theRecord);
+            }
+        }
+        std::optional<std::string> readEvent(const std::uint64_t Number) {
+            const Record theRecord = record(Number);
+
+            auto it = Segments.find(theRecord.Segment);
+
+            if (it == Segments.end()) {
+                it = Segments.emplace(theRecord.Segment, std::ifstream(segmentPath(theRecord.Segment), std::ios::binary)).first;
+            }
+
+            std::ifstream& segmentFile = it->second;
+            std::string theEvent(theRecord.Length, '\0');
+
+            segmentFile.clear();
+            segmentFile.seekg(static_cast<std::streamoff>(theRecord.Offset));
+
+            if (!segmentFile.read(theEvent.data(), static_cast<std::streamsize>(theEvent.size()))) {
+                return std::nullopt;
+            }
+
+            return theEvent;
+        }
+        void setToken(const std::string& Token) {
+            Header& theHeader = header();
+
+            std::memset(theHeader.Token, 0, sizeof(theHeader.Token));
+
+            // A token which doesn't fit is left out, which only means the runs start over after a restart
+            if (Token.size() < sizeof(theHeader.Token)) {
+                std::memcpy(theHeader.Token, Token.data(), Token.size());
+            }
+
+            writeHeader();
+        }
+        std::string returnToken() {
+            const Header& theHeader = header();
+
+            return std::string(theHeader.Token, strnlen(theHeader.Token, sizeof(theHeader.Token)));
+        }
+};
+
+leet::Event::EventStore::EventStore() = default;
+leet::Event::EventStore::~EventStore() = default;
+
+bool leet::Event::EventStore::open(const std::string& Directory) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    theStorage.reset();
+
+    std::error_code ec;
+    std::filesystem::create_directories(Directory, ec);
+
+    auto newStorage = std::make_unique<Storage>();
+    newStorage->Directory = Directory;
+
+    if (!newStorage->openIndex() || !newStorage->load()) {
+        return false;
+    }
+
+    theStorage = std::move(newStorage);
+
+    return true;
+}
+
+void leet::Event::EventStore::close() {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    theStorage.reset();
+}
+
+void leet::Event::EventStore::update(const leet::Sync::Sync& sync, const leet::Sync::SyncConfiguration& conf) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    if (!theStorage || !sync.nextBatch.compare("")) {
+        return;
+    }
+
+    // Events the filter left out would leave gaps in the runs, so the next unfiltered sync starts them over
+    if (leetFunction::isTimelineFiltered(conf)) {
+        theStorage->setToken("");
+        return;
+    }
+
+    // Events may have been missed since the last stored sync, so none of the runs can be trusted to be without gaps
+    if (theStorage->returnToken().compare(conf.Since)) {
+        theStorage->startAllRuns();
+    }
+
+    std::vector<std::pair<std::string, nlohmann::json>> Redactions{}; // Redacted event ID and the redaction, applied once everything has been stored
+
+    auto storeTimeline = [&](const std::string& roomID, const std::vector<leet::Sync::RoomEvent>& Timeline, const bool Limited) {
+        std::vector<std::pair<std::string, std::string>> theEvents{};
+
+        for (auto& roomEvent : Timeline) {
+            if (!roomEvent.eventID.compare("")) {
+                continue;
+            }
+
+            nlohmann::json theEvent{};
+
+            theEvent["event_id"] = roomEvent.eventID;
+            theEvent["room_id"] = roomID;
+            theEvent["type"] = roomEvent.Type;
+            theEvent["sender"] = roomEvent.Sender;
+            theEvent["origin_server_ts"] = roomEvent.originServerTS;
+
+            if (roomEvent.isState) {
+                theEvent["state_key"] = roomEvent.stateKey;
+            }
+
+            if (roomEvent.Redacts.compare("")) {
+                theEvent["redacts"] = roomEvent.Redacts;
+            }
+
+            try {
+                theEvent["content"] = nlohmann::json::parse(roomEvent.eventContent);
+            } catch (const nlohmann::json::parse_error& e) {
+                theEvent["content"] = nlohmann::json::object();
+            }
+
+            theEvents.emplace_back(roomEvent.eventID, theEvent.dump());
+
+            if (roomEvent.Redacts.compare("")) {
+                Redactions.emplace_back(roomEvent.Redacts, std::move(theEvent));
+            }
+        }
+
+        if (theEvents.empty()) {
+            return;
+        }
+
+        const std::uint64_t roomHash = leetFunction::returnStableHash(roomID);
+        const auto& Run = theStorage->Rooms[roomHash];
+
+        // A limited timeline has a gap before it, so the run starts over
+        theStorage->addEvents(roomHash, theEvents, Run.empty() ? 0 : Run.rbegin()->first + 1, 1, Limited || Run.empty(), segmentSize);
+    };
+
+    for (auto& theRoom : sync.roomEvents.joinEvents) {
+        storeTimeline(theRoom.roomID, theRoom.Timeline, theRoom.Limited);
+    }
+
+    for (auto& theRoom : sync.roomEvents.leaveEvents) {
+        storeTimeline(theRoom.roomID, theRoom.Timeline, theRoom.Limited);
+    }
+
+    for (auto& [eventID, theRedaction] : Redactions) {
+        theStorage->redactEvent(eventID, theRedaction, segmentSize);
+    }
+
+    theStorage->setToken(sync.nextBatch);
+    lastUpdate = std::chrono::steady_clock::now();
+}
+
+void leet::Event::EventStore::addMessages(const std::string& roomID, const std::vector<std::string>& Events) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    if (!theStorage) {
+        return;
+    }
+
+    std::vector<std::pair<std::string, std::string>> Chunk{}; // Newest first
+    std::vector<std::pair<std::string, nlohmann::json>> Redactions{}; // Redacted event ID and the redaction, applied once the chunk has been stored
+
+    for (auto& eventJSON : Events) {
+        try {
+            nlohmann::json theEvent = nlohmann::json::parse(eventJSON);
+
+            if (theEvent.contains("event_id") && theEvent["event_id"].is_string()) {
+                Chunk.emplace_back(theEvent["event_id"].get<std::string>(), eventJSON);
+            }
+
+            const std::string Redacts = leetFunction::returnRedacts(theEvent);
+
+            if (Redacts.compare("")) {
+                Redactions.emplace_back(Redacts, std::move(theEvent));
+            }
+        } catch (const nlohmann::json::parse_error& e) {
+        }
+    }
+
+    if (Chunk.empty()) {
+        return;
+    }
+
+    theStorage->addChunk(roomID, Chunk, segmentSize);
+
+    // The chunk is newest first, so the oldest redaction is applied first like it would have been by sync
+    for (auto it = Redactions.rbegin(); it != Redactions.rend(); ++it) {
+        theStorage->redactEvent(it->first, it->second, segmentSize);
+    }
+}
+
+
+std::optional<std::vector<std::string>> leet::Event::EventStore::findLatestEvents(const std::string& roomID, const std::size_t Count) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    // Without recent syncs, there may be newer events the store doesn't know about
+    if (!theStorage || !Count || std::chrono::steady_clock::now() - lastUpdate > maxAge) {
+        return std::nullopt;
+    }
+
+    const auto theRoom = theStorage->Rooms.find(leetFunction::returnStableHash(roomID));
+
+    if (theRoom == theStorage->Rooms.end() || theRoom->second.empty()) {
+        return std::nullopt;
+    }
+
+    const auto& Run = theRoom->second;
+
+    // A run shorter than Count is only enough if it goes all the way back to the creation of the room
+    if (Run.size() < Count) {
+        const std::optional<std::string> firstEvent = theStorage->readEvent(Run.begin()->second);
+
+        try {
+            if (!firstEvent || nlohmann::json::parse(*firstEvent).value("type", "").compare("m.room.create")) {
+                return std::nullopt;
+            }
+        } catch (const nlohmann::json::parse_error& e) {
+            return std::nullopt;
+        }
+    }
+
+    std::vector<std::string> Latest{};
+    Latest.reserve(std::min(Count, Run.size()));
+
+    for (auto it = Run.rbegin(); it != Run.rend() && Latest.size() < Count; ++it) {
+        std::optional<std::string> theEvent = theStorage->readEvent(it->second);
+
+        if (!theEvent) {
+            return std::nullopt;
+        }
+
+        Latest.push_back(std::move(*theEvent));
+    }
+
+    return Latest;
+}
+
+std::optional<std::string> leet::Event::EventStore::findEvent(const std::string& eventID) {
+    std::lock_guard<std::mutex> lock(storeMutex);
+
+    if (!theStorage) {
+        return std::nullopt;
+    }
+
+    const auto it = theStorage->Events.find(leetFunction::returnStableHash(eventID));
+
+    if (it == theStorage->Events.end()) {
+        return std::nullopt;
+    }
+
+    std::optional<std::string> theEvent = theStorage->readEvent(it->second);
+
+    // The index is keyed by a hash of the event ID, so the event itself has the final say
+    try {
+        if (!theEvent || nlohmann::json::parse(*theEvent).value("event_id", "").compare(eventID)) {
+            return std::nullopt;
+        }
+    } catch (const nlohmann::json::parse_error& e) {
+        return std::nullopt;
+    }
+
+    return theEvent;
+}
+
+std::string leetFunction::encodeURL(const std::string& Input) {
+    static const char Hex[] = "0123456789ABCDEF";
+    std::string Output{};
+
+    Output.reserve(Input.size() * 3);
+
+    for (const unsigned char it : Input) {
+        if (std::isalnum(it) || it == '-' || it == '_' || it == '.' || it == '~') {
+            Output += static_cast<char>(it);
+        } else {
+            Output += '%';
+            Output += Hex[it >> 4];
+            Output += Hex[it & 15];
+        }
+    }
+
+    return Output;
+}
+
+void leetFunction::addEventFilterToJSON(nlohmann::json& Output, const leet::Filter::EventFilter& filter) {
+    if (filter.Limit != 0) Output["limit"] = filter.Limit;
+    if (filter.Types) Output["types"] = *filter.Types;
+    if (filter.notTypes) Output["not_types"] = *filter.notTypes;
+    if (filter.Senders) Output["senders"] = *filter.Senders;
+    if (filter.notSenders) Output["not_senders"] = *filter.notSenders;
+}
+
+void leetFunction::addRoomEventFilterToJSON(nlohmann::json& Output, const leet::Filter::RoomEventFilter& filter) {
+    leetFunction::addEventFilterToJSON(Output, filter);
+
+    if (filter.Rooms) Output["rooms"] = *filter.Rooms;
+    if (filter.notRooms) Output["not_rooms"] = *filter.notRooms;
+    if (filter.containsURL) Output["contains_url"] = *filter.containsURL;
+    if (filter.lazyLoadMembers) Output["lazy_load_members"] = true;
+    if (filter.includeRedundantMembers) Output["include_redundant_members"] = true;
+    if (filter.unreadThreadNotifications) Output["unread_thread_notifications"] = true;
+}
+
+nlohmann::json leetFunction::returnFilterJSON(const leet::Filter::FilterConfiguration& filter) {
+    nlohmann::json list = nlohmann::json::object();
+    nlohmann::json Presence = nlohmann::json::object();
+    nlohmann::json accountData = nlohmann::json::object();
+    nlohmann::json Room = nlohmann::json::object();
+    nlohmann::json Timeline = nlohmann::json::object();
+    nlohmann::json State = nlohmann::json::object();
+    nlohmann::json Ephemeral = nlohmann::json::object();
+    nlohmann::json roomAccountData = nlohmann::json::object();
+
+    /* An empty list in a filter matches nothing, so the shorthand lists
+     * are only included if something has been added to them.
+     */
+    list["event_format"] = filter.eventFormat;
+    if (!filter.Fields.empty()) list["event_fields"] = filter.Fields;
+
+    if (!filter.Senders.empty()) Presence["senders"] = filter.Senders;
+    if (!filter.notSenders.empty()) Presence["not_senders"] = filter.notSenders;
+    if (!filter.Rooms.empty()) Ephemeral["rooms"] = filter.Rooms;
+    if (!filter.notRooms.empty()) Ephemeral["not_rooms"] = filter.notRooms;
+    if (!filter.Senders.empty()) Ephemeral["senders"] = filter.Senders;
+    if (!filter.notSenders.empty()) Ephemeral["not_senders"] = filter.notSenders;
+    if (!filter.Rooms.empty()) State["rooms"] = filter.Rooms;
+    if (!filter.notRooms.empty()) State["not_rooms"] = filter.notRooms;
+    if (filter.Limit != 0) Timeline["limit"] = filter.Limit;
+    if (!filter.notRooms.empty()) Timeline["not_rooms"] = filter.notRooms;
+    if (!filter.notSenders.empty()) Timeline["not_senders"] = filter.notSenders;
+
+    if (filter.lazyLoadMembers) {
+        State["lazy_load_members"] = true;
+        Timeline["lazy_load_members"] = true;
+    }
+
+    leetFunction::addEventFilterToJSON(Presence, filter.Presence);
+    leetFunction::addEventFilterToJSON(accountData, filter.accountData);
+    leetFunction::addRoomEventFilterToJSON(Timeline, filter.Room.Timeline);
+    leetFunction::addRoomEventFilterToJSON(State, filter.Room.State);
+    leetFunction::addRoomEventFilterToJSON(Ephemeral, filter.Room.Ephemeral);
+    leetFunction::addRoomEventFilterToJSON(roomAccountData, filter.Room.accountData);
+
+    if (filter.Room.Rooms) Room["rooms"] = *filter.Room.Rooms;
+    if (filter.Room.notRooms) Room["not_rooms"] = *filter.Room.notRooms;
+    if (filter.Room.includeLeave) Room["include_leave"] = true;
+
+    if (!Timeline.empty()) Room["timeline"] = Timeline;
+    if (!State.empty()) Room["state"] = State;
+    if (!Ephemeral.empty()) Room["ephemeral"] = Ephemeral;
+    if (!roomAccountData.empty()) Room["account_data"] = roomAccountData;
+
+    if (!Presence.empty()) list["presence"] = Presence;
+    if (!accountData.empty()) list["account_data"] = accountData;
+    if (!Room.empty()) list["room"] = Room;
+
+    return list;
+}
+
+std::uint64_t leetFunction::returnStableHash(const std::string& Input) {
+    // FNV-1a, which unlike std::hash gives the same result between runs, so it can be saved to disk
+    std::uint64_t Hash{14695981039346656037ULL};
+
+    for (const unsigned char it : Input) {
+        Hash ^= it;
+        Hash *= 1099511628211ULL;
+    }
+
+    return Hash;
+}
+
+std::string leetFunction::returnFilterHash(const std::string& filterJSON) {
+    char Output[17];
+    std::snprintf(Output, sizeof(Output), "%016llx", static_cast<unsigned long long>(leetFunction::returnStableHash(filterJSON)));
+
+    return Output;
+}
+
+void leet::Filter::FilterCache::loadFromFile() {
+    if (Loaded) {
+        return;
+    }
+
+    Loaded = true;
+
+    if (!cacheFile.compare("") || !std::filesystem::exists(cacheFile)) {
+        return;
+    }
+
+    std::ifstream inputFile(cacheFile);
+    nlohmann::json theCache{};
+
+    try {
+        theCache = nlohmann::json::parse(inputFile);
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    if (!theCache.is_object()) {
+        return;
+    }
+
+    for (auto& it : theCache.items()) {
+        if (!it.value().contains("filter") || !it.value().contains("filter_id") || !it.value()["filter"].is_string() || !it.value()["filter_id"].is_string()) {
+            continue;
+        }
+
+        Entry theEntry{};
+
+        theEntry.filterJSON = it.value()["filter"].get<std::string>();
+        theEntry.filterID = it.value()["filter_id"].get<std::string>();
+
+        Filters[it.key()] = theEntry;
+    }
+}
+
+void leet::Filter::FilterCache::saveToFile() {
+    if (!cacheFile.compare("")) {
+        return;
+    }
+
+    nlohmann::json theCache = nlohmann::json::object();
+
+    for (auto& it : Filters) {
+        theCache[it.first]["filter"] = it.second.filterJSON;
+        theCache[it.first]["filter_id"] = it.second.filterID;
+    }
+
+    const std::filesystem::path file{ cacheFile };
+
+    if (file.has_parent_path()) {
+        std::error_code ec;
+        std::filesystem::create_directories(file.parent_path(), ec);
+    }
+
+    const std::string temporaryFile = cacheFile + ".tmp";
+    std::ofstream outputFile(temporaryFile, std::ios::trunc);
+
+    outputFile << theCache.dump();
+    outputFile.close();
+
+    if (outputFile) {
+        std::error_code ec;
+        std::filesystem::rename(temporaryFile, cacheFile, ec);
+    }
+}
+
+std::string leet::Filter::FilterCache::findFilter(const std::string& userID, const std::string& filterJSON) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    loadFromFile();
+
+    const auto it = Filters.find(userID + "/" + leetFunction::returnFilterHash(filterJSON));
+
+    if (it == Filters.end() || it->second.filterJSON.compare(filterJSON)) {
+        return "";
+    }
+
+    return it->second.filterID;
+}
+
+void leet::Filter::FilterCache::addFilter(const std::string& userID, const std::string& filterJSON, const std::string& filterID) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    loadFromFile();
+
+    Entry theEntry{};
+
+    theEntry.filterJSON = filterJSON;
+    theEntry.filterID = filterID;
+
+    Filters[userID + "/" + leetFunction::returnFilterHash(filterJSON)] = theEntry;
+
+    saveToFile();
+}
+
+void leet::Filter::FilterCache::removeFilter(const std::string& userID, const std::string& filterID) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    loadFromFile();
+
+    const std::string Prefix = userID + "/";
+
+    for (auto it = Filters.begin(); it != Filters.end();) {
+        if (!it->first.compare(0, Prefix.size(), Prefix) && !it->second.filterID.compare(filterID)) {
+            it = Filters.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    saveToFile();
+}
+
+void leet::Filter::FilterCache::clear() {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+
+    Loaded = true;
+    Filters.clear();
+
+    saveToFile();
+}
+
+leet::Filter::Filter leet::returnFilter(const leet::User::CredentialsResponse& resp, const leet::Filter::FilterConfiguration& filter) {
+    leet::Filter::Filter retFilter;
+    const std::string APIUrl { "/_matrix/client/v3/user/" + resp.userID + "/filter" };
+
+    const std::string list = leetFunction::returnFilterJSON(filter).dump();
+
+    // The same filter has already been uploaded, no need to do it again
+    retFilter.filterID = leet::filterCache.findFilter(resp.userID, list);
+
+    if (retFilter.filterID.compare("")) {
+        leet::returnClient().errorCode = 0;
+        return retFilter;
+    }
+
+    std::string Output { leet::invokeRequest_Post(leet::getAPI(APIUrl), list, resp.accessToken) };
+
+    nlohmann::json requestResponse{};
+    try {
+        requestResponse = { nlohmann::json::parse(Output) };
+    } catch (const nlohmann::json::parse_error& e) {
+        return retFilter;
+    }
+
+    for (auto& output : requestResponse) {
+        leet::returnClient().errorCode = 0;
+
+        if (output["filter_id"].is_string()) {
+            retFilter.filterID = output["filter_id"].get<std::string>();
+            leet::filterCache.addFilter(resp.userID, list, retFilter.filterID);
+
+            return retFilter;
+        }
+
+        if (output["errcode"].is_string()) {
+            leet::returnClient().errorCode = 1;
+            leet::returnClient().Error = output["errcode"].get<std::string>();
+            if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
+        }
+    }
+
+    return retFilter;
+}
+
+void leetFunction::getSessionFromEvent(std::vector<leet::Sync::MegolmSession>& megolmSessions, nlohmann::json& itEvent) {
+    leet::Sync::MegolmSession megolmSession;
+
+    if (itEvent["content"]["sender_key"].is_string()) {
+        megolmSession.senderKey = itEvent["content"]["sender_key"];
+    }
+
+    if (itEvent["content"]["algorithm"].is_string()) {
+        megolmSession.Algorithm = itEvent["content"]["algorithm"];
+    }
+
+    if (megolmSession.senderKey.compare("")) {
+        if (!itEvent["content"]["ciphertext"][megolmSession.senderKey]["body"].is_null()) {
+            megolmSession.cipherText = itEvent["content"]["ciphertext"][megolmSession.senderKey]["body"];
+        }
+
+        if (!itEvent["content"]["ciphertext"][megolmSession.senderKey]["type"].is_null()) {
+            megolmSession.cipherType = itEvent["content"]["ciphertext"][megolmSession.senderKey]["type"];
+        }
+    }
+
+    if (itEvent["sender"].is_string()) {
+        megolmSession.Sender = itEvent["sender"];
+    }
+
+    if (itEvent["type"].is_string()) {
+        megolmSession.Type = itEvent["type"];
+    }
+
+    megolmSessions.push_back(megolmSession);
+}
+
+void leetFunction::getInviteFromEvent(const leet::User::CredentialsResponse& resp, leet::Sync::RoomEvents::InviteEvent& theInviteEvent, nlohmann::json& eventIt) {
+    if (!eventIt["type"].is_string()) { // not valid
+        return;
+    }
+
+    const std::string theType{eventIt["type"].get<std::string>()};
+
+    if (!theType.compare("m.room.encryption")) {
+        theInviteEvent.Encrypted = true;
+    }
+
+    if (!theType.compare("m.room.create")) {
+        if (eventIt["content"]["creator"].is_string()) {
+            theInviteEvent.Creator = eventIt["content"]["creator"].get<std::string>();
+        }
+        if (eventIt["content"]["room_version"].is_number_integer()) {
+            theInviteEvent.roomVersion = eventIt["content"]["room_version"].get<int>();
+        }
+    }
+
+    if (!theType.compare("m.room.member")) {
+        if (eventIt["state_key"].is_string()) if (eventIt["state_key"].get<std::string>().compare(resp.userID)) {
+            if (eventIt["content"]["displayname"].is_string()) {
+                theInviteEvent.displayName = eventIt["content"]["displayname"].get<std::string>();
+            }
+            if (eventIt["content"]["avatar_url"].is_string()) {
+                theInviteEvent.avatarURL = eventIt["content"]["avatar_url"].get<std::string>();
+            }
+        }
+
+        if (eventIt["sender"].is_string()) {
+            theInviteEvent.userID = eventIt["sender"].get<std::string>();
+        }
+    }
+
+    if (!theType.compare("m.room.name")) {
+        if (eventIt["content"]["name"].is_string()) {
+            theInviteEvent.roomName = eventIt["content"]["name"].get<std::string>();
+        }
+    }
+
+    if (!theType.compare("m.room.topic")) {
+        if (eventIt["content"]["topic"].is_string()) {
+            theInviteEvent.roomTopic = eventIt["content"]["topic"].get<std::string>();
+        }
+    }
+
+    if (!theType.compare("m.room.join_rules")) {
+        if (eventIt["content"]["join_rule"].is_string()) {
+            theInviteEvent.joinRule = eventIt["content"]["join_rule"].get<std::string>();
+        }
+
+        if (eventIt["content"]["allow"][0]["room_id"].is_string()) {
+            theInviteEvent.roomID = eventIt["content"]["allow"][0]["room_id"].get<std::string>();
+        }
+    }
+
+    if (eventIt["event_id"].is_string()) {
+        theInviteEvent.eventID = eventIt["event_id"].get<std::string>();
+    }
+}
+
+leetRequest::Request leetFunction::returnSyncRequest(const std::string& Homeserver, const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf) {
+    std::string presenceString{"offline"};
+
+    switch(conf.Presence) {
+        case leet::LEET_PRESENCE_OFFLINE:
+            presenceString = "offline";
+            break;
+        case leet::LEET_PRESENCE_ONLINE:
+            presenceString = "online";
+            break;
+        case leet::LEET_PRESENCE_UNAVAILABLE:
+            presenceString = "unavailable";
+            break;
+        default:
+            break;
+    }
+
+    leetRequest::URL url;
+    leetRequest::Request request;
+
+    url.parseURLFromString(Homeserver + "/_matrix/client/v3/sync?presence=" + presenceString + "&timeout=" + std::to_string(conf.Timeout) +
+                        (conf.Since.compare("") ? "&since=" + conf.Since : "") + "&full_state=" + (conf.fullState ? "true" : "false") +
+                        (conf.Filter.filterID.compare("") ? "&filter=" + conf.Filter.filterID :
+                         conf.filterConfiguration ? "&filter=" + leetFunction::encodeURL(leetFunction::returnFilterJSON(*conf.filterConfiguration).dump()) : ""));
+
+    request.Host = url.Host;
+    request.Endpoint = url.Endpoint;
+    request.Query = url.Query;
+    request.Port = url.Port;
+    request.Protocol = url.Protocol;
+    request.Type = leetRequest::LEET_REQUEST_REQTYPE_GET;
+    request.userAgent = "LIBLEET_USER_AGENT";
+    request.setAuthenticationHeader("Bearer " + resp.accessToken);
+    request.cancellationToken = conf.cancellationToken;
+
+    // The server holds the request for up to conf.Timeout before responding, so the header deadline has to allow for that
+    if (request.Timeouts.headerTimeout.count() > 0) {
+        request.Timeouts.headerTimeout += std::chrono::milliseconds(conf.Timeout);
+    }
+
+    return request;
+}
+
+leetRequest::Response leetFunction::requestSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf, const std::function<void(std::istream&)>& Reader) {
+    leetRequest::Request request = leetFunction::returnSyncRequest(leet::returnClient().Homeserver, resp, conf);
+
+    if (Reader) {
+        request.keepStreamedBody = true;
+        return request.makeRequest(Reader);
+    }
+
+    return request.makeRequest();
+}
+
+leet::Sync::RoomEvent leetFunction::getRoomEventFromEvent(nlohmann::json& theEvent) {
+    leet::Sync::RoomEvent roomEvent{};
+
+    if (theEvent["event_id"].is_string()) roomEvent.eventID = theEvent["event_id"].get<std::string>();
+    if (theEvent["type"].is_string()) roomEvent.Type = theEvent["type"].get<std::string>();
+    if (theEvent["sender"].is_string()) roomEvent.Sender = theEvent["sender"].get<std::string>();
+    if (theEvent["origin_server_ts"].is_number_integer()) roomEvent.originServerTS = theEvent["origin_server_ts"].get<int64_t>();
+    if (theEvent["unsigned"]["age"].is_number_integer()) roomEvent.Age = theEvent["unsigned"]["age"].get<int64_t>();
+
+    if (theEvent["state_key"].is_string()) {
+        roomEvent.isState = true;
+        roomEvent.stateKey = theEvent["state_key"].get<std::string>();
+    }
+
+    roomEvent.eventContent = theEvent["content"].dump();
+    roomEvent.Redacts = leetFunction::returnRedacts(theEvent);
+
+    return roomEvent;
+}
+
+std::string leetFunction::returnRedacts(const nlohmann::json& theEvent) {
+    if (!theEvent.is_object() || theEvent.value("type", "").compare("m.room.redaction")) {
+        return "";
+    }
+
+    // Room version 11 moved the key into the content
+    if (theEvent.contains("redacts") && theEvent["redacts"].is_string()) {
+        return theEvent["redacts"].get<std::string>();
+    }
+
+    if (theEvent.contains("content") && theEvent["content"].is_object() && theEvent["content"].contains("redacts") && theEvent["content"]["redacts"].is_string()) {
+        return theEvent["content"]["redacts"].get<std::string>();
+    }
+
+    return "";
+}
+
+nlohmann::json leetFunction::returnRedactedEvent(const nlohmann::json& theEvent, const nlohmann::json& theRedaction) {
+    static const std::map<std::string, std::vector<std::string>> keptContent {
+        { "m.room.member", { "membership", "join_authorised_via_users_server" } },
+        { "m.room.join_rules", { "join_rule", "allow" } },
+        { "m.room.power_levels", { "ban", "events", "events_default", "invite", "kick", "redact", "state_default", "users", "users_default" } },
+        { "m.room.history_visibility", { "history_visibility" } },
+        { "m.room.redaction", { "redacts" } },
+    };
+
+    nlohmann::json redactedEvent = nlohmann::json::object();
+
+    for (const char* Key : { "event_id", "room_id", "type", "sender", "state_key", "origin_server_ts" }) {
+        if (theEvent.contains(Key)) {
+            redactedEvent[Key] = theEvent[Key];
+        }
+    }
+
+    const std::string Type = theEvent.value("type", "");
+    const nlohmann::json Content = theEvent.contains("content") && theEvent["content"].is_object() ? theEvent["content"] : nlohmann::json::object();
+
+    redactedEvent["content"] = nlohmann::json::object();
+
+    // Nothing is removed from the content of m.room.create since room version 11
+    if (!Type.compare("m.room.create")) {
+        redactedEvent["content"] = Content;
+    } else if (const auto it = keptContent.find(Type); it != keptContent.end()) {
+        for (auto& Key : it->second) {
+            if (Content.contains(Key)) {
+                redactedEvent["content"][Key] = Content[Key];
+            }
+        }
+    }
+
+    redactedEvent["unsigned"]["redacted_because"] = theRedaction;
+
+    return redactedEvent;
+}
+
+template <typename Input> bool leetFunction::decodeSync(const leet::User::CredentialsResponse& resp, Input&& Body, leet::Sync::Sync& sync, std::vector<leet::Sync::SyncEvent>* Events) {
+    leetFunction::EventDecoder Decoder{};
+    std::map<std::string, std::size_t> inviteIndex{}; // room ID -> index in sync.roomEvents.inviteEvents
+    std::map<std::string, std::size_t> joinIndex{};
+    std::map<std::string, std::size_t> knockIndex{};
+    std::map<std::string, std::size_t> leaveIndex{};
+
+    // Rooms show up once in the response, but their events arrive one by one
+    auto findRoom = [](auto& Rooms, std::map<std::string, std::size_t>& Index, const std::string& roomID) -> auto& {
+        auto it = Index.find(roomID);
+
+        if (it == Index.end()) {
+            it = Index.emplace(roomID, Rooms.size()).first;
+            Rooms.emplace_back();
+            Rooms.back().roomID = roomID;
+        }
+
+        return Rooms[it->second];
+    };
+
+    /* Paths look like this:
+     * { "to_device", "events", "[]" }
+     * { "rooms", "invite", <room ID>, "invite_state", "events", "[]" }
+     * { "rooms", "join", <room ID>, "timeline", "events", "[]" }
+     * { "rooms", "join", <room ID>, "timeline", "limited" }
+     * { "rooms", "join", <room ID>, "unread_notifications", "highlight_count" }
+     */
+    auto isToDevice = [](const std::vector<std::string>& Path) {
+        return Path.size() == 3 && !Path[0].compare("to_device") && !Path[1].compare("events");
+    };
+    auto isInvite = [](const std::vector<std::string>& Path) {
+        return Path.size() == 6 && !Path[0].compare("rooms") && !Path[1].compare("invite") && !Path[3].compare("invite_state") && !Path[4].compare("events");
+    };
+    auto isRoomEvent = [](const std::vector<std::string>& Path) {
+        return Path.size() == 6 && !Path[0].compare("rooms") && !Path[4].compare("events") && Path[5] == "[]"
+            && (!Path[1].compare("join") || !Path[1].compare("knock") || !Path[1].compare("leave"));
+    };
+    auto isEvent = [](const std::vector<std::string>& Path) {
+        return (Path.size() == 3 && !Path[1].compare("events") && Path[2] == "[]")
+            || (Path.size() == 6 && !Path[0].compare("rooms") && !Path[4].compare("events") && Path[5] == "[]");
+    };
+
+    Decoder.isWanted = [&](const std::vector<std::string>& Path) {
+        return isToDevice(Path) || isInvite(Path) || isRoomEvent(Path) || (Events && isEvent(Path));
+    };
+
+    Decoder.onEvent = [&](const std::vector<std::string>& Path, nlohmann::json& theEvent) {
+        if (isToDevice(Path)) {
+            leetFunction::getSessionFromEvent(sync.megolmSessions, theEvent);
+        } else if (isInvite(Path)) {
+            leetFunction::getInviteFromEvent(resp, findRoom(sync.roomEvents.inviteEvents, inviteIndex, Path[2]), theEvent);
+        } else if (isRoomEvent(Path)) {
+            const std::string& Section = Path[3];
+
+            if (!Path[1].compare("join")) {
+                auto& theRoom = findRoom(sync.roomEvents.joinEvents, joinIndex, Path[2]);
+
+                if (!Section.compare("timeline")) theRoom.Timeline.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Section.compare("state")) theRoom.State.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Section.compare("ephemeral")) theRoom.Ephemeral.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Section.compare("account_data")) theRoom.accountData.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+            } else if (!Path[1].compare("leave")) {
+                auto& theRoom = findRoom(sync.roomEvents.leaveEvents, leaveIndex, Path[2]);
+
+                if (!Section.compare("timeline")) theRoom.Timeline.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Section.compare("state")) theRoom.State.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Section.compare("account_data")) theRoom.accountData.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+            } else if (!Section.compare("knock_state")) {
+                findRoom(sync.roomEvents.knockEvents, knockIndex, Path[2]).State.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+            }
+        }
+
+        if (!Events || !isEvent(Path)) {
+            return;
+        }
+
+        leet::Sync::SyncEvent syncEvent{};
+
+        if (Path.size() == 6) {
+            syncEvent.Membership = Path[1];
+            syncEvent.roomID = Path[2];
+            syncEvent.Section = Path[3];
+        } else {
+            syncEvent.Section = Path[0];
+        }
+
+        if (theEvent["type"].is_string()) {
+            syncEvent.Type = theEvent["type"].get<std::string>();
+        }
+
+        syncEvent.eventContent = theEvent.dump();
+
+        Events->push_back(syncEvent);
+    };
+
+    Decoder.onValue = [&](const std::vector<std::string>& Path, const nlohmann::json& Value) {
+        // { "device_lists", "changed", "[]" }
+        if (Path.size() == 3 && !Path[0].compare("device_lists") && Value.is_string()) {
+            if (!Path[1].compare("changed")) sync.deviceLists.Changed.push_back(Value.get<std::string>());
+            if (!Path[1].compare("left")) sync.deviceLists.Left.push_back(Value.get<std::string>());
+
+            return;
+        }
+
+        if (Path.size() != 5 || Path[0].compare("rooms")) {
+            return;
+        }
+
+        if (!Path[1].compare("join")) {
+            auto& theRoom = findRoom(sync.roomEvents.joinEvents, joinIndex, Path[2]);
+
+            if (!Path[3].compare("timeline") && !Path[4].compare("limited") && Value.is_boolean()) theRoom.Limited = Value.get<bool>();
+            if (!Path[3].compare("timeline") && !Path[4].compare("prev_batch") && Value.is_string()) theRoom.prevBatch = Value.get<std::string>();
+            if (!Path[3].compare("unread_notifications") && !Path[4].compare("highlight_count") && Value.is_number_integer()) theRoom.highlightCount = Value.get<int>();
+            if (!Path[3].compare("unread_notifications") && !Path[4].compare("notification_count") && Value.is_number_integer()) theRoom.notificationCount = Value.get<int>();
+        } else if (!Path[1].compare("leave")) {
+            auto& theRoom = findRoom(sync.roomEvents.leaveEvents, leaveIndex, Path[2]);
+
+            if (!Path[3].compare("timeline") && !Path[4].compare("limited") && Value.is_boolean()) theRoom.Limited = Value.get<bool>();
+            if (!Path[3].compare("timeline") && !Path[4].compare("prev_batch") && Value.is_string()) theRoom.prevBatch = Value.get<std::string>();
+        }
+    };
+
+    if (!nlohmann::json::sax_parse(std::forward<Input>(Body), &Decoder)) {
+        return false;
+    }
+
+    leet::returnClient().errorCode = 0;
+    sync.nextBatch = Decoder.nextBatch;
+
+    /* done:
+     * - to_device
+     * - invite
+     * - join (timeline, state, ephemeral, account_data, unread_notifications)
+     * - knock
+     * - leave
+     * - device_lists
+     */
+
+    return true;
+}
+
+std::string leetFunction::findNextBatch(const std::string& Body) {
+    /* Only next_batch is needed to start the next sync, so instead of building the whole document
+     * the response is just scanned for the top level key.
+     */
+    class NextBatchHandler : public nlohmann::json_sax<nlohmann::json> {
+        private:
+        public:
+            int Depth{0};
+            bool isNextBatch{false};
+            std::string nextBatch{};
+
+            bool null() override { isNextBatch = false; return true; }
+            bool boolean(bool) override { isNextBatch = false; return true; }
+            bool number_integer(number_integer_t) override { isNextBatch = false; return true; }
+            bool number_unsigned(number_unsigned_t) override { isNextBatch = false; return true; }
+            bool number_float(number_float_t, const string_t&) override { isNextBatch = false; return true; }
+            bool binary(binary_t&) override { isNextBatch = false; return true; }
+            bool string(string_t& val) override {
+                if (isNextBatch) {
+                    nextBatch = val;
+                    return false; // nothing else is needed
+                }
+
+                return true;
+            }
+            bool start_object(std::size_t) override { isNextBatch = false; ++Depth; return true; }
+            bool end_object() override { --Depth; return true; }
+            bool start_array(std::size_t) override { isNextBatch = false; ++Depth; return true; }
+            bool end_array() override { --Depth; return true; }
+            bool key(string_t& val) override { isNextBatch = Depth == 1 && val == "next_batch"; return true; }
+            bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception&) override { return false; }
+    };
+
+    NextBatchHandler Handler{};
+    nlohmann::json::sax_parse(Body, &Handler);
+
+    return Handler.nextBatch;
+}
+
+std::chrono::milliseconds leetFunction::returnRetryAfter(const leetRequest::Response& response) {
+    if (response.statusCode != 429) {
+        return std::chrono::milliseconds(0);
+    }
+
+    try {
+        const nlohmann::json theOutput = nlohmann::json::parse(response.Body);
+
+        if (theOutput.contains("retry_after_ms") && theOutput["retry_after_ms"].is_number_integer()) {
+            return std::chrono::milliseconds(theOutput["retry_after_ms"].get<int64_t>());
+        }
+    } catch (const nlohmann::json::parse_error& e) {
+    }
+
+    return std::chrono::milliseconds(0);
+}
+
+void leetFunction::setResponseStatus(const leetRequest::Response& response) {
+    leet::Client& theClient = leet::returnClient();
+
+    theClient.networkStatusCode = response.statusCode;
+    theClient.retryAfter = leetFunction::returnRetryAfter(response);
+}
+
+bool leetFunction::isUnknownFilter(const leetRequest::Response& response, const leet::Sync::SyncConfiguration& conf) {
+    if (response.statusCode < 400 || !conf.Filter.filterID.compare("")) {
+        return false;
+    }
+
+    try {
+        const nlohmann::json theOutput = nlohmann::json::parse(response.Body);
+
+        return theOutput.contains("errcode") && theOutput["errcode"] == "M_NOT_FOUND";
+    } catch (const nlohmann::json::parse_error& e) {
+        return false;
+    }
+}
+
+bool leetFunction::isStateFiltered(const leet::Sync::SyncConfiguration& conf) {
+    if (!conf.filterConfiguration) {
+        return false;
+    }
+
+    const leet::Filter::RoomEventFilter& State = conf.filterConfiguration->Room.State;
+
+    return conf.filterConfiguration->lazyLoadMembers || State.lazyLoadMembers || State.Types || State.notTypes || State.Senders || State.notSenders;
+}
+
+bool leetFunction::isTimelineFiltered(const leet::Sync::SyncConfiguration& conf) {
+    // What a filter ID leaves out is only known if the configuration it was made from is passed along
+    if (!conf.filterConfiguration) {
+        return conf.Filter.filterID.compare("");
+    }
+
+    const leet::Filter::FilterConfiguration& theConfiguration = *conf.filterConfiguration;
+    const leet::Filter::RoomEventFilter& Timeline = theConfiguration.Room.Timeline;
+
+    return !theConfiguration.Senders.empty() || !theConfiguration.notSenders.empty() || !theConfiguration.Rooms.empty() || !theConfiguration.notRooms.empty() ||
+        theConfiguration.Room.Rooms || theConfiguration.Room.notRooms ||
+        Timeline.Types || Timeline.notTypes || Timeline.Senders || Timeline.notSenders || Timeline.Rooms || Timeline.notRooms || Timeline.containsURL;
+}
+
+void leetFunction::updateStateStore(const leet::Sync::Sync& sync, const leet::Sync::SyncConfiguration& conf, const bool fullState) {
+    leet::Client& theClient = leet::returnClient();
+
+    if (theClient.stateStore) {
+        theClient.stateStore->update(sync, fullState, leetFunction::isStateFiltered(conf));
+    }
+}
+
+void leetFunction::updateDeviceCache(const leet::User::CredentialsResponse& resp, const leet::Sync::Sync& sync, const std::string& Since) {
+    leet::Client& theClient = leet::returnClient();
+
+    if (!theClient.deviceCache || !sync.nextBatch.compare("")) {
+        return;
+    }
+
+    const std::string Token = theClient.deviceCache->returnToken();
+
+    // Devices cached before the first sync were queried by this process, as ones loaded without a token are already stale
+    if (!Token.compare("") || !Token.compare(Since)) {
+        theClient.deviceCache->update(sync.deviceLists, sync.nextBatch);
+        return;
+    }
+
+    // The sync only has the changes since it was made, so the changes since the token of the cache are asked for.
+    // This happens after a restart, or if syncs have been made without updating the cache.
+    auto Changes = theClient.call([&]() { return leet::returnDeviceListChanges(resp, Token, sync.nextBatch); });
+
+    if (Changes) {
+        theClient.deviceCache->update(Changes.value(), sync.nextBatch);
+    } else {
+        theClient.deviceCache->invalidate(sync.nextBatch);
+    }
+}
+
+void leetFunction::updateProfileCache(const leet::Sync::Sync& sync) {
+    const std::shared_ptr<leet::User::ProfileCache> profileCache = leet::returnClient().profileCache;
+
+    if (!profileCache) {
+        return;
+    }
+
+    std::vector<leet::User::Profile> profiles{};
+
+    auto addMember = [&](const leet::Sync::RoomEvent& theEvent) {
+        if (!theEvent.isState || theEvent.Type.compare("m.room.member")) {
+            return;
+        }
+
+        nlohmann::json Content{};
+
+        try {
+            Content = nlohmann::json::parse(theEvent.eventContent);
+        } catch (const nlohmann::json::parse_error& e) {
+            return;
+        }
+
+        if (!Content.is_object() || !Content.contains("membership") || !Content["membership"].is_string() || Content["membership"].get<std::string>().compare("join")) {
+            return;
+        }
+
+        leet::User::Profile profile{};
+
+        profile.userID = theEvent.stateKey;
+        if (Content.contains("displayname") && Content["displayname"].is_string()) profile.displayName = Content["displayname"].get<std::string>();
+        if (Content.contains("avatar_url") && Content["avatar_url"].is_string()) profile.avatarURL = Content["avatar_url"].get<std::string>();
+
+        profiles.push_back(profile);
+    };
+
+    // The timeline comes after the state, so the latest change of each member is added last
+    for (auto& theRoom : sync.roomEvents.joinEvents) {
+        for (auto& theEvent : theRoom.State) addMember(theEvent);
+        for (auto& theEvent : theRoom.Timeline) addMember(theEvent);
+    }
+
+    if (!profiles.empty()) {
+        profileCache->addProfiles(profiles);
+    }
+}
+
+void leetFunction::updateHierarchyCache(const leet::Sync::Sync& sync) {
+    const std::shared_ptr<leet::Space::HierarchyCache> hierarchyCache = leet::returnClient().hierarchyCache;
+
+    if (!hierarchyCache) {
+        return;
+    }
+
+    auto isChildEvent = [](const leet::Sync::RoomEvent& theEvent) {
+        return theEvent.isState && !theEvent.Type.compare("m.space.child");
+    };
+
+    for (auto& theRoom : sync.roomEvents.joinEvents) {
+        if (std::any_of(theRoom.State.begin(), theRoom.State.end(), isChildEvent) || std::any_of(theRoom.Timeline.begin(), theRoom.Timeline.end(), isChildEvent)) {
+            hierarchyCache->removeSpace(theRoom.roomID);
+        }
+    }
+}
+
+void leetFunction::updateEventStore(const leet::Sync::Sync& sync, const leet::Sync::SyncConfiguration& conf) {
+    const std::shared_ptr<leet::Event::EventStore> eventStore = leet::returnClient().eventStore;
+
+    if (eventStore) {
+        eventStore->update(sync, conf);
+    }
+}
+
+leet::Sync::Sync leet::returnSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf) {
+    leet::Sync::Sync sync{};
+    bool Decoded{false};
+
+    // The response is decoded while it is being received
+    leetRequest::Response response = leetFunction::requestSync(resp, conf, [&](std::istream& Body) {
+        Decoded = leetFunction::decodeSync(resp, Body, sync, nullptr);
+    });
+
+    leetFunction::setResponseStatus(response);
+
+    // A body which ends early leaves part of a sync behind, which must not be handed out or stored
+    if (response.statusCode == 200 && !Decoded) {
+        sync = leet::Sync::Sync{};
+
+        leet::returnClient().errorCode = 1;
+        leet::returnClient().friendlyError = "Failed to decode the sync response";
+    }
+
+    sync.theRequest = response.Body;
+
+    if (response.statusCode == 200 && Decoded) {
+        leetFunction::updateStateStore(sync, conf, !conf.Since.compare("") || conf.fullState);
+        leetFunction::updateDeviceCache(resp, sync, conf.Since);
+        leetFunction::updateProfileCache(sync);
+        leetFunction::updateHierarchyCache(sync);
+        leetFunction::updateEventStore(sync, conf);
+    }
+
+    // The server has forgotten the filter, so it should not be handed out by returnFilter() again
+    if (leetFunction::isUnknownFilter(response, conf)) {
+        leet::filterCache.removeFilter(resp.userID, conf.Filter.filterID);
+
+        leet::returnClient().errorCode = 1;
+        leet::returnClient().Error = "M_NOT_FOUND";
+    }
+
+    return sync;
+}
+
+void leet::Sync::RoomStateStore::applyEvent(RoomState& theRoom, const leet::Sync::RoomEvent& theEvent) {
+    if (!theEvent.isState) {
+        return;
+    }
+
+    theRoom.State[{ theEvent.Type, theEvent.stateKey }] = theEvent;
+
+    // Only the events the summary and member list are made from need to be parsed
+    if (theEvent.Type.compare(0, 7, "m.room.")) {
+        return;
+    }
+
+    nlohmann::json Content{};
+
+    try {
+        Content = nlohmann::json::parse(theEvent.eventContent);
+    } catch (const nlohmann::json::parse_error& e) {
+        return;
+    }
+
+    if (!Content.is_object()) {
+        return;
+    }
+
+    auto returnString = [&](const std::string& Key) {
+        return Content.contains(Key) && Content[Key].is_string() ? Content[Key].get<std::string>() : std::string{};
+    };
+
+    leet::Room::Room& Summary = theRoom.Summary;
+
+    if (!theEvent.Type.compare("m.room.member")) {
+        if (!returnString("membership").compare("join")) {
+            leet::User::Profile profile{};
+
+            profile.userID = theEvent.stateKey;
+            profile.displayName = returnString("displayname");
+            profile.avatarURL = returnString("avatar_url");
+
+            theRoom.Members[theEvent.stateKey] = profile;
+        } else {
+            theRoom.Members.erase(theEvent.stateKey);
+        }
+
+        Summary.memberCount = static_cast<int>(theRoom.Members.size());
+    } else if (!theEvent.Type.compare("m.room.name")) {
+        Summary.Name = returnString("name");
+    } else if (!theEvent.Type.compare("m.room.topic")) {
+        Summary.Topic = returnString("topic");
+    } else if (!theEvent.Type.compare("m.room.avatar")) {
+        Summary.avatarURL = returnString("url");
+    } else if (!theEvent.Type.compare("m.room.canonical_alias")) {
+        Summary.Alias = returnString("alias");
+    } else if (!theEvent.Type.compare("m.room.join_rules")) {
+        Summary.joinRule = returnString("join_rule");
+    } else if (!theEvent.Type.compare("m.room.guest_access")) {
+        Summary.guestCanJoin = !returnString("guest_access").compare("can_join");
+    } else if (!theEvent.Type.compare("m.room.history_visibility")) {
+        Summary.worldReadable = !returnString("history_visibility").compare("world_readable");
+    } else if (!theEvent.Type.compare("m.room.create")) {
+        Summary.roomType = returnString("type");
+    }
+}
+
+void leet::Sync::RoomStateStore::update(const leet::Sync::Sync& sync, const bool fullState, const bool Filtered) {
+    std::unique_lock<std::shared_mutex> lock(storeMutex);
+
+    if (fullState) {
+        Rooms.clear();
+        Initialized = true;
+    }
+
+    for (auto& joinIt : sync.roomEvents.joinEvents) {
+        auto roomIt = Rooms.find(joinIt.roomID);
+
+        if (roomIt == Rooms.end()) {
+            roomIt = Rooms.emplace(joinIt.roomID, RoomState{}).first;
+            roomIt->second.Summary.roomID = joinIt.roomID;
+
+            // The server sends all state of rooms which have been joined since the last sync
+            roomIt->second.Complete = Initialized && !Filtered;
+        }
+
+        for (auto& eventIt : joinIt.State) {
+            applyEvent(roomIt->second, eventIt);
+        }
+        for (auto& eventIt : joinIt.Timeline) {
+            applyEvent(roomIt->second, eventIt);
+        }
+    }
+
+    for (auto& leaveIt : sync.roomEvents.leaveEvents) {
+        Rooms.erase(leaveIt.roomID);
+    }
+
+    lastUpdate = std::chrono::steady_clock::now();
+}
+
+const leet::Sync::RoomStateStore::RoomState* leet::Sync::RoomStateStore::findFreshRoom(const std::string& roomID) const {
+    if (std::chrono::steady_clock::now() - lastUpdate > maxAge) {
+        return nullptr;
+    }
+
+    auto it = Rooms.find(roomID);
+
+    if (it == Rooms.end() || !it->second.Complete) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+bool leet::Sync::RoomStateStore::isFresh(const std::string& roomID) const {
+    std::shared_lock<std::shared_mutex> lock(storeMutex);
+    return findFreshRoom(roomID) != nullptr;
+}
+
+std::optional<leet::Sync::RoomEvent> leet::Sync::RoomStateStore::findState(const std::string& roomID, const std::string& Type, const std::string& stateKey) const {
+    std::shared_lock<std::shared_mutex> lock(storeMutex);
+    const RoomState* theRoom = findFreshRoom(roomID);
+
+    if (!theRoom) {
+        return std::nullopt;
+    }
+
+    auto it = theRoom->State.find({ Type, stateKey });
+
+    if (it == theRoom->State.end()) {
+        return std::nullopt;
+    }
+
+    return it->second;
+}
+
+std::optional<leet::Room::Room> leet::Sync::RoomStateStore::findRoom(const std::string& roomID) const {
+    std::shared_lock<std::shared_mutex> lock(storeMutex);
+    const RoomState* theRoom = findFreshRoom(roomID);
+
+    if (!theRoom) {
+        return std::nullopt;
+    }
+
+    return theRoom->Summary;
+}
+
+std::optional<std::vector<leet::User::Profile>> leet::Sync::RoomStateStore::findMembers(const std::string& roomID) const {
+    std::shared_lock<std::shared_mutex> lock(storeMutex);
+    const RoomState* theRoom = findFreshRoom(roomID);
+
+    if (!theRoom) {
+        return std::nullopt;
+    }
+
+    std::vector<leet::User::Profile> Members{};
+    Members.reserve(theRoom->Members.size());
+
+    for (auto& it : theRoom->Members) {
+        Members.push_back(it.second);
+    }
+
+    return Members;
+}
+
+void leet::Sync::RoomStateStore::removeRoom(const std::string& roomID) {
+    std::unique_lock<std::shared_mutex> lock(storeMutex);
+    Rooms.erase(roomID);
+}
+
+void leet::Sync::RoomStateStore::clear() {
+    std::unique_lock<std::shared_mutex> lock(storeMutex);
+    Rooms.clear();
+    Initialized = false;
+}
+
+leet::Sync::SlidingSync leet::returnSlidingSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SlidingSyncConfiguration& conf) {
+    leet::Sync::SlidingSync sync{};
+    nlohmann::json list = nlohmann::json::object();
+
+    auto returnRequiredState = [](const std::vector<std::pair<std::string, std::string>>& requiredState) {
+        nlohmann::json Output = nlohmann::json::array();
+
+        for (auto& it : requiredState) {
+            Output.push_back({ it.first, it.second });
+        }
+
+        return Output;
+    };
+
+    if (conf.connectionID.compare("")) {
+        list["conn_id"] = conf.connectionID;
+    }
+
+    for (auto& it : conf.Lists) {
+        nlohmann::json theList{};
+
+        theList["ranges"] = nlohmann::json::array();
+
+        for (auto& rangeIt : it.second.Ranges) {
+            theList["ranges"].push_back({ rangeIt.first, rangeIt.second });
+        }
+
+        theList["required_state"] = returnRequiredState(it.second.requiredState);
+        theList["timeline_limit"] = it.second.timelineLimit;
+
+        if (it.second.isDM) theList["filters"]["is_dm"] = *it.second.isDM;
+        if (it.second.isInvite) theList["filters"]["is_invite"] = *it.second.isInvite;
+
+        list["lists"][it.first] = theList;
+    }
+
+    for (auto& it : conf.roomSubscriptions) {
+        list["room_subscriptions"][it.first]["required_state"] = returnRequiredState(it.second.requiredState);
+        list["room_subscriptions"][it.first]["timeline_limit"] = it.second.timelineLimit;
+    }
+
+    if (conf.toDevice) {
+        list["extensions"]["to_device"]["enabled"] = true;
+        if (conf.toDeviceSince.compare("")) list["extensions"]["to_device"]["since"] = conf.toDeviceSince;
+    }
+
+    if (conf.accountData) list["extensions"]["account_data"]["enabled"] = true;
+    if (conf.Typing) list["extensions"]["typing"]["enabled"] = true;
+    if (conf.Receipts) list["extensions"]["receipts"]["enabled"] = true;
+
     leetRequest::URL url;
     leetRequest::Request request;
 
-    url.parseURLFromString(API);
+    url.parseURLFromString(leet::getAPI("/_matrix/client/unstable/org.matrix.simplified_msc3575/sync" +
+                        (conf.Position.compare("") ? "?pos=" + leetFunction::encodeURL(conf.Position) + "&timeout=" + std::to_string(conf.Timeout) : std::string(""))));
+
+    request.Host = url.Host;
+    request.Endpoint = url.Endpoint;
+    request.Query = url.Query;
+    request.Port = url.Port;
+    request.Protocol = url.Protocol;
+    request.Type = leetRequest::LEET_REQUEST_REQTYPE_POST;
+    request.userAgent = "LIBLEET_USER_AGENT";
+    request.Body = list.dump();
+    request.setAuthenticationHeader("Bearer " + resp.accessToken);
+    request.cancellationToken = conf.cancellationToken;
+    request.keepStreamedBody = true;
+
+    if (request.Timeouts.headerTimeout.count() > 0) {
+        request.Timeouts.headerTimeout += std::chrono::milliseconds(conf.Timeout);
+    }
+
+    std::map<std::string, std::size_t> roomIndex{};
+
+    auto findRoom = [&](const std::string& roomID) -> leet::Sync::SlidingRoom& {
+        auto it = roomIndex.find(roomID);
+
+        if (it == roomIndex.end()) {
+            it = roomIndex.emplace(roomID, sync.Rooms.size()).first;
+            sync.Rooms.emplace_back();
+            sync.Rooms.back().roomID = roomID;
+        }
+
+        return sync.Rooms[it->second];
+    };
+
+    /* Paths look like this:
+     * { "rooms", <room ID>, "timeline", "[]" }
+     * { "rooms", <room ID>, "name" }
+     * { "lists", <list name>, "count" }
+     * { "extensions", "to_device", "events", "[]" }
+     * { "extensions", "typing", "rooms", <room ID> }
+     */
+    std::string errorCode{};
+    std::string errorMessage{};
+
+    leetRequest::Response response = request.makeRequest([&](std::istream& Body) {
+        leetFunction::EventDecoder Decoder{};
+
+        Decoder.isWanted = [](const std::vector<std::string>& Path) {
+            if (Path.size() != 4) {
+                return false;
+            }
+
+            // Typing and receipts are sent as a single event per room
+            if (!Path[0].compare("extensions") && (!Path[1].compare("typing") || !Path[1].compare("receipts")) && !Path[2].compare("rooms")) {
+                return true;
+            }
+
+            return (!Path[0].compare("rooms") || !Path[0].compare("extensions")) && Path[3] == "[]";
+        };
+
+        Decoder.onEvent = [&](const std::vector<std::string>& Path, nlohmann::json& theEvent) {
+            if (!Path[0].compare("rooms")) {
+                leet::Sync::SlidingRoom& theRoom = findRoom(Path[1]);
+
+                if (!Path[2].compare("timeline")) theRoom.Timeline.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Path[2].compare("required_state")) theRoom.requiredState.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+                if (!Path[2].compare("invite_state")) theRoom.inviteState.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+            } else if (!Path[1].compare("to_device") && !Path[2].compare("events")) {
+                leetFunction::getSessionFromEvent(sync.megolmSessions, theEvent);
+            } else if (!Path[1].compare("account_data") && !Path[2].compare("global")) {
+                sync.accountData.push_back(leetFunction::getRoomEventFromEvent(theEvent));
+            } else if (!Path[1].compare("typing") && !Path[2].compare("rooms")) {
+                std::vector<std::string>& theUsers = sync.typingUsers[Path[3]];
+
+                if (theEvent.contains("/content/user_ids"_json_pointer) && theEvent["content"]["user_ids"].is_array()) {
+                    for (auto& it : theEvent["content"]["user_ids"]) {
+                        if (it.is_string()) {
+                            theUsers.push_back(it.get<std::string>());
+                        }
+                    }
+                }
+            } else if (!Path[1].compare("receipts") && !Path[2].compare("rooms")) {
+                sync.Receipts[Path[3]] = leetFunction::getRoomEventFromEvent(theEvent);
+            }
+        };
+
+        Decoder.onValue = [&](const std::vector<std::string>& Path, const nlohmann::json& Value) {
+            if (Path.size() == 1 && !Path[0].compare("pos") && Value.is_string()) {
+                sync.Position = Value.get<std::string>();
+            } else if (Path.size() == 1 && !Path[0].compare("errcode") && Value.is_string()) {
+                errorCode = Value.get<std::string>();
+            } else if (Path.size() == 1 && !Path[0].compare("error") && Value.is_string()) {
+                errorMessage = Value.get<std::string>();
+            } else if (Path.size() == 3 && !Path[0].compare("lists") && !Path[2].compare("count") && Value.is_number_integer()) {
+                sync.listCounts[Path[1]] = Value.get<int>();
+            } else if (Path.size() == 3 && !Path[0].compare("extensions") && !Path[1].compare("to_device") && !Path[2].compare("next_batch") && Value.is_string()) {
+                sync.toDeviceNextBatch = Value.get<std::string>();
+            } else if (Path.size() == 3 && !Path[0].compare("rooms")) {
+                leet::Sync::SlidingRoom& theRoom = findRoom(Path[1]);
+                const std::string& Key = Path[2];
+
+                if (!Key.compare("name") && Value.is_string()) theRoom.Name = Value.get<std::string>();
+                if (!Key.compare("avatar") && Value.is_string()) theRoom.avatarURL = Value.get<std::string>();
+                if (!Key.compare("initial") && Value.is_boolean()) theRoom.Initial = Value.get<bool>();
+                if (!Key.compare("is_dm") && Value.is_boolean()) theRoom.isDM = Value.get<bool>();
+                if (!Key.compare("limited") && Value.is_boolean()) theRoom.Limited = Value.get<bool>();
+                if (!Key.compare("prev_batch") && Value.is_string()) theRoom.prevBatch = Value.get<std::string>();
+                if (!Key.compare("bump_stamp") && Value.is_number_integer()) theRoom.bumpStamp = Value.get<int64_t>();
+                if (!Key.compare("joined_count") && Value.is_number_integer()) theRoom.joinedCount = Value.get<int>();
+                if (!Key.compare("invited_count") && Value.is_number_integer()) theRoom.invitedCount = Value.get<int>();
+                if (!Key.compare("notification_count") && Value.is_number_integer()) theRoom.notificationCount = Value.get<int>();
+                if (!Key.compare("highlight_count") && Value.is_number_integer()) theRoom.highlightCount = Value.get<int>();
+                if (!Key.compare("num_live") && Value.is_number_integer()) theRoom.numLive = Value.get<int>();
+            }
+        };
+
+        leet::returnClient().errorCode = nlohmann::json::sax_parse(Body, &Decoder) ? 0 : 1;
+    });
+
+    leetFunction::setResponseStatus(response);
+
+    // For example M_UNKNOWN_POS, after which the caller has to start over without a position
+    if (errorCode.compare("")) {
+        leet::returnClient().errorCode = 1;
+        leet::returnClient().Error = errorCode;
+        leet::returnClient().friendlyError = errorMessage;
+    }
+
+    sync.theRequest = response.Body;
+
+    return sync;
+}
+
+leet::Sync::SyncEngine::~SyncEngine() {
+    stop();
+}
+
+int leet::Sync::SyncEngine::addEventCallback(const std::string& Type, const std::string& roomID, std::function<void(const leet::Sync::SyncEvent&)> Function) {
+    std::lock_guard<std::mutex> lock(callbackMutex);
+
+    EventCallback theCallback{};
+
+    theCallback.ID = nextID++;
+    theCallback.Type = Type;
+    theCallback.roomID = roomID;
+    theCallback.Function = std::move(Function);
+
+    auto theCallbacks = std::make_shared<std::vector<EventCallback>>(*eventCallbacks);
+    theCallbacks->push_back(theCallback);
+    eventCallbacks = theCallbacks;
+
+    return theCallback.ID;
+}
+
+int leet::Sync::SyncEngine::addSyncCallback(std::function<void(const leet::Sync::Sync&)> Function) {
+    std::lock_guard<std::mutex> lock(callbackMutex);
+
+    syncCallbacks[nextID] = std::move(Function);
+
+    return nextID++;
+}
+
+void leet::Sync::SyncEngine::setErrorCallback(std::function<void(const int, const std::string&)> Function) {
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    errorCallback = std::move(Function);
+}
+
+void leet::Sync::SyncEngine::removeCallback(const int ID) {
+    std::lock_guard<std::mutex> lock(callbackMutex);
+
+    syncCallbacks.erase(ID);
+
+    auto theCallbacks = std::make_shared<std::vector<EventCallback>>(*eventCallbacks);
+    theCallbacks->erase(std::remove_if(theCallbacks->begin(), theCallbacks->end(),
+                [ID](const EventCallback& theCallback) { return theCallback.ID == ID; }), theCallbacks->end());
+    eventCallbacks = theCallbacks;
+}
+
+void leet::Sync::SyncEngine::start() {
+    stop();
+
+    if (!Configuration.Since.compare("") && sinceFile.compare("")) {
+        std::ifstream inputFile(sinceFile);
+        std::getline(inputFile, Configuration.Since);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        Since = Configuration.Since;
+        Pending.clear();
+    }
+
+    cancellationToken = leetRequest::CancellationToken{};
+    unhandledTokens.clear();
+
+    // The engine keeps a copy, so the caller's client may go away and the threads don't overwrite its errors
+    theClient = leetFunction::returnClientCopy();
+
+    if (dispatchThreads) {
+        leet::Client::Scope theScope(*theClient);
+
+        Dispatcher = std::make_unique<leet::Sync::EventDispatcher>(dispatchThreads, dispatchQueueSize,
+                [this](const leet::Sync::SyncEvent& theEvent) { callEventCallbacks(theEvent); });
+    }
+
+    Running = true;
+
+    fetchThread = std::thread(&leet::Sync::SyncEngine::fetchLoop, this);
+    dispatchThread = std::thread(&leet::Sync::SyncEngine::dispatchLoop, this);
+}
+
+void leet::Sync::SyncEngine::stop() {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        Running = false;
+    }
+
+    queueCondition.notify_all();
+    cancellationToken.cancel();
+
+    if (fetchThread.joinable()) {
+        fetchThread.join();
+    }
+    if (dispatchThread.joinable()) {
+        dispatchThread.join();
+    }
+
+    // Everything that was queued is handled before stopping, so the last token can be saved
+    if (Dispatcher) {
+        Dispatcher->stop();
+        saveHandledSince();
+        Dispatcher.reset();
+    }
+
+    // The threads have stopped, so the next start() continues after the last handled response instead of syncing it again
+    std::lock_guard<std::mutex> lock(queueMutex);
+
+    if (Since.compare("")) {
+        Configuration.Since = Since;
+    }
+}
+
+bool leet::Sync::SyncEngine::isRunning() const {
+    return Running;
+}
+
+std::string leet::Sync::SyncEngine::returnSince() {
+    std::lock_guard<std::mutex> lock(queueMutex);
+    return Since;
+}
+
+void leet::Sync::SyncEngine::fetchLoop() {
+    leet::Client fetchClient = *theClient;
+    leet::Client::Scope theScope(fetchClient);
+    leet::Sync::SyncConfiguration conf = Configuration;
+    std::chrono::milliseconds Backoff{0};
+
+    conf.cancellationToken = cancellationToken;
+
+    while (Running) {
+        leetRequest::Response response = leetFunction::requestSync(Credentials, conf);
+
+        if (!Running) {
+            break;
+        }
+
+        const std::string nextBatch = response.statusCode == 200 ? leetFunction::findNextBatch(response.Body) : "";
+
+        if (nextBatch.compare("")) {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueCondition.wait(lock, [&]() { return !Running || Pending.size() < maxPending; });
+
+            if (!Running) {
+                break;
+            }
+
+            Pending.push_back(PendingSync{ std::move(response.Body), nextBatch, !conf.Since.compare("") || conf.fullState, conf.Since });
+            lock.unlock();
+            queueCondition.notify_all();
+
+            // The callbacks are handled by the dispatch thread, so the next sync can be started right away
+            Backoff = std::chrono::milliseconds(0);
+            conf.Since = nextBatch;
+            conf.fullState = false;
+
+            continue;
+        }
+
+        std::function<void(const int, const std::string&)> theErrorCallback{};
+
+        {
+            std::lock_guard<std::mutex> lock(callbackMutex);
+            theErrorCallback = errorCallback;
+        }
+
+        if (theErrorCallback) {
+            theErrorCallback(response.statusCode, response.Body);
+        }
+
+        // Sync again without the filter ID, using filterConfiguration instead if there is one
+        if (leetFunction::isUnknownFilter(response, conf)) {
+            leet::filterCache.removeFilter(Credentials.userID, conf.Filter.filterID);
+            conf.Filter.filterID.clear();
+
+            continue;
+        }
+
+        // The access token is not valid, there is no point in trying again
+        if (response.statusCode == 401) {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            Running = false;
+            queueCondition.notify_all();
+            break;
+        }
 
-    request.Host = url.Host;
-    request.Endpoint = url.Endpoint;
-    request.Query = url.Query;
-    request.Port = url.Port;
-    request.Protocol = url.Protocol;
-    request.Type = leetRequest::LEET_REQUEST_REQTYPE_GET;
-    request.userAgent = "LIBLEET_USER_AGENT";
-    request.outputFile = outputFile;
+        Backoff = Backoff.count() ? std::min(Backoff * 2, maximumBackoff) : minimumBackoff;
+        const std::chrono::milliseconds Wait = std::max(Backoff, leetFunction::returnRetryAfter(response));
 
-    return request.downloadFile();
+        std::unique_lock<std::mutex> lock(queueMutex);
+        queueCondition.wait_for(lock, Wait, [&]() { return !Running; });
+    }
 }
 
-leet::URL::URLPreview leet::getURLPreview(const leet::User::CredentialsResponse& resp, const std::string& URL, const int64_t time) {
-    leet::URL::URLPreview preview;
-    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/media/v3/preview_url?ts=" + std::to_string(time) + "&url=" + URL), resp.accessToken) };
+void leet::Sync::SyncEngine::dispatchLoop() {
+    leet::Client dispatchClient = *theClient;
+    leet::Client::Scope theScope(dispatchClient);
 
-    nlohmann::json requestResponse{};
+    while (true) {
+        PendingSync theSync{};
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return preview;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+
+            // Tokens are saved as the dispatcher catches up, even if nothing new arrives
+            while (Running && Pending.empty() && !unhandledTokens.empty()) {
+                queueCondition.wait_for(lock, std::chrono::milliseconds(100));
+
+                lock.unlock();
+                saveHandledSince();
+                lock.lock();
+            }
+
+            queueCondition.wait(lock, [&]() { return !Running || !Pending.empty(); });
+
+            if (!Running) {
+                return;
+            }
+
+            theSync = std::move(Pending.front());
+            Pending.pop_front();
+        }
+
+        queueCondition.notify_all();
+
+        dispatch(theSync);
+
+        /* The token is only saved once everything before it has been handled, so events
+         * are never skipped if the program exits while responses are still waiting.
+         */
+        if (Dispatcher) {
+            unhandledTokens.emplace_back(theSync.nextBatch, Dispatcher->returnPushed());
+            saveHandledSince();
+        } else {
+            saveSince(theSync.nextBatch);
+        }
     }
+}
 
-    preview.URL = URL;
-    preview.Time = time;
+void leet::Sync::SyncEngine::saveHandledSince() {
+    std::string theSince{};
 
-    for (auto& output : requestResponse) {
-        if (output["og:image"].is_string()) preview.imageURL = output["og:image"].get<std::string>();
-        if (output["og:image:type"].is_string()) preview.Type = output["og:image:type"].get<std::string>();
-        if (output["og:image:width"].is_number_integer()) preview.imageWidth = output["og:image:width"].get<int>();
-        if (output["og:image:height"].is_number_integer()) preview.imageHeight = output["og:image:height"].get<int>();
-        if (output["matrix:image:size"].is_number_integer()) preview.imageSize = output["matrix:image:size"].get<int>();
-        if (output["og:title"].is_string()) preview.Title = output["og:title"].get<std::string>();
-        if (output["og:description"].is_string()) preview.Description = output["og:description"].get<std::string>();
+    while (!unhandledTokens.empty() && Dispatcher->isHandled(unhandledTokens.front().second)) {
+        theSince = unhandledTokens.front().first;
+        unhandledTokens.pop_front();
     }
 
-    return preview;
+    if (theSince.compare("")) {
+        saveSince(theSince);
+    }
 }
 
-int64_t leet::returnUnixTimestamp() {
-    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
-}
+void leet::Sync::SyncEngine::saveSince(const std::string& theSince) {
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        Since = theSince;
+    }
 
-leet::Event::Event leet::returnEventFromTimestamp(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int64_t Timestamp, const bool Direction) {
-    leet::Event::Event event;
-    std::string Dir = Direction ? "f" : "b";
+    if (!sinceFile.compare("")) {
+        return;
+    }
 
-    const std::string Output = leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v1/rooms/" + room.roomID + "/timestamp_to_event" + "?ts=" + std::to_string(Timestamp) + "&dir=" + Dir), resp.accessToken);
-    nlohmann::json requestResponse{};
+    const std::string temporaryFile = sinceFile + ".tmp";
+    std::ofstream outputFile(temporaryFile, std::ios::trunc);
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return event;
+    outputFile << theSince;
+    outputFile.close();
+
+    if (outputFile) {
+        std::error_code ec;
+        std::filesystem::rename(temporaryFile, sinceFile, ec);
     }
+}
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+void leet::Sync::SyncEngine::callEventCallbacks(const leet::Sync::SyncEvent& theEvent) {
+    std::shared_ptr<const std::vector<EventCallback>> theEventCallbacks{};
 
-        if (output["event_id"].is_string()) event.eventID = output["event_id"].get<std::string>();
-        if (output["origin_server_ts"].is_number_integer()) event.Age = output["origin_server_ts"].get<int>();
+    {
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        theEventCallbacks = eventCallbacks;
+    }
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-            break;
+    for (auto& it : *theEventCallbacks) {
+        if ((!it.Type.compare("") || !it.Type.compare(theEvent.Type)) && (!it.roomID.compare("") || !it.roomID.compare(theEvent.roomID))) {
+            it.Function(theEvent);
         }
     }
-
-    return event;
-}
-
-leet::Event::Event leet::returnLatestEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
-    return leet::returnEventFromTimestamp(resp, room, leet::returnUnixTimestamp(), true);
 }
 
-void leet::redactEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Event& event, const std::string& Reason) {
-
-    nlohmann::json body{};
+void leet::Sync::SyncEngine::dispatch(const PendingSync& theSync) {
+    std::map<int, std::function<void(const leet::Sync::Sync&)>> theSyncCallbacks{};
+    bool hasEventCallbacks{false};
 
-    if (Reason.compare("")) {
-        body["reason"] = Reason;
+    {
+        std::lock_guard<std::mutex> lock(callbackMutex);
+        theSyncCallbacks = syncCallbacks;
+        hasEventCallbacks = !eventCallbacks->empty();
     }
 
-    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/redact/" + event.eventID + "/" + std::to_string(leet::transID)), body.dump(), resp.accessToken) };
+    leet::Sync::Sync sync{};
+    std::vector<leet::Sync::SyncEvent> Events{};
 
-    nlohmann::json requestResponse{};
+    sync.theRequest = theSync.Body;
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
+    // Events are only collected if someone is going to receive them
+    if (!leetFunction::decodeSync(Credentials, theSync.Body, sync, hasEventCallbacks ? &Events : nullptr)) {
         return;
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    leetFunction::updateStateStore(sync, Configuration, theSync.fullState);
+    leetFunction::updateDeviceCache(Credentials, sync, theSync.Since);
+    leetFunction::updateProfileCache(sync);
+    leetFunction::updateHierarchyCache(sync);
+    leet::Sync::SyncConfiguration theConfiguration = Configuration;
+    theConfiguration.Since = theSync.Since;
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+    leetFunction::updateEventStore(sync, theConfiguration);
+
+    for (auto& it : theSyncCallbacks) {
+        it.second(sync);
+    }
+
+    for (auto& eventIt : Events) {
+        if (Dispatcher) {
+            Dispatcher->dispatch(eventIt);
+        } else {
+            callEventCallbacks(eventIt);
         }
     }
+}
 
+void leetFunction::waitIdle(const int Attempt) {
+    // Spin briefly for low latency, then back off so an idle thread doesn't burn a core
+    if (Attempt < 64) {
+        std::this_thread::yield();
+    } else {
+        std::this_thread::sleep_for(std::chrono::microseconds(Attempt < 256 ? 50 : 1000));
+    }
 }
 
-void leet::reportEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Event& event, const std::string& Reason, const int Score) {
-    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/report/" + event.eventID };
+leet::Sync::EventDispatcher::EventDispatcher(const std::size_t Threads, const std::size_t Capacity, std::function<void(const leet::Sync::SyncEvent&)> theHandler) : Handler(std::move(theHandler)) {
+    workerClient = leetFunction::returnClientCopy();
 
-    nlohmann::json body{};
+    for (std::size_t it{0}; it < std::max<std::size_t>(Threads, 1); ++it) {
+        Shards.push_back(std::make_unique<Shard>(Capacity));
+    }
 
-    body["reason"] = Reason;
-    if (Score > 0 || Score < -100) {
-        body["score"] = 0;
-    } else {
-        body["score"] = Score;
+    for (auto& it : Shards) {
+        it->Worker = std::thread(&leet::Sync::EventDispatcher::workerLoop, this, std::ref(*it));
     }
+}
 
-    const std::string Output { leet::invokeRequest_Post(leet::getAPI(APIUrl), body.dump(), resp.accessToken) };
+leet::Sync::EventDispatcher::~EventDispatcher() {
+    stop();
+}
 
-    nlohmann::json requestResponse{};
+void leet::Sync::EventDispatcher::dispatch(leet::Sync::SyncEvent& theEvent) {
+    Shard& theShard = *Shards[std::hash<std::string>{}(theEvent.roomID) % Shards.size()];
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    }  catch (const nlohmann::json::parse_error& e) {
-        return;
+    // The shard is full, so wait for its worker instead of letting the queue grow
+    for (int Attempt{0}; !theShard.Queue.push(theEvent); ++Attempt) {
+        leetFunction::waitIdle(Attempt);
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    theShard.Pushed.fetch_add(1, std::memory_order_release);
 
-        if (output["errcode"].is_string()) leet::Error = output["errcode"].get<std::string>();
-        if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+    // Pairs with the fence in workerLoop(), so either the worker sees the event or this sees the worker sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (theShard.Sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(theShard.waitMutex);
+        theShard.notEmpty.notify_one();
     }
 }
 
-void leet::sendMessage(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Message& msg) {
-    const std::string eventType { "m.room.message" };
-    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/send/" + eventType + "/" + std::to_string(transID) };
-    std::string messageType { "m.text" };
+std::vector<std::uint64_t> leet::Sync::EventDispatcher::returnPushed() const {
+    std::vector<std::uint64_t> Marks{};
 
-    switch (msg.msgType) {
-        case leet::LEET_MESSAGETYPE_IMAGE:
-            messageType = "m.image";
-            break;
-        case leet::LEET_MESSAGETYPE_AUDIO:
-            messageType = "m.audio";
-            break;
-        case leet::LEET_MESSAGETYPE_VIDEO:
-            messageType = "m.video";
-            break;
-        case leet::LEET_MESSAGETYPE_FILE:
-            messageType = "m.file";
-            break;
-        case leet::LEET_MESSAGETYPE_NOTICE:
-            messageType = "m.notice";
-            break;
-        case leet::LEET_MESSAGETYPE_EMOTE:
-            messageType = "m.emote";
-            break;
-        case leet::LEET_MESSAGETYPE_STRING:
-            messageType = msg.messageType;
-            if (!messageType.compare("")) {
-                messageType = "m.text";
-            }
-            break;
-        default:
-            messageType = "m.text";
-            break;
+    for (auto& it : Shards) {
+        Marks.push_back(it->Pushed.load(std::memory_order_acquire));
     }
 
-    nlohmann::json list{};
+    return Marks;
+}
 
-    // attachment
-    if (!messageType.compare("m.image") || !messageType.compare("m.audio") || !messageType.compare("m.video") || !messageType.compare("m.file")) {
-        if (msg.attachmentURL.at(0) != 'm' || msg.attachmentURL.at(1) != 'x' || msg.attachmentURL.at(2) != 'c') {
-            leet::errorCode = 1;
-            return;
+bool leet::Sync::EventDispatcher::isHandled(const std::vector<std::uint64_t>& Marks) const {
+    for (std::size_t it{0}; it < Shards.size() && it < Marks.size(); ++it) {
+        if (Shards[it]->Handled.load(std::memory_order_acquire) < Marks[it]) {
+            return false;
         }
+    }
 
-        list["type"] = "m.room.message";
-        list["room_id"] = room.roomID;
+    return true;
+}
 
-        if ((msg.bodyType == leet::LEET_BODYTYPE_BASIC) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
-            list["body"] = msg.messageText;
-        }
+void leet::Sync::EventDispatcher::stop() {
+    Running = false;
 
-        if ((msg.bodyType == leet::LEET_BODYTYPE_FORMATTED) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
-            list["formatted_body"] = msg.formattedText;
+    for (auto& it : Shards) {
+        std::lock_guard<std::mutex> lock(it->waitMutex);
+        it->notEmpty.notify_all();
+    }
 
-            if (!msg.Format.compare("")) {
-                list["format"] = "org.matrix.custom.html";
-            } else {
-                list["format"] = msg.Format;
-            }
+    for (auto& it : Shards) {
+        if (it->Worker.joinable()) {
+            it->Worker.join();
         }
+    }
+}
 
-        list["msgtype"] = messageType;
-        list["url"] = msg.attachmentURL;
+void leet::Sync::EventDispatcher::workerLoop(Shard& theShard) {
+    leet::Client theClient = *workerClient;
+    leet::Client::Scope theScope(theClient);
 
-        list["m.mentions"]["user_ids"] = msg.mentionedUserIDs;
+    int Attempt{0};
 
-        if (msg.replyEvent.eventID.compare("")) {
-            list["m.relates_to"]["m.in_reply_to"]["event_id"] = msg.replyEvent.eventID;
-        }
-    } else { // plain text/formatted text
-        list["type"] = "m.room.message";
-        list["room_id"] = room.roomID;
-        list["body"] = msg.messageText;
-        list["msgtype"] = messageType;
+    while (true) {
+        leet::Sync::SyncEvent theEvent{};
 
-        if ((msg.bodyType == leet::LEET_BODYTYPE_BASIC) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
-            list["body"] = msg.messageText;
-        }
+        // Running is checked before popping, so nothing pushed before stop() is left behind
+        const bool wasRunning = Running;
 
-        if ((msg.bodyType == leet::LEET_BODYTYPE_FORMATTED) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
-            list["formatted_body"] = msg.formattedText;
+        if (!theShard.Queue.pop(theEvent)) {
+            if (!wasRunning) {
+                return;
+            }
 
-            if (!msg.Format.compare("")) {
-                list["format"] = "org.matrix.custom.html";
-            } else {
-                list["format"] = msg.Format;
+            // Spin for a little while in case more events are on their way, then sleep until one is pushed
+            if (Attempt < 64) {
+                leetFunction::waitIdle(Attempt++);
+                continue;
             }
+
+            std::unique_lock<std::mutex> lock(theShard.waitMutex);
+
+            theShard.Sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            theShard.notEmpty.wait(lock, [&]() { return !theShard.Queue.empty() || !Running; });
+            theShard.Sleeping.store(false, std::memory_order_relaxed);
+
+            Attempt = 0;
+            continue;
         }
 
-        list["m.mentions"]["user_ids"] = msg.mentionedUserIDs;
+        Attempt = 0;
 
-        if (msg.replyEvent.eventID.compare("")) {
-            list["m.relates_to"]["m.in_reply_to"]["event_id"] = msg.replyEvent.eventID;
+        try {
+            Handler(theEvent);
+        } catch (const std::exception& e) {
+            // One failing handler should not stop the other events in the room from being handled
         }
+
+        theShard.Handled.fetch_add(1, std::memory_order_release);
     }
+}
 
-    const std::string Output { leet::invokeRequest_Put(leet::getAPI(APIUrl), list.dump(), resp.accessToken) };
+leet::Sync::SyncMultiplexer::~SyncMultiplexer() {
+    stop();
+}
 
-    nlohmann::json requestResponse{};
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return;
+int leet::Sync::SyncMultiplexer::addAccount(const std::string& Homeserver, const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf,
+        std::function<void(const leet::Sync::Sync&)> Callback, std::function<void(const int, const std::string&)> errorCallback) {
+    auto theAccount = std::make_shared<Account>();
+
+    theAccount->Homeserver = Homeserver;
+    theAccount->Credentials = resp;
+    theAccount->Configuration = conf;
+    theAccount->Configuration.cancellationToken = leetRequest::CancellationToken{}; // removeAccount() cancels it, which should not affect anything else
+    theAccount->Callback = std::move(Callback);
+    theAccount->errorCallback = std::move(errorCallback);
+
+    {
+        std::lock_guard<std::mutex> lock(accountMutex);
+        theAccount->ID = nextID++;
+        Accounts[theAccount->ID] = theAccount;
     }
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+    asyncClient.post([this, theAccount]() {
+        poll(theAccount);
+    });
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+    return theAccount->ID;
+}
+
+void leet::Sync::SyncMultiplexer::removeAccount(const int ID) {
+    std::shared_ptr<Account> theAccount;
+
+    {
+        std::lock_guard<std::mutex> lock(accountMutex);
+
+        auto it = Accounts.find(ID);
+
+        if (it == Accounts.end()) {
+            return;
         }
+
+        theAccount = it->second;
+        theAccount->Removed = true;
+        Accounts.erase(it);
     }
+
+    theAccount->Configuration.cancellationToken.cancel();
 }
 
-// TODO: support other message types than m.text
-#ifndef LEET_NO_ENCRYPTION
-void leet::sendEncryptedMessage(const leet::User::CredentialsResponse& resp, leet::Encryption& enc, const leet::Room::Room& room, const leet::Event::Message& msg) {
-    std::string eventType { "m.room.encrypted" };
-    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/send/" + eventType + "/" + std::to_string(leet::transID) };
+std::string leet::Sync::SyncMultiplexer::returnSince(const int ID) {
+    std::lock_guard<std::mutex> lock(accountMutex);
 
-    nlohmann::json Body{};
+    auto it = Accounts.find(ID);
 
-    Body["type"] = "m.room.message";
-    Body["room_id"] = room.roomID;
+    return it == Accounts.end() ? "" : it->second->Configuration.Since;
+}
+
+void leet::Sync::SyncMultiplexer::run() {
+    // Accounts have their own homeserver, this only keeps the loop from writing errors to the caller's client
+    leet::Client loopClient{};
+    leet::Client::Scope theScope(loopClient);
+
+    asyncClient.run();
+}
+
+void leet::Sync::SyncMultiplexer::stop() {
+    asyncClient.stop();
+}
+
+void leet::Sync::SyncMultiplexer::poll(std::shared_ptr<Account> theAccount) {
+    leetRequest::Request request;
+
+    {
+        std::lock_guard<std::mutex> lock(accountMutex);
+
+        if (theAccount->Removed) {
+            return;
+        }
+
+        request = leetFunction::returnSyncRequest(theAccount->Homeserver, theAccount->Credentials, theAccount->Configuration);
+    }
+
+    asyncClient.makeRequest(request, [this, theAccount](const leetRequest::Response& response) {
+        handleResponse(theAccount, response);
+    });
+}
+
+void leet::Sync::SyncMultiplexer::handleResponse(std::shared_ptr<Account> theAccount, const leetRequest::Response& response) {
+    {
+        std::lock_guard<std::mutex> lock(accountMutex);
+
+        if (theAccount->Removed) {
+            return;
+        }
+    }
+
+    if (response.statusCode == 200) {
+        leet::Sync::Sync sync{};
+
+        if (leetFunction::decodeSync(theAccount->Credentials, response.Body, sync, nullptr) && sync.nextBatch.compare("")) {
+            {
+                std::lock_guard<std::mutex> lock(accountMutex);
+                theAccount->Configuration.Since = sync.nextBatch;
+                theAccount->Configuration.fullState = false;
+            }
+
+            theAccount->Backoff = std::chrono::milliseconds(0);
+
+            // Only starts the request, so the callback below does not hold up the next sync
+            poll(theAccount);
+
+            if (theAccount->Callback) {
+                sync.theRequest = response.Body;
+                theAccount->Callback(sync);
+            }
 
-    if ((msg.bodyType == leet::LEET_BODYTYPE_BASIC) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
-        Body["body"] = msg.messageText;
+            return;
+        }
     }
 
-    if ((msg.bodyType == leet::LEET_BODYTYPE_FORMATTED) || (msg.bodyType == leet::LEET_BODYTYPE_BOTH)) {
-        Body["formatted_body"] = msg.formattedText;
+    if (theAccount->errorCallback) {
+        theAccount->errorCallback(response.statusCode, response.Body);
+    }
 
-        if (!msg.Format.compare("")) {
-            Body["format"] = "org.matrix.custom.html";
-        } else {
-            Body["format"] = msg.Format;
+    // Sync again without the filter ID, using filterConfiguration instead if there is one
+    if (leetFunction::isUnknownFilter(response, theAccount->Configuration)) {
+        leet::filterCache.removeFilter(theAccount->Credentials.userID, theAccount->Configuration.Filter.filterID);
+
+        {
+            std::lock_guard<std::mutex> lock(accountMutex);
+            theAccount->Configuration.Filter.filterID.clear();
         }
+
+        return poll(theAccount);
     }
 
-    Body["content"]["msgtype"] = "m.text";
-    Body["m.mentions"]["user_ids"] = msg.mentionedUserIDs;
+    // The access token is not valid, there is no point in trying again
+    if (response.statusCode == 401) {
+        std::lock_guard<std::mutex> lock(accountMutex);
+        theAccount->Removed = true;
+        Accounts.erase(theAccount->ID);
 
-    if (msg.replyEvent.eventID.compare("")) {
-        Body["m.relates_to"]["m.in_reply_to"]["event_id"] = msg.replyEvent.eventID;
+        return;
     }
 
-    const std::string Output { leet::invokeRequest_Put(leet::getAPI(APIUrl), enc.account.encryptMessage(resp, Body.dump()), resp.accessToken) };
+    theAccount->Backoff = theAccount->Backoff.count() ? std::min(theAccount->Backoff * 2, maximumBackoff) : minimumBackoff;
+
+    asyncClient.postAfter(std::max(theAccount->Backoff, leetFunction::returnRetryAfter(response)), [this, theAccount]() {
+        poll(theAccount);
+    });
+}
+
+leet::VOIP::Credentials leet::returnTurnCredentials(const leet::User::CredentialsResponse& resp) {
+    leet::VOIP::Credentials cred;
+
+    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/voip/turnServer"), resp.accessToken) };
 
     nlohmann::json requestResponse{};
 
     try {
         requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return;
+    }  catch (const nlohmann::json::parse_error& e) {
+        return cred;
     }
 
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
-        if (output["errcode"].is_string()) {
-            leet::errorCode = 1;
-            leet::Error = output["errcode"].get<std::string>();
-            if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-        }
+        if (output["uris"].is_array()) cred.URI = output["uris"];
+        if (output["username"].is_string()) cred.Username = output["username"].get<std::string>();
+        if (output["password"].is_string()) cred.Password = output["password"].get<std::string>();
+        if (output["ttl"].is_number_integer()) cred.timeToLiveIn = output["ttl"].get<int>();
+        if (output["errcode"].is_string()) leet::returnClient().Error = output["errcode"].get<std::string>();
+        if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
     }
-}
-#endif
 
-leet::Event::Event leet::getStateFromType(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& eventType, const std::string& stateKey) {
-    leet::Event::Event event;
-    leet::errorCode = 0;
-    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/state/" + eventType + "/" + stateKey), resp.accessToken) };
+    return cred;
+}
 
-    nlohmann::json requestResponse{};
+std::string leet::getAPI(const std::string& API) {
+    return leet::returnClient().Homeserver + API;
+}
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    }  catch (const nlohmann::json::parse_error& e) {
-        return event;
-    }
+leet::Client& leet::returnClient() {
+    return leetFunction::activeClient ? *leetFunction::activeClient : leet::defaultClient;
+}
 
-    event.eventContent = Output;
+std::shared_ptr<leet::Client> leetFunction::returnClientCopy() {
+    auto theCopy = std::make_shared<leet::Client>(leet::returnClient());
 
-    for (auto& output : requestResponse) {
-        if (output["event_id"].is_string()) event.eventID = output["event_id"].get<std::string>();
-        if (output["origin_server_ts"].is_number_integer()) event.Age = output["origin_server_ts"].get<int>();
+    theCopy->Error.clear();
+    theCopy->friendlyError.clear();
+    theCopy->leetError = leet::LEET_ERROR_NONE;
+    theCopy->errorCode = 0;
+    theCopy->networkStatusCode = 200;
+    theCopy->retryAfter = std::chrono::milliseconds(0);
 
-        if (output["errcode"].is_string()) {
-            leet::Error = output["errcode"].get<std::string>();
-            leet::errorCode = 1;
-        }
+    return theCopy;
+}
 
-        if (output["error"].is_string())
-            leet::friendlyError = output["error"].get<std::string>();
-    }
+leet::Client::Scope::Scope(leet::Client& theClient) : Previous(leetFunction::activeClient) {
+    leetFunction::activeClient = &theClient;
+}
 
-    return event;
+leet::Client::Scope::~Scope() {
+    leetFunction::activeClient = Previous;
 }
 
-leet::Event::Event leet::setStateFromType(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& eventType, const std::string& stateKey, const std::string& Body) {
-    leet::Event::Event event;
-    leet::errorCode = 0;
-    const std::string Output { leet::invokeRequest_Put(leet::getAPI("/_matrix/client/v3/rooms/" + room.roomID + "/state/" + eventType + "/" + stateKey), Body, resp.accessToken) };
+int leet::Client::generateTransID() {
+    leet::Client::Scope theScope(*this);
+    return leet::generateTransID();
+}
 
-    nlohmann::json requestResponse{};
+bool leet::Client::saveTransID(const std::string& File) {
+    leet::Client::Scope theScope(*this);
+    return leet::saveTransID(File);
+}
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return event;
-    }
+bool leet::Client::loadTransID(const std::string& File) {
+    leet::Client::Scope theScope(*this);
+    return leet::loadTransID(File);
+}
 
-    for (auto& output : requestResponse) {
-        if (output["event_id"].is_string()) event.eventID = output["event_id"].get<std::string>();
+bool leet::Client::setTransID(int id) {
+    leet::Client::Scope theScope(*this);
+    return leet::setTransID(id);
+}
 
-        if (output["errcode"].is_string()) {
-            leet::Error = output["errcode"].get<std::string>();
-            leet::errorCode = 1;
-        }
+std::string leet::Client::returnServerDiscovery(const std::string& Server) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnServerDiscovery(Server);
+}
 
-        if (output["error"].is_string())
-            leet::friendlyError = output["error"].get<std::string>();
-    }
+std::string leet::Client::returnHomeServerFromString(const std::string& userID) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnHomeServerFromString(userID);
+}
 
-    return event;
+std::vector<std::string> leet::Client::returnSupportedLoginTypes() {
+    leet::Client::Scope theScope(*this);
+    return leet::returnSupportedLoginTypes();
 }
 
-std::vector<leet::Event::Message> leet::returnMessages(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int messageCount) {
-    std::vector<leet::Event::Message> vector;
-    const std::string APIUrl { "/_matrix/client/v3/rooms/" + room.roomID + "/messages?dir=b&limit=" + std::to_string(messageCount) };
+std::vector<std::string> leet::Client::returnSupportedSpecs() {
+    leet::Client::Scope theScope(*this);
+    return leet::returnSupportedSpecs();
+}
 
-    std::string Output { leet::invokeRequest_Get(leet::getAPI(APIUrl), resp.accessToken) };
+int leet::Client::returnMaxUploadLimit(const leet::User::CredentialsResponse& resp) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnMaxUploadLimit(resp);
+}
 
-    nlohmann::json requestResponse{};
-    try {
-        requestResponse = nlohmann::json::parse(Output);
-    } catch (const nlohmann::json::parse_error& e) {
-        return vector;
-    }
+bool leet::Client::checkError() {
+    leet::Client::Scope theScope(*this);
+    return leet::checkError();
+}
 
-    auto& messages = requestResponse["chunk"];
+leet::User::CredentialsResponse leet::Client::registerAccount(const leet::User::Credentials& cred) {
+    leet::Client::Scope theScope(*this);
+    return leet::registerAccount(cred);
+}
 
-    for (auto it = messages.begin(); it != messages.end(); ++it) {
-        leet::Event::Message message;
+bool leet::Client::checkRegistrationTokenValidity(const std::string& Token) {
+    leet::Client::Scope theScope(*this);
+    return leet::checkRegistrationTokenValidity(Token);
+}
 
-        message.Encrypted = false;
+leet::User::CredentialsResponse leet::Client::loginAccount(const leet::User::Credentials& cred) {
+    leet::Client::Scope theScope(*this);
+    return leet::loginAccount(cred);
+}
 
-        if (it.value().contains("/type"_json_pointer)) message.Type = it.value()["type"];
+leet::User::CredentialsResponse leet::Client::refreshAccessToken(leet::User::CredentialsResponse& resp) {
+    leet::Client::Scope theScope(*this);
+    return leet::refreshAccessToken(resp);
+}
 
-        // Encrypted message
-        if (!message.Type.compare("m.room.encrypted")) {
-            message.Encrypted = true;
-            message.megolm = false;
+void leet::Client::invalidateAccessToken(const std::string& Token) {
+    leet::Client::Scope theScope(*this);
+    return leet::invalidateAccessToken(Token);
+}
 
-            if (it.value().contains("/content/ciphertext"_json_pointer)) message.cipherText = it.value()["content"]["ciphertext"];
-            if (it.value().contains("/content/sender_key"_json_pointer)) message.senderKey = it.value()["content"]["sender_key"];
-            if (it.value().contains("/content/device_id"_json_pointer)) message.deviceID = it.value()["content"]["device_id"];
-            if (it.value().contains("/content/session_id"_json_pointer)) message.sessionID = it.value()["content"]["session_id"];
-            if (it.value().contains("/content/algorithm"_json_pointer)) if (it.value()["content"]["algorithm"] == "m.megolm.v1.aes-sha2") message.megolm = true;
-        }
+leet::User::Profile leet::Client::getUserData(const leet::User::CredentialsResponse& resp, const std::string& userID) {
+    leet::Client::Scope theScope(*this);
+    return leet::getUserData(resp, userID);
+}
 
-        if (it.value().contains("/content/msgtype"_json_pointer)) message.messageType = it.value()["content"]["msgtype"];
-        if (it.value().contains("/sender"_json_pointer)) message.Sender = it.value()["sender"];
+std::string leet::Client::getAPI(const std::string& API) {
+    leet::Client::Scope theScope(*this);
+    return leet::getAPI(API);
+}
 
-        if (it.value().contains("/content/body"_json_pointer)) message.messageText = it.value()["content"]["body"];
-        if (it.value().contains("/content/formatted_body"_json_pointer)) message.formattedText = it.value()["content"]["formatted_body"];
-        if (it.value().contains("/content/format"_json_pointer)) message.Format = it.value()["content"]["format"];
-        if (it.value().contains("/content/info/mimetype"_json_pointer)) message.mimeType = it.value()["content"]["info"]["mimetype"];
-        if (it.value().contains("/event_id"_json_pointer)) message.eventID = it.value()["event_id"];
-        if (it.value().contains("/origin_server_ts"_json_pointer)) message.Age = it.value()["origin_server_ts"];
+std::string leet::Client::invokeRequest_Get(const std::string& URL, const std::string& Authentication) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Get(URL, Authentication);
+}
 
-        // Attachments
-        if (it.value().contains("/content/info/size"_json_pointer)) message.attachmentSize = it.value()["content"]["info"]["size"];
-        if (it.value().contains("/content/info/duration"_json_pointer)) message.attachmentLength = it.value()["content"]["info"]["duration"];
-        if (it.value().contains("/content/info/w"_json_pointer)) message.attachmentWidth = it.value()["content"]["info"]["w"];
-        if (it.value().contains("/content/info/h"_json_pointer)) message.attachmentHeight = it.value()["content"]["info"]["h"];
-        if (it.value().contains("/content/url"_json_pointer)) message.attachmentURL = it.value()["content"]["url"];
+std::string leet::Client::invokeRequest_Delete(const std::string& URL, const std::string& Authentication) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Delete(URL, Authentication);
+}
 
-        // Handle thumbnails
-        if (!message.messageType.compare("m.video")) {
-            if (it.value().contains("/content/info/thumbnail_info/w"_json_pointer)) message.thumbnailWidth = it.value()["content"]["info"]["thumbnail_info"]["w"];
-            if (it.value().contains("/content/info/thumbnail_info/h"_json_pointer)) message.thumbnailHeight = it.value()["content"]["info"]["thumbnail_info"]["h"];
-            if (it.value().contains("/content/info/thumbnail_info/size"_json_pointer)) message.thumbnailSize = it.value()["content"]["info"]["thumbnail_info"]["size"];
-            if (it.value().contains("/content/info/thumbnail_info/mimetype"_json_pointer)) message.thumbnailMimeType = it.value()["content"]["info"]["thumbnail_info"]["mimetype"];
-            if (it.value().contains("/content/info/thumbnail_url"_json_pointer)) message.thumbnailURL = it.value()["content"]["info"]["thumbnail_url"];
-        }
+std::string leet::Client::invokeRequest_Put(const std::string& URL, const std::string& Data, const std::string& Authentication) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Put(URL, Data, Authentication);
+}
 
-        vector.push_back(message);
-    }
+std::string leet::Client::invokeRequest_Post(const std::string& URL, const std::string& Data, const std::string& Authentication) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Post(URL, Data, Authentication);
+}
 
-    return vector;
+std::string leet::Client::invokeRequest_Get(const std::string& URL) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Get(URL);
 }
 
-leet::Filter::Filter leet::returnFilter(const leet::User::CredentialsResponse& resp, const leet::Filter::FilterConfiguration& filter) {
-    leet::Filter::Filter retFilter;
-    const std::string APIUrl { "/_matrix/client/v3/user/" + resp.userID + "/filter" };
+std::string leet::Client::invokeRequest_Delete(const std::string& URL) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Delete(URL);
+}
 
-    nlohmann::json list{};
+std::string leet::Client::invokeRequest_Put(const std::string& URL, const std::string& Data) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Put(URL, Data);
+}
 
-    list["event_format"] = "client";
-    list["event_fields"] = filter.Fields;
-    list["presence"]["senders"] = filter.Senders;
-    list["presence"]["not_senders"] = filter.notSenders;
-    list["room"]["ephemeral"]["rooms"] = filter.Rooms;
-    list["room"]["ephemeral"]["not_rooms"] = filter.notRooms;
-    list["room"]["ephemeral"]["senders"] = filter.Senders;
-    list["room"]["ephemeral"]["not_senders"] = filter.notSenders;
-    list["room"]["state"]["rooms"] = filter.Rooms;
-    list["room"]["state"]["not_rooms"] = filter.notRooms;
+std::string leet::Client::invokeRequest_Post(const std::string& URL, const std::string& Data) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Post(URL, Data);
+}
 
-    if (filter.Limit != 0) {
-        list["room"]["timeline"]["limit"] = filter.Limit;
-    }
+std::string leet::Client::invokeRequest_Post_File(const std::string& URL, const std::string& File) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Post_File(URL, File);
+}
 
-    list["room"]["timeline"]["not_rooms"] = filter.notRooms;
-    list["room"]["timeline"]["not_senders"] = filter.notSenders;
+std::string leet::Client::invokeRequest_Post_File(const std::string& URL, const std::string& File, const std::string& Authentication) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeRequest_Post_File(URL, File, Authentication);
+}
 
-    std::string Output { leet::invokeRequest_Post(leet::getAPI(APIUrl), list.dump(), resp.accessToken) };
+std::vector<leet::Batch::Result> leet::Client::invokeBatch(const std::vector<leet::Batch::Request>& requests, const int Concurrency) {
+    leet::Client::Scope theScope(*this);
+    return leet::invokeBatch(requests, Concurrency);
+}
 
-    nlohmann::json requestResponse{};
-    try {
-        requestResponse = nlohmann::json::parse(Output);
-    } catch (const nlohmann::json::parse_error& e) {
-        return retFilter;
-    }
+leet::Room::Room leet::Client::returnRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnRoom(resp, room);
+}
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+leet::Room::Room leet::Client::upgradeRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int Version) {
+    leet::Client::Scope theScope(*this);
+    return leet::upgradeRoom(resp, room, Version);
+}
 
-        if (output["filter_id"].is_string()) {
-            retFilter.filterID = output["filter_id"].get<std::string>();
-            return retFilter;
-        }
-    }
+leet::Room::Room leet::Client::createRoom(const leet::User::CredentialsResponse& resp, const leet::Room::RoomConfiguration& conf) {
+    leet::Client::Scope theScope(*this);
+    return leet::createRoom(resp, conf);
+}
 
-    return retFilter;
+void leet::Client::joinRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::joinRoom(resp, room, Reason);
 }
 
-void leetFunction::getSessionsFromSync(const leet::User::CredentialsResponse& resp, leet::Sync::Sync& sync, nlohmann::json& it) {
-    if (!it["to_device"]["events"].is_array()) {
-        return;
-    }
+void leet::Client::leaveRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::leaveRoom(resp, room, Reason);
+}
 
-    // we get all encrypted sessions
-    for (auto& itEvent : it["to_device"]["events"]) {
-        leet::errorCode = 0;
-        leet::Sync::MegolmSession megolmSession;
+void leet::Client::kickUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::kickUserFromRoom(resp, room, profile, Reason);
+}
 
-        if (itEvent["content"]["sender_key"].is_string()) {
-            megolmSession.senderKey = itEvent["content"]["sender_key"];
-        }
+void leet::Client::banUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::banUserFromRoom(resp, room, profile, Reason);
+}
 
-        if (itEvent["content"]["algorithm"].is_string()) {
-            megolmSession.Algorithm = itEvent["content"]["algorithm"];
-        }
+void leet::Client::unbanUserFromRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::User::Profile& profile, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::unbanUserFromRoom(resp, room, profile, Reason);
+}
 
-        if (megolmSession.senderKey.compare("")) {
-            if (!itEvent["content"]["ciphertext"][megolmSession.senderKey]["body"].is_null()) {
-                megolmSession.cipherText = itEvent["content"]["ciphertext"][megolmSession.senderKey]["body"];
-            }
+void leet::Client::inviteUserToRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::inviteUserToRoom(resp, room, Reason);
+}
 
-            if (!itEvent["content"]["ciphertext"][megolmSession.senderKey]["type"].is_null()) {
-                megolmSession.cipherType = itEvent["content"]["ciphertext"][megolmSession.senderKey]["type"];
-            }
-        }
+bool leet::Client::getVisibilityOfRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    leet::Client::Scope theScope(*this);
+    return leet::getVisibilityOfRoom(resp, room);
+}
 
-        if (itEvent["sender"].is_string()) {
-            megolmSession.Sender = itEvent["sender"];
-        }
+void leet::Client::setVisibilityOfRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const bool Visibility) {
+    leet::Client::Scope theScope(*this);
+    return leet::setVisibilityOfRoom(resp, room, Visibility);
+}
 
-        if (itEvent["type"].is_string()) {
-            megolmSession.Type = itEvent["type"];
-        }
+std::vector<leet::Room::Room> leet::Client::returnRooms(const leet::User::CredentialsResponse& resp, const int Limit) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnRooms(resp, Limit);
+}
 
-        sync.megolmSessions.push_back(megolmSession);
-    }
+std::vector<leet::Room::Room> leet::Client::returnRoomIDs(const leet::User::CredentialsResponse& resp) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnRoomIDs(resp);
 }
 
-void leetFunction::getInvitesFromSync(const leet::User::CredentialsResponse& resp, leet::Sync::Sync& sync, nlohmann::json& it) {
-    if (it["invite"].is_null()) {
-        return;
-    }
+std::vector<std::string> leet::Client::findRoomAliases(const leet::User::CredentialsResponse& resp, const std::string& roomID) {
+    leet::Client::Scope theScope(*this);
+    return leet::findRoomAliases(resp, roomID);
+}
 
-    for (auto& inviteIt : it["invite"]) { // each room we have invite events in
-        if (inviteIt["invite_state"]["events"].is_null()) {
-            continue;
-        }
+std::string leet::Client::findRoomID(const std::string& Alias) {
+    leet::Client::Scope theScope(*this);
+    return leet::findRoomID(Alias);
+}
 
-        leet::Sync::RoomEvents::InviteEvent theInviteEvent{};
+bool leet::Client::removeRoomAlias(const leet::User::CredentialsResponse& resp, const std::string& Alias) {
+    leet::Client::Scope theScope(*this);
+    return leet::removeRoomAlias(resp, Alias);
+}
 
-        theInviteEvent.Encrypted = false; // sane default
+std::vector<leet::Space::Space> leet::Client::returnSpaces(const leet::User::CredentialsResponse& resp, const int Limit) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnSpaces(resp, Limit);
+}
 
-        for (auto& eventIt : inviteIt["invite_state"]["events"]) {
-            if (!eventIt["type"].is_string()) { // not valid
-                continue;
-            }
+const std::vector<leet::Room::Room> leet::Client::returnRoomsInSpace(const leet::User::CredentialsResponse& resp, const std::string& spaceID, const int Limit) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnRoomsInSpace(resp, spaceID, Limit);
+}
 
-            const std::string theType{eventIt["type"].get<std::string>()};
+leet::Space::Hierarchy leet::Client::returnHierarchy(const leet::User::CredentialsResponse& resp, const std::string& spaceID, const leet::Space::HierarchyConfiguration& conf) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnHierarchy(resp, spaceID, conf);
+}
 
-            if (!theType.compare("m.room.encryption")) {
-                theInviteEvent.Encrypted = true;
-            }
+std::string leet::Client::findUserID(const std::string& Alias, const std::string& Homeserver) {
+    leet::Client::Scope theScope(*this);
+    return leet::findUserID(Alias, Homeserver);
+}
 
-            if (!theType.compare("m.room.create")) {
-                if (eventIt["content"]["creator"].is_string()) {
-                    theInviteEvent.Creator = eventIt["content"]["creator"].get<std::string>();
-                }
-                if (eventIt["content"]["room_version"].is_number_integer()) {
-                    theInviteEvent.roomVersion = eventIt["content"]["room_version"].get<int>();
-                }
-            }
+std::string leet::Client::returnUserName(const std::string& userID) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnUserName(userID);
+}
 
-            if (!theType.compare("m.room.member")) {
-                if (eventIt["state_key"].is_string()) if (eventIt["state_key"].get<std::string>().compare(resp.userID)) {
-                    if (eventIt["content"]["displayname"].is_string()) {
-                        theInviteEvent.displayName = eventIt["content"]["displayname"].get<std::string>();
-                    }
-                    if (eventIt["content"]["avatar_url"].is_string()) {
-                        theInviteEvent.avatarURL = eventIt["content"]["avatar_url"].get<std::string>();
-                    }
-                }
+std::vector<leet::User::Profile> leet::Client::returnUsersInRoom(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnUsersInRoom(resp, room);
+}
 
-                if (eventIt["sender"].is_string()) {
-                    theInviteEvent.userID = eventIt["sender"].get<std::string>();
-                }
-            }
+std::vector<leet::User::Device> leet::Client::returnDevicesFromUser(const leet::User::CredentialsResponse& resp, const std::vector<leet::User::Profile>& user) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnDevicesFromUser(resp, user);
+}
 
-            if (!theType.compare("m.room.name")) {
-                if (eventIt["content"]["name"].is_string()) {
-                    theInviteEvent.roomName = eventIt["content"]["name"].get<std::string>();
-                }
-            }
+leet::User::DeviceListChanges leet::Client::returnDeviceListChanges(const leet::User::CredentialsResponse& resp, const std::string& From, const std::string& To) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnDeviceListChanges(resp, From, To);
+}
 
-            if (!theType.compare("m.room.topic")) {
-                if (eventIt["content"]["topic"].is_string()) {
-                    theInviteEvent.roomTopic = eventIt["content"]["topic"].get<std::string>();
-                }
-            }
+bool leet::Client::checkIfUsernameIsAvailable(const std::string& Username) {
+    leet::Client::Scope theScope(*this);
+    return leet::checkIfUsernameIsAvailable(Username);
+}
 
-            if (!theType.compare("m.room.join_rules")) {
-                if (eventIt["content"]["join_rule"].is_string()) {
-                    theInviteEvent.joinRule = eventIt["content"]["join_rule"].get<std::string>();
-                }
+void leet::Client::toggleTyping(const leet::User::CredentialsResponse& resp, const int Timeout, const bool Typing, const leet::Room::Room& room) {
+    leet::Client::Scope theScope(*this);
+    return leet::toggleTyping(resp, Timeout, Typing, room);
+}
 
-                if (eventIt["content"]["allow"][0]["room_id"].is_string()) {
-                    theInviteEvent.roomID = eventIt["content"]["allow"][0]["room_id"].get<std::string>();
-                }
-            }
+void leet::Client::setReadMarkerPosition(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room,
+    const leet::Event::Event& fullyReadEvent, const leet::Event::Event& readEvent, const leet::Event::Event& privateReadEvent) {
+    leet::Client::Scope theScope(*this);
+    return leet::setReadMarkerPosition(resp, room, fullyReadEvent, readEvent, privateReadEvent);
+}
 
-            if (eventIt["event_id"].is_string()) {
-                theInviteEvent.eventID = eventIt["event_id"].get<std::string>();
-            }
-        }
+void leet::Client::sendMessage(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Message& msg) {
+    leet::Client::Scope theScope(*this);
+    return leet::sendMessage(resp, room, msg);
+}
 
-        sync.roomEvents.inviteEvents.push_back(theInviteEvent);
-    }
+std::vector<leet::Event::Message> leet::Client::returnMessages(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int messageCount) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnMessages(resp, room, messageCount);
 }
 
-void leetFunction::getRoomEventsFromSync(const leet::User::CredentialsResponse& resp, leet::Sync::Sync& sync, nlohmann::json& it) {
-    if (it["rooms"].is_null())  {
-        return;
-    }
+std::vector<leet::Event::Message> leet::Client::returnMessages(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int messageCount, const leet::Filter::RoomEventFilter& filter) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnMessages(resp, room, messageCount, filter);
+}
 
-    leetFunction::getInvitesFromSync(resp, sync, it["rooms"]);
+leet::Event::MessagePage leet::Client::returnMessagePage(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& From, const std::string& To, const bool Direction, const int Limit, const leet::Filter::RoomEventFilter& filter) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnMessagePage(resp, room, From, To, Direction, Limit, filter);
 }
 
-leet::Sync::Sync leet::returnSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf) {
-    leet::Sync::Sync sync{};
-    std::string presenceString{"offline"};
+leet::Filter::Filter leet::Client::returnFilter(const leet::User::CredentialsResponse& resp, const leet::Filter::FilterConfiguration& filter) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnFilter(resp, filter);
+}
 
-    switch(conf.Presence) {
-        case LEET_PRESENCE_OFFLINE:
-            presenceString = "offline";
-            break;
-        case LEET_PRESENCE_ONLINE:
-            presenceString = "online";
-            break;
-        case LEET_PRESENCE_UNAVAILABLE:
-            presenceString = "unavailable";
-            break;
-        default:
-            break;
-    }
+leet::Attachment::Attachment leet::Client::uploadFile(const leet::User::CredentialsResponse& resp, const std::string& File) {
+    leet::Client::Scope theScope(*this);
+    return leet::uploadFile(resp, File);
+}
 
-    const std::string Output = leet::invokeRequest_Get(
-            leet::getAPI("/_matrix/client/v3/sync?presence=" + presenceString + "&timeout=" + std::to_string(conf.Timeout) +
-                        (conf.Since.compare("") ? "&since=" + conf.Since : "") + "&full_state=" + (conf.fullState ? "true" : "false") +
-                        (conf.Filter.filterID.compare("") ? "&filter=" + conf.Filter.filterID : "")),
-                        resp.accessToken
-    );
+bool leet::Client::downloadFile(const leet::User::CredentialsResponse& resp, const leet::Attachment::Attachment& Attachment, const std::string& outputFile) {
+    leet::Client::Scope theScope(*this);
+    return leet::downloadFile(resp, Attachment, outputFile);
+}
 
-    sync.theRequest = Output;
+leet::URL::URLPreview leet::Client::getURLPreview(const leet::User::CredentialsResponse& resp, const std::string& URL, const int64_t time) {
+    leet::Client::Scope theScope(*this);
+    return leet::getURLPreview(resp, URL, time);
+}
 
-    nlohmann::json theOutput{};
+std::string leet::Client::decodeFile(const leet::User::CredentialsResponse& resp, const leet::Attachment::Attachment& Attachment) {
+    leet::Client::Scope theScope(*this);
+    return leet::decodeFile(resp, Attachment);
+}
 
-    try {
-        theOutput = { nlohmann::json::parse(Output) };
-    } catch (const nlohmann::json::parse_error& e) {
-        return sync;
-    }
+leet::Event::Event leet::Client::returnEventFromTimestamp(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const int64_t Timestamp, const bool Direction) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnEventFromTimestamp(resp, room, Timestamp, Direction);
+}
 
-    for (auto& it : theOutput) {
-        leet::errorCode = 0;
+leet::Event::Event leet::Client::returnLatestEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnLatestEvent(resp, room);
+}
 
-        if (it["next_batch"].is_string()) {
-            sync.nextBatch = it["next_batch"].get<std::string>();
-        }
+leet::Event::Event leet::Client::getStateFromType(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& eventType, const std::string& stateKey) {
+    leet::Client::Scope theScope(*this);
+    return leet::getStateFromType(resp, room, eventType, stateKey);
+}
 
-        leetFunction::getSessionsFromSync(resp, sync, it);
-        leetFunction::getRoomEventsFromSync(resp, sync, it);
+leet::Event::Event leet::Client::setStateFromType(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const std::string& eventType, const std::string& stateKey, const std::string& Body) {
+    leet::Client::Scope theScope(*this);
+    return leet::setStateFromType(resp, room, eventType, stateKey, Body);
+}
 
-        /* done:
-         * - to_device
-         * - invite
-         */
-    }
+void leet::Client::redactEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Event& event, const std::string& Reason) {
+    leet::Client::Scope theScope(*this);
+    return leet::redactEvent(resp, room, event, Reason);
+}
 
-    return sync;
+void leet::Client::reportEvent(const leet::User::CredentialsResponse& resp, const leet::Room::Room& room, const leet::Event::Event& event, const std::string& Reason, const int Score) {
+    leet::Client::Scope theScope(*this);
+    return leet::reportEvent(resp, room, event, Reason, Score);
 }
 
-leet::VOIP::Credentials leet::returnTurnCredentials(const leet::User::CredentialsResponse& resp) {
-    leet::VOIP::Credentials cred;
+leet::Sync::Sync leet::Client::returnSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SyncConfiguration& conf) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnSync(resp, conf);
+}
 
-    const std::string Output { leet::invokeRequest_Get(leet::getAPI("/_matrix/client/v3/voip/turnServer"), resp.accessToken) };
+leet::Sync::SlidingSync leet::Client::returnSlidingSync(const leet::User::CredentialsResponse& resp, const leet::Sync::SlidingSyncConfiguration& conf) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnSlidingSync(resp, conf);
+}
 
-    nlohmann::json requestResponse{};
+leet::VOIP::Credentials leet::Client::returnTurnCredentials(const leet::User::CredentialsResponse& resp) {
+    leet::Client::Scope theScope(*this);
+    return leet::returnTurnCredentials(resp);
+}
 
-    try {
-        requestResponse = { nlohmann::json::parse(Output) };
-    }  catch (const nlohmann::json::parse_error& e) {
-        return cred;
-    }
+#ifndef LEET_NO_ENCRYPTION
+leet::Encryption leet::Client::initEncryption() {
+    leet::Client::Scope theScope(*this);
+    return leet::initEncryption();
+}
 
-    for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+leet::Encryption leet::Client::initEncryptionFromPickle(const std::string& pickleKey, const std::string& pickleData) {
+    leet::Client::Scope theScope(*this);
+    return leet::initEncryptionFromPickle(pickleKey, pickleData);
+}
 
-        if (output["uris"].is_array()) cred.URI = output["uris"];
-        if (output["username"].is_string()) cred.Username = output["username"].get<std::string>();
-        if (output["password"].is_string()) cred.Password = output["password"].get<std::string>();
-        if (output["ttl"].is_number_integer()) cred.timeToLiveIn = output["ttl"].get<int>();
-        if (output["errcode"].is_string()) leet::Error = output["errcode"].get<std::string>();
-        if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
-    }
+leet::Encryption leet::Client::uploadKeys(const leet::User::CredentialsResponse& resp, leet::Encryption& enc) {
+    leet::Client::Scope theScope(*this);
+    return leet::uploadKeys(resp, enc);
+}
 
-    return cred;
+leet::Encryption leet::Client::createSessionInRoom(const leet::User::CredentialsResponse& resp, leet::Encryption& enc, const leet::Room::Room& room) {
+    leet::Client::Scope theScope(*this);
+    return leet::createSessionInRoom(resp, enc, room);
 }
 
-std::string leet::getAPI(const std::string& API) {
-    return leet::Homeserver + API;
+void leet::Client::sendEncryptedMessage(const leet::User::CredentialsResponse& resp, leet::Encryption& enc, const leet::Room::Room& room, const leet::Event::Message& msg) {
+    leet::Client::Scope theScope(*this);
+    return leet::sendEncryptedMessage(resp, enc, room, msg);
 }
 
+#endif // #ifndef LEET_NO_ENCRYPTION
+
 int leet::generateTransID() {
-    return ++leet::transID;
+    return ++leet::returnClient().transID;
 }
 
 std::string leet::returnServerDiscovery(const std::string& Server) {
     std::string ret = Server;
-    leet::errorCode = 0;
+    leet::returnClient().errorCode = 0;
 
     if (ret.at(0) != 'h' || ret.at(1) != 't' || ret.at(2) != 't' || ret.at(3) != 'p') {
         ret = "https://" + ret;
@@ -2753,7 +7177,7 @@ std::string leet::returnServerDiscovery(const std::string& Server) {
 std::string leet::returnHomeServerFromString(const std::string& userID) {
     std::string uid{userID};
     if (uid.at(0) != '@') {
-        leet::errorCode = 1;
+        leet::returnClient().errorCode = 1;
         return "";
     }
 
@@ -2778,7 +7202,7 @@ std::vector<std::string> leet::returnSupportedSpecs() {
     }
 
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
         if (output["versions"].is_array()) {
             vector = output["versions"];
@@ -2802,11 +7226,11 @@ int leet::returnMaxUploadLimit(const leet::User::CredentialsResponse& resp) {
     }
 
     for (auto& output : requestResponse) {
-        leet::errorCode = 0;
+        leet::returnClient().errorCode = 0;
 
         if (output["m.upload.size"].is_number_integer()) return output["m.upload.size"].get<int>();
-        if (output["errcode"].is_string()) leet::Error = output["errcode"].get<std::string>();
-        if (output["error"].is_string()) leet::friendlyError = output["error"].get<std::string>();
+        if (output["errcode"].is_string()) leet::returnClient().Error = output["errcode"].get<std::string>();
+        if (output["error"].is_string()) leet::returnClient().friendlyError = output["error"].get<std::string>();
     }
 
     return 0;
@@ -2816,7 +7240,7 @@ int leet::returnMaxUploadLimit(const leet::User::CredentialsResponse& resp) {
  * Thus, it is easiest to use this to check errors.
  */
 bool leet::checkError() {
-    if (leet::errorCode != 0) {
+    if (leet::returnClient().errorCode != 0) {
         return false;
     }
 
@@ -12,11 +12,21 @@
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <thread>
+#include <algorithm>
+#include <memory>
+#include <deque>
+#include <condition_variable>
+#include <exception>
+#include <optional>
+#include <atomic>
 #include <boost/beast/core.hpp>
 #include <boost/beast/http.hpp>
 #include <boost/beast/version.hpp>
 #include <boost/beast/ssl.hpp>
 #include <boost/asio/connect.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/asio/ssl/error.hpp>
 #include <boost/asio/ssl/stream.hpp>
@@ -25,6 +35,489 @@
 #include <openssl/ssl.h>
 #include <net/Request.hpp>
 
+namespace leetRequest {
+    /**
+     * @brief  Class representing an open connection to a host
+     *
+     * Each connection has its own io_context, which is only ever run by the thread that
+     * is currently using the connection. This lets blocking requests use asynchronous
+     * operations, and with that deadlines and cancellation.
+     */
+    class Connection {
+        private:
+        public:
+            std::shared_ptr<boost::asio::ssl::context> Context;
+            boost::asio::io_context ioc{};
+            boost::beast::ssl_stream<boost::beast::tcp_stream> stream;
+            boost::asio::ip::tcp::resolver Resolver;
+            boost::beast::flat_buffer Buffer{}; // Data read past the end of the previous response
+            std::string Key{}; // <host>:<port>
+            std::chrono::steady_clock::time_point lastUsed{};
+            std::atomic<std::uint64_t> Generation{0}; // Incremented whenever an operation stops using the connection
+
+            Connection(std::shared_ptr<boost::asio::ssl::context> ctx) : Context(ctx), stream(ioc, *Context), Resolver(ioc) {}
+
+            /**
+             * @brief  Start an asynchronous operation on the stream and wait for it to complete
+             * @param  Timeout How long the operation may take, zero means forever.
+             * @param  Start Function which starts the operation, given the completion handler to use.
+             * @return Returns the error the operation completed with. beast::error::timeout is returned if the deadline passed.
+             */
+            template <typename Operation>
+            boost::system::error_code runOperation(const std::chrono::milliseconds Timeout, Operation&& Start) {
+                boost::system::error_code ec;
+
+                if (Timeout.count() > 0) {
+                    boost::beast::get_lowest_layer(stream).expires_after(Timeout);
+                } else {
+                    boost::beast::get_lowest_layer(stream).expires_never();
+                }
+
+                Start([&ec](const boost::system::error_code& theError, auto&&...) {
+                    ec = theError;
+                });
+
+                ioc.restart();
+                ioc.run();
+
+                return ec;
+            }
+    };
+
+    /**
+     * @brief  Class which cancels the operations on a connection if a token is cancelled while it exists
+     *
+     * It must be destroyed before the connection is released to the pool. A cancel which is still queued
+     * on the connection by then sees that the generation has changed, and leaves the next borrower alone.
+     */
+    class CancellationSubscription {
+        private:
+            CancellationToken& Token;
+            std::shared_ptr<Connection> theConnection;
+            int ID{-1};
+        public:
+            CancellationSubscription(CancellationToken& theToken, std::shared_ptr<Connection> connection) : Token(theToken), theConnection(connection) {
+                const std::uint64_t Generation = connection->Generation.load();
+
+                // cancel() may be called from any thread, so the actual cancelling is done by the thread running the io_context
+                ID = Token.subscribe([connection, Generation]() {
+                    boost::asio::post(connection->ioc, [connection, Generation]() {
+                        if (connection->Generation.load() != Generation) {
+                            return;
+                        }
+
+                        boost::system::error_code ec;
+                        connection->Resolver.cancel();
+                        boost::beast::get_lowest_layer(connection->stream).socket().cancel(ec);
+                    });
+                });
+            }
+            ~CancellationSubscription() {
+                Token.unsubscribe(ID);
+                theConnection->Generation++;
+            }
+
+            CancellationSubscription(const CancellationSubscription&) = delete;
+            CancellationSubscription& operator=(const CancellationSubscription&) = delete;
+    };
+
+    /**
+     * @brief  Stream buffer which hands body chunks from the thread receiving them to the thread reading them
+     */
+    class ChunkBuffer : public std::streambuf {
+        private:
+            std::mutex chunkMutex{};
+            std::condition_variable chunkCondition{};
+            std::deque<std::string> Chunks{};
+            std::string Current{}; // Chunk currently being read
+            std::size_t queuedBytes{0};
+            bool Finished{false}; // No more chunks will be pushed
+            bool Abandoned{false}; // The reader has stopped reading
+        protected:
+            int_type underflow() override {
+                std::unique_lock<std::mutex> lock(chunkMutex);
+                chunkCondition.wait(lock, [&]() { return !Chunks.empty() || Finished; });
+
+                if (Chunks.empty()) {
+                    return traits_type::eof();
+                }
+
+                Current = std::move(Chunks.front());
+                Chunks.pop_front();
+                queuedBytes -= Current.size();
+
+                lock.unlock();
+                chunkCondition.notify_all();
+
+                setg(Current.data(), Current.data(), Current.data() + Current.size());
+
+                return traits_type::to_int_type(*gptr());
+            }
+        public:
+            std::size_t maxQueuedBytes{4 * 1024 * 1024}; // The receiving thread waits if the reader falls this far behind
+
+            /**
+             * @brief  Queue a chunk for the reader
+             * @return Returns false if the reader has stopped reading.
+             */
+            bool push(const char* Data, const std::size_t Length) {
+                std::unique_lock<std::mutex> lock(chunkMutex);
+                chunkCondition.wait(lock, [&]() { return queuedBytes < maxQueuedBytes || Abandoned; });
+
+                if (Abandoned) {
+                    return false;
+                }
+
+                Chunks.emplace_back(Data, Length);
+                queuedBytes += Length;
+
+                lock.unlock();
+                chunkCondition.notify_all();
+
+                return true;
+            }
+            /**
+             * @brief  Tell the reader there are no more chunks
+             */
+            void finish() {
+                std::lock_guard<std::mutex> lock(chunkMutex);
+                Finished = true;
+                chunkCondition.notify_all();
+            }
+            /**
+             * @brief  Tell the receiving thread there is no point in pushing more chunks
+             */
+            void abandon() {
+                std::lock_guard<std::mutex> lock(chunkMutex);
+                Abandoned = true;
+                chunkCondition.notify_all();
+            }
+    };
+
+    std::shared_ptr<boost::asio::ssl::context> returnSSLContext();
+    std::shared_ptr<Connection> createConnection(const std::string& Host, const int Port);
+    void setServerName(boost::beast::ssl_stream<boost::beast::tcp_stream>& stream, const std::string& Host);
+    void connectConnection(Connection& connection, const std::string& Host, const int Port, const Deadlines& Timeouts);
+    void closeConnection(std::shared_ptr<Connection> connection);
+    boost::beast::http::request<boost::beast::http::string_body> returnHTTPRequest(const Request& theRequest);
+    bool isRetrySafe(const int Type, const std::size_t Written);
+
+    /**
+     * @brief  Class representing an open connection used by an AsyncClient
+     */
+    class AsyncConnection {
+        private:
+        public:
+            std::shared_ptr<boost::asio::ssl::context> Context;
+            boost::beast::ssl_stream<boost::beast::tcp_stream> stream;
+            boost::beast::flat_buffer Buffer{}; // Data read past the end of the previous response
+            std::string Key{}; // <host>:<port>
+            std::chrono::steady_clock::time_point lastUsed{};
+
+            AsyncConnection(boost::asio::io_context& ioc, std::shared_ptr<boost::asio::ssl::context> ctx) : Context(ctx), stream(ioc, *Context) {}
+
+            void close() {
+                boost::system::error_code ec;
+
+                boost::beast::get_lowest_layer(stream).socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+                boost::beast::get_lowest_layer(stream).socket().close(ec);
+            }
+    };
+
+    /**
+     * @brief  Class holding the event loop of an AsyncClient and its idle connections
+     *
+     * Idle connections are only touched from the thread running the loop, so they need no lock.
+     */
+    class AsyncState {
+        private:
+        public:
+            boost::asio::io_context ioc{};
+            boost::asio::executor_work_guard<boost::asio::io_context::executor_type> Work{ioc.get_executor()};
+            std::map<std::string, std::vector<std::shared_ptr<AsyncConnection>>> idleConnections{};
+            std::size_t maxIdlePerHost{16};
+
+            std::shared_ptr<AsyncConnection> acquire(const std::string& Key) {
+                auto& Idle = idleConnections[Key];
+                const auto Now = std::chrono::steady_clock::now();
+
+                while (!Idle.empty()) {
+                    std::shared_ptr<AsyncConnection> connection = Idle.back();
+                    Idle.pop_back();
+
+                    if (Now - connection->lastUsed > leetRequest::connectionPool.idleTimeout) {
+                        connection->close();
+                        continue;
+                    }
+
+                    return connection;
+                }
+
+                return nullptr;
+            }
+            void release(std::shared_ptr<AsyncConnection> connection) {
+                connection->lastUsed = std::chrono::steady_clock::now();
+                boost::beast::get_lowest_layer(connection->stream).expires_never();
+
+                auto& Idle = idleConnections[connection->Key];
+
+                if (Idle.size() < maxIdlePerHost) {
+                    Idle.push_back(connection);
+                    return;
+                }
+
+                connection->close();
+            }
+    };
+
+    /**
+     * @brief  Class representing a single request made by an AsyncClient, from connecting to reading the body
+     *
+     * Every step is started from the completion handler of the previous one. The exchange keeps
+     * itself alive by passing a shared pointer to itself along with each handler.
+     *
+     * The state is not owned by the exchange. Its io_context holds the handlers which own the exchange, so
+     * owning the state as well would keep both alive forever. Destroying the io_context destroys the pending
+     * handlers, and with them every exchange which hasn't finished.
+     */
+    class AsyncExchange : public std::enable_shared_from_this<AsyncExchange> {
+        private:
+            AsyncState* State; // Only used from handlers, which can only run while the state exists
+            std::weak_ptr<AsyncState> weakState; // Used by the cancellation callback, which may be called from any thread
+            Request theRequest;
+            std::function<void(const Response&)> Callback;
+            boost::beast::http::request<boost::beast::http::string_body> httpRequest{};
+            std::unique_ptr<boost::beast::http::response_parser<boost::beast::http::string_body>> Parser{};
+            std::shared_ptr<AsyncConnection> connection{};
+            boost::asio::ip::tcp::resolver Resolver;
+            boost::asio::steady_timer Timer;
+            std::string Key{};
+            int theClass{LEET_REQUEST_CLASS_OTHER};
+            int subscriptionID{-1};
+            bool Reused{false};
+            std::size_t Written{0}; // Bytes of the request written to the connection
+            bool resolveTimedOut{false};
+            bool Finished{false};
+
+            void setDeadline(const std::chrono::milliseconds Timeout) {
+                if (Timeout.count() > 0) {
+                    boost::beast::get_lowest_layer(connection->stream).expires_after(Timeout);
+                } else {
+                    boost::beast::get_lowest_layer(connection->stream).expires_never();
+                }
+            }
+            void connect(const bool allowReuse) {
+                connection = allowReuse ? State->acquire(Key) : nullptr;
+                Reused = connection != nullptr;
+
+                if (Reused) {
+                    return send();
+                }
+
+                try {
+                    connection = std::make_shared<AsyncConnection>(State->ioc, leetRequest::returnSSLContext());
+                    connection->Key = Key;
+                    leetRequest::setServerName(connection->stream, theRequest.Host);
+                } catch (boost::system::system_error const &e) {
+                    return finish(e.code());
+                }
+
+                auto self = shared_from_this();
+
+                // The resolver is not covered by the stream's deadline, so it gets a timer of its own
+                resolveTimedOut = false;
+
+                if (theRequest.Timeouts.connectTimeout.count() > 0) {
+                    Timer.expires_after(theRequest.Timeouts.connectTimeout);
+                    Timer.async_wait([self](const boost::system::error_code& ec) {
+                        if (!ec) {
+                            self->resolveTimedOut = true;
+                            self->Resolver.cancel();
+                        }
+                    });
+                }
+
+                Resolver.async_resolve(theRequest.Host, std::to_string(theRequest.Port),
+                    [self](const boost::system::error_code& theError, boost::asio::ip::tcp::resolver::results_type Results) {
+                        boost::system::error_code ec = self->resolveTimedOut ? boost::beast::error::timeout : theError;
+                        self->Timer.cancel();
+
+                        if (ec) {
+                            return self->finish(ec);
+                        }
+
+                        self->setDeadline(self->theRequest.Timeouts.connectTimeout);
+                        boost::beast::get_lowest_layer(self->connection->stream).async_connect(Results,
+                            [self](const boost::system::error_code& ec, auto&&) {
+                                if (ec) {
+                                    return self->finish(ec);
+                                }
+
+                                self->setDeadline(self->theRequest.Timeouts.handshakeTimeout);
+                                self->connection->stream.async_handshake(boost::asio::ssl::stream_base::client,
+                                    [self](const boost::system::error_code& ec) {
+                                        if (ec) {
+                                            return self->finish(ec);
+                                        }
+
+                                        self->send();
+                                    });
+                            });
+                    });
+            }
+            void send() {
+                auto self = shared_from_this();
+
+                Parser = std::make_unique<boost::beast::http::response_parser<boost::beast::http::string_body>>();
+
+                if (theRequest.bodyLimit >= 0) {
+                    Parser->body_limit(static_cast<std::uint64_t>(theRequest.bodyLimit));
+                } else {
+                    Parser->body_limit(theClass == LEET_REQUEST_CLASS_MEDIA ? leetRequest::bodyLimits.mediaLimit : leetRequest::bodyLimits.jsonLimit);
+                }
+
+                Written = 0;
+
+                setDeadline(theRequest.Timeouts.sendTimeout);
+                boost::beast::http::async_write(connection->stream, httpRequest, [self](const boost::system::error_code& ec, std::size_t Length) {
+                    self->Written = Length;
+
+                    if (ec) {
+                        return self->finish(ec);
+                    }
+
+                    self->setDeadline(self->theRequest.Timeouts.headerTimeout);
+                    boost::beast::http::async_read_header(self->connection->stream, self->connection->Buffer, *self->Parser,
+                        [self](const boost::system::error_code& ec, std::size_t) {
+                            if (ec) {
+                                return self->finish(ec);
+                            }
+
+                            self->setDeadline(self->theRequest.Timeouts.bodyTimeout);
+                            boost::beast::http::async_read(self->connection->stream, self->connection->Buffer, *self->Parser,
+                                [self](const boost::system::error_code& ec, std::size_t) {
+                                    self->finish(ec);
+                                });
+                        });
+                });
+            }
+            void finish(const boost::system::error_code& ec) {
+                if (Finished) {
+                    return;
+                }
+
+                // An idle connection the server has closed in the meantime, try again on a new one
+                if (ec && Reused && !(Parser && Parser->got_some()) && ec != boost::beast::error::timeout && !theRequest.cancellationToken.isCancelled() &&
+                    leetRequest::isRetrySafe(theRequest.Type, Written)) {
+                    connection->close();
+                    return connect(false);
+                }
+
+                Finished = true;
+                theRequest.cancellationToken.unsubscribe(subscriptionID);
+                subscriptionID = -1;
+
+                Response resp;
+
+                if (ec) {
+                    resp.statusCode = 0;
+                    resp.networkError = ec.message();
+                    resp.timedOut = ec == boost::beast::error::timeout;
+                    resp.Cancelled = theRequest.cancellationToken.isCancelled();
+
+                    if (connection) {
+                        connection->close();
+                    }
+                } else {
+                    auto& res = Parser->get();
+
+                    resp.statusCode = res.result_int();
+                    resp.contentType = std::string(res[boost::beast::http::field::content_type]);
+                    resp.Body = std::move(res.body());
+                    resp.bodySize = resp.Body.size();
+
+                    leetRequest::trafficShaper.consume(theRequest.Host, theClass, resp.bodySize);
+
+                    if (Parser->keep_alive() && !theRequest.cancellationToken.isCancelled()) {
+                        State->release(connection);
+                    } else {
+                        connection->close();
+                    }
+                }
+
+                connection.reset();
+                Parser.reset();
+
+                if (Callback) {
+                    Callback(resp);
+                }
+            }
+        public:
+            AsyncExchange(std::shared_ptr<AsyncState> theState, const Request& request, std::function<void(const Response&)> theCallback) :
+                State(theState.get()), weakState(theState), theRequest(request), Callback(std::move(theCallback)), Resolver(theState->ioc), Timer(theState->ioc) {}
+            ~AsyncExchange() {
+                if (subscriptionID != -1) {
+                    theRequest.cancellationToken.unsubscribe(subscriptionID);
+                }
+            }
+
+            /**
+             * @brief  Start the request, must be called from the thread running the loop
+             */
+            void start() {
+                auto self = shared_from_this();
+
+                theClass = theRequest.endpointClass == LEET_REQUEST_CLASS_AUTO ? leetRequest::returnEndpointClass(theRequest.Endpoint) : theRequest.endpointClass;
+                Key = theRequest.Host + ":" + std::to_string(theRequest.Port);
+
+                try {
+                    httpRequest = leetRequest::returnHTTPRequest(theRequest);
+                } catch (std::exception const &) {
+                    return finish(boost::asio::error::invalid_argument);
+                }
+
+                if (theRequest.cancellationToken.isCancelled()) {
+                    return finish(boost::asio::error::operation_aborted);
+                }
+
+                // cancel() may be called from any thread, so the actual cancelling is done by the thread running the loop
+                std::weak_ptr<AsyncExchange> Weak = self;
+
+                subscriptionID = theRequest.cancellationToken.subscribe([Weak, weakState = weakState]() {
+                    if (auto theState = weakState.lock()) {
+                        boost::asio::post(theState->ioc, [Weak]() {
+                            if (auto exchange = Weak.lock()) {
+                                boost::system::error_code ec;
+
+                                exchange->Resolver.cancel();
+                                exchange->Timer.cancel();
+
+                                if (exchange->connection) {
+                                    boost::beast::get_lowest_layer(exchange->connection->stream).socket().cancel(ec);
+                                }
+                            }
+                        });
+                    }
+                });
+
+                const std::chrono::nanoseconds Wait = leetRequest::trafficShaper.reserve(theRequest.Host, theClass, httpRequest.body().size());
+
+                if (Wait.count() <= 0) {
+                    return connect(true);
+                }
+
+                Timer.expires_after(Wait);
+                Timer.async_wait([self](const boost::system::error_code& ec) {
+                    if (ec) {
+                        return self->finish(ec);
+                    }
+
+                    self->connect(true);
+                });
+            }
+    };
+}
+
 void leetRequest::URL::parseURLFromString(const std::string& URL) {
     std::regex urlReg("(http|https)://([^/ :]+):?([^/ ]*)(/?[^ #?]*)\\x3f?([^ #]*)#?([^ ]*)");
     std::smatch Match;
@@ -84,121 +577,728 @@ void leetRequest::Request::setContentTypeHeader(const std::string& Data) {
     contentTypeHeaderData = Data;
 }
 
-leetRequest::Response leetRequest::Request::makeRequest() {
-    leetRequest::Response resp;
+leetRequest::Request::Request() : Timeouts(leetRequest::defaultDeadlines) {
+}
 
-    try {
-        boost::asio::ssl::context ctx(boost::asio::ssl::context::tlsv12_client);
+void leetRequest::CancellationToken::cancel() {
+    std::map<int, std::function<void()>> Callbacks;
+
+    {
+        std::lock_guard<std::mutex> lock(state->stateMutex);
+
+        if (state->Cancelled) {
+            return;
+        }
+
+        state->Cancelled = true;
+        Callbacks.swap(state->Callbacks);
+    }
+
+    state->cancelCondition.notify_all();
+
+    for (auto& it : Callbacks) {
+        it.second();
+    }
+}
+
+bool leetRequest::CancellationToken::isCancelled() const {
+    std::lock_guard<std::mutex> lock(state->stateMutex);
+    return state->Cancelled;
+}
+
+bool leetRequest::CancellationToken::waitFor(const std::chrono::nanoseconds Timeout) const {
+    std::unique_lock<std::mutex> lock(state->stateMutex);
+    return state->cancelCondition.wait_for(lock, Timeout, [&]() { return state->Cancelled; });
+}
+
+int leetRequest::CancellationToken::subscribe(std::function<void()> Callback) {
+    {
+        std::lock_guard<std::mutex> lock(state->stateMutex);
+
+        if (!state->Cancelled) {
+            state->Callbacks[state->nextID] = std::move(Callback);
+            return state->nextID++;
+        }
+    }
+
+    Callback();
+
+    return -1;
+}
+
+void leetRequest::CancellationToken::unsubscribe(const int ID) {
+    std::lock_guard<std::mutex> lock(state->stateMutex);
+    state->Callbacks.erase(ID);
+}
+
+std::chrono::nanoseconds leetRequest::TokenBucket::reserve(const double Count, const std::chrono::steady_clock::time_point Now) {
+    if (Rate <= 0) {
+        return std::chrono::nanoseconds{0};
+    }
+
+    if (lastRefill == std::chrono::steady_clock::time_point{}) { // first use, start out full
+        Tokens = Burst;
+    } else {
+        const double Elapsed = std::chrono::duration<double>(Now - lastRefill).count();
+        Tokens = std::min(Burst, Tokens + Elapsed * Rate);
+    }
+
+    lastRefill = Now;
+
+    /* A reservation larger than the bucket can ever hold only has to wait until the
+     * bucket is full. The rest is left as debt which later reservations will pay for.
+     */
+    const double Needed = std::min(Count, Burst);
+    const double Wait = Tokens >= Needed ? 0 : (Needed - Tokens) / Rate;
+
+    Tokens -= Count;
+
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::duration<double>(Wait));
+}
+
+leetRequest::TrafficShaper::Buckets* leetRequest::TrafficShaper::findBuckets(const std::string& Host, const int endpointClass) {
+    const std::string Key{ Host + "#" + std::to_string(endpointClass) };
+
+    auto active = activeBuckets.find(Key);
+    if (active != activeBuckets.end()) {
+        return &active->second;
+    }
+
+    auto limit = Limits.find(Key);
+    if (limit == Limits.end()) {
+        limit = Limits.find("#" + std::to_string(endpointClass));
+    }
+    if (limit == Limits.end()) {
+        return nullptr;
+    }
+
+    Buckets& buckets = activeBuckets[Key];
+
+    applyLimit(buckets, limit->second);
+
+    return &buckets;
+}
+
+void leetRequest::TrafficShaper::applyLimit(Buckets& buckets, const TrafficLimit& Limit) {
+    buckets.Requests.Rate = Limit.requestsPerSecond;
+    buckets.Requests.Burst = std::max(1.0, Limit.requestBurst);
+    buckets.Requests.Tokens = std::min(buckets.Requests.Tokens, buckets.Requests.Burst);
+    buckets.Bytes.Rate = Limit.bytesPerSecond;
+    buckets.Bytes.Burst = std::max(1.0, Limit.byteBurst);
+    buckets.Bytes.Tokens = std::min(buckets.Bytes.Tokens, buckets.Bytes.Burst);
+}
+
+void leetRequest::TrafficShaper::setLimit(const std::string& Host, const int endpointClass, const TrafficLimit& Limit) {
+    std::lock_guard<std::mutex> lock(shaperMutex);
 
-        const std::string cert = leetRequest::getRootCertificates();
+    const std::string Suffix{ "#" + std::to_string(endpointClass) };
 
-        boost::system::error_code ec;
+    Limits[Host + Suffix] = Limit;
 
-        ctx.add_certificate_authority(boost::asio::buffer(cert.data(), cert.size()), ec);
+    // Buckets already in use keep their balance, including any debt, and only get the new rates
+    for (auto& it : activeBuckets) {
+        if (it.first.size() < Suffix.size() || it.first.compare(it.first.size() - Suffix.size(), Suffix.size(), Suffix)) {
+            continue;
+        }
+
+        const std::string bucketHost{ it.first.substr(0, it.first.size() - Suffix.size()) };
 
-        if (ec) {
-            throw boost::system::system_error{ec};
+        // A limit for a specific host takes precedence over the one for every host
+        if (bucketHost.compare(Host) && (Host.compare("") || Limits.count(it.first))) {
+            continue;
         }
 
-        boost::asio::io_context ioc;
-        boost::asio::ip::tcp::resolver resolver(ioc);
+        applyLimit(it.second, Limit);
+    }
+}
+
+void leetRequest::TrafficShaper::clearLimits() {
+    std::lock_guard<std::mutex> lock(shaperMutex);
+
+    Limits.clear();
+    activeBuckets.clear();
+}
+
+std::chrono::nanoseconds leetRequest::TrafficShaper::reserve(const std::string& Host, const int endpointClass, const std::size_t Bytes) {
+    std::lock_guard<std::mutex> lock(shaperMutex);
+    std::chrono::nanoseconds Wait{0};
+
+    if (Limits.empty()) {
+        return Wait;
+    }
+
+    const auto Now = std::chrono::steady_clock::now();
 
-        ctx.set_verify_mode(boost::asio::ssl::verify_peer);
-        ctx.set_verify_callback(boost::asio::ssl::host_name_verification(Host));
+    for (const int theClass : { endpointClass, static_cast<int>(LEET_REQUEST_CLASS_ANY) }) {
+        Buckets* buckets = findBuckets(Host, theClass);
 
-        boost::beast::ssl_stream<boost::beast::tcp_stream> stream(ioc, ctx);
+        if (buckets) {
+            Wait = std::max(Wait, buckets->Requests.reserve(1, Now));
+            if (Bytes && (theClass == endpointClass || endpointClass != LEET_REQUEST_CLASS_MEDIA)) Wait = std::max(Wait, buckets->Bytes.reserve(static_cast<double>(Bytes), Now));
+        }
 
-        if (!SSL_set_tlsext_host_name(stream.native_handle(), Host.c_str())) {
-            boost::system::error_code ssl_ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
-            throw boost::beast::system_error{ssl_ec};
+        if (theClass == LEET_REQUEST_CLASS_ANY) {
+            break;
         }
+    }
+
+    return Wait;
+}
 
-        const auto results { resolver.resolve(Host, std::to_string(Port)) };
+void leetRequest::TrafficShaper::consume(const std::string& Host, const int endpointClass, const std::size_t Bytes) {
+    std::lock_guard<std::mutex> lock(shaperMutex);
 
-        boost::beast::get_lowest_layer(stream).connect(results);
+    if (Limits.empty() || !Bytes) {
+        return;
+    }
 
-        stream.handshake(boost::asio::ssl::stream_base::client);
+    const auto Now = std::chrono::steady_clock::now();
 
-        boost::beast::http::verb theVerb;
+    for (const int theClass : { endpointClass, static_cast<int>(LEET_REQUEST_CLASS_ANY) }) {
+        Buckets* buckets = findBuckets(Host, theClass);
 
-        switch (Type) {
-            case leetRequest::LEET_REQUEST_REQTYPE_GET:
-                theVerb = boost::beast::http::verb::get;
-                break;
-            case leetRequest::LEET_REQUEST_REQTYPE_POST:
-                theVerb = boost::beast::http::verb::post;
-                break;
-            case leetRequest::LEET_REQUEST_REQTYPE_PUT:
-                theVerb = boost::beast::http::verb::put;
-                break;
-        case leetRequest::LEET_REQUEST_REQTYPE_DELETE:
-        theVerb = boost::beast::http::verb::delete_;
-        break;
-            default:
-                break;
+        // Media bytes stay in the media bucket, so send and sync requests never wait for media debt
+        if (buckets && (theClass == endpointClass || endpointClass != LEET_REQUEST_CLASS_MEDIA)) {
+            buckets->Bytes.reserve(static_cast<double>(Bytes), Now); // no waiting, the debt is paid by the next request
         }
 
-        boost::beast::http::request<boost::beast::http::string_body> httpRequest{theVerb, Host + std::to_string(Port), 11};
-        httpRequest.set(boost::beast::http::field::host, Host);
+        if (theClass == LEET_REQUEST_CLASS_ANY) {
+            break;
+        }
+    }
+}
+
+void leetRequest::TrafficShaper::waitFor(const std::string& Host, const int endpointClass, const std::size_t Bytes) {
+    const std::chrono::nanoseconds Wait = reserve(Host, endpointClass, Bytes);
+
+    if (Wait.count() > 0) {
+        std::this_thread::sleep_for(Wait);
+    }
+}
+
+void leetRequest::TrafficShaper::waitFor(const std::string& Host, const int endpointClass, const std::size_t Bytes, const CancellationToken& Token) {
+    const std::chrono::nanoseconds Wait = reserve(Host, endpointClass, Bytes);
+
+    if (Wait.count() > 0 && Token.waitFor(Wait)) {
+        throw boost::system::system_error{boost::asio::error::operation_aborted};
+    }
+}
+
+int leetRequest::returnEndpointClass(const std::string& Endpoint) {
+    auto endsWith = [&](const std::string& Suffix) {
+        return Endpoint.size() >= Suffix.size() && !Endpoint.compare(Endpoint.size() - Suffix.size(), Suffix.size(), Suffix);
+    };
+
+    if (Endpoint.find("/_matrix/media/") != std::string::npos || Endpoint.find("/_matrix/client/v1/media/") != std::string::npos) {
+        return LEET_REQUEST_CLASS_MEDIA;
+    }
+    if (Endpoint.find("/keys/") != std::string::npos) {
+        return LEET_REQUEST_CLASS_KEYS;
+    }
+    if (endsWith("/sync")) {
+        return LEET_REQUEST_CLASS_SYNC;
+    }
+    if (Endpoint.find("/send/") != std::string::npos || Endpoint.find("/sendToDevice/") != std::string::npos || Endpoint.find("/redact/") != std::string::npos) {
+        return LEET_REQUEST_CLASS_SEND;
+    }
+
+    return LEET_REQUEST_CLASS_OTHER;
+}
+
+std::shared_ptr<boost::asio::ssl::context> leetRequest::returnSSLContext() {
+    static std::mutex contextMutex;
+    static std::shared_ptr<boost::asio::ssl::context> Context;
+    static std::string contextCert;
+
+    std::lock_guard<std::mutex> lock(contextMutex);
+
+    const std::string cert = leetRequest::getRootCertificates();
+
+    /* Loading the root certificates is expensive, so the context is only
+     * created again if the user specified certificate has changed.
+     */
+    if (Context && !contextCert.compare(cert)) {
+        return Context;
+    }
+
+    auto ctx = std::make_shared<boost::asio::ssl::context>(boost::asio::ssl::context::tlsv12_client);
+
+    boost::system::error_code ec;
+
+    ctx->add_certificate_authority(boost::asio::buffer(cert.data(), cert.size()), ec);
+
+    if (ec) {
+        throw boost::system::system_error{ec};
+    }
+
+    ctx->set_verify_mode(boost::asio::ssl::verify_peer);
+
+    Context = ctx;
+    contextCert = cert;
+
+    return Context;
+}
+
+std::shared_ptr<leetRequest::Connection> leetRequest::createConnection(const std::string& Host, const int Port) {
+    auto connection = std::make_shared<leetRequest::Connection>(leetRequest::returnSSLContext());
+
+    connection->Key = Host + ":" + std::to_string(Port);
+    leetRequest::setServerName(connection->stream, Host);
+
+    return connection;
+}
+
+/* A request which the server may have received already is only made again if making it twice
+ * does no harm. POST is the only method used which isn't idempotent.
+ */
+bool leetRequest::isRetrySafe(const int Type, const std::size_t Written) {
+    return Written == 0 || Type != LEET_REQUEST_REQTYPE_POST;
+}
+
+void leetRequest::setServerName(boost::beast::ssl_stream<boost::beast::tcp_stream>& stream, const std::string& Host) {
+    stream.set_verify_callback(boost::asio::ssl::host_name_verification(Host));
+
+    if (!SSL_set_tlsext_host_name(stream.native_handle(), Host.c_str())) {
+        boost::system::error_code ssl_ec{static_cast<int>(::ERR_get_error()), boost::asio::error::get_ssl_category()};
+        throw boost::beast::system_error{ssl_ec};
+    }
+}
+
+void leetRequest::connectConnection(leetRequest::Connection& connection, const std::string& Host, const int Port, const leetRequest::Deadlines& Timeouts) {
+    boost::system::error_code ec;
+    boost::asio::ip::tcp::resolver::results_type Results;
+    boost::asio::steady_timer Timer(connection.ioc);
+    bool timedOut{false};
+
+    // The resolver is not covered by the stream's deadline, so it gets a timer of its own
+    connection.Resolver.async_resolve(Host, std::to_string(Port),
+        [&](const boost::system::error_code& theError, boost::asio::ip::tcp::resolver::results_type theResults) {
+            ec = theError;
+            Results = theResults;
+            Timer.cancel();
+        });
+
+    if (Timeouts.connectTimeout.count() > 0) {
+        Timer.expires_after(Timeouts.connectTimeout);
+        Timer.async_wait([&](const boost::system::error_code& theError) {
+            if (!theError) {
+                timedOut = true;
+                connection.Resolver.cancel();
+            }
+        });
+    }
+
+    connection.ioc.restart();
+    connection.ioc.run();
+
+    if (timedOut) {
+        ec = boost::beast::error::timeout;
+    }
+    if (ec) {
+        throw boost::system::system_error{ec};
+    }
+
+    ec = connection.runOperation(Timeouts.connectTimeout, [&](auto Handler) {
+        boost::beast::get_lowest_layer(connection.stream).async_connect(Results, Handler);
+    });
+
+    if (ec) {
+        throw boost::system::system_error{ec};
+    }
+
+    ec = connection.runOperation(Timeouts.handshakeTimeout, [&](auto Handler) {
+        connection.stream.async_handshake(boost::asio::ssl::stream_base::client, Handler);
+    });
+
+    if (ec) {
+        throw boost::system::system_error{ec};
+    }
+}
+
+void leetRequest::closeConnection(std::shared_ptr<leetRequest::Connection> connection) {
+    boost::system::error_code ec;
+
+    /* No TLS shutdown here. The connection is not going to be used again, and waiting
+     * for the server to acknowledge the shutdown would only hold up the caller.
+     */
+    boost::beast::get_lowest_layer(connection->stream).socket().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+    boost::beast::get_lowest_layer(connection->stream).socket().close(ec);
+}
+
+std::shared_ptr<leetRequest::Connection> leetRequest::ConnectionPool::acquire(const std::string& Host, const int Port) {
+    std::vector<std::shared_ptr<leetRequest::Connection>> Expired;
+    std::shared_ptr<leetRequest::Connection> connection;
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        auto& Idle = idleConnections[Host + ":" + std::to_string(Port)];
+        const auto Now = std::chrono::steady_clock::now();
 
-        if (userAgent.compare("")) httpRequest.set(boost::beast::http::field::user_agent, userAgent);
-        if (contentTypeHeaderData.compare("")) httpRequest.set(boost::beast::http::field::content_type, contentTypeHeaderData);
-        if (Body.compare("")) httpRequest.body() = Body;
-        if (Authentication) httpRequest.set(boost::beast::http::field::authorization, authenticationHeaderData);
+        while (!Idle.empty()) {
+            std::shared_ptr<leetRequest::Connection> theConnection = Idle.back();
+            Idle.pop_back();
 
-        for (int it{0}; it < static_cast<int>(headerName.size()); ++it) {
-            if (!headerName[it].compare("") || !headerData[it].compare("")) {
+            // the server has most likely closed it by now
+            if (Now - theConnection->lastUsed > idleTimeout) {
+                Expired.push_back(theConnection);
                 continue;
             }
 
-            httpRequest.set(headerName[it], headerData[it]);
+            connection = theConnection;
+            break;
         }
+    }
 
-        if (Filename.compare("")) {
-            std::filesystem::path fileName = Filename;
+    for (auto& it : Expired) {
+        leetRequest::closeConnection(it);
+    }
 
-            if (std::filesystem::exists(fileName)) {
-                std::ostringstream fileBody;
+    return connection;
+}
 
-                fileBody << std::ifstream(fileName, std::ios::binary).rdbuf();
+void leetRequest::ConnectionPool::release(std::shared_ptr<leetRequest::Connection> connection) {
+    connection->lastUsed = std::chrono::steady_clock::now();
 
-                std::string theBody{ std::move(fileBody).str() };
-                httpRequest.body() = theBody;
-                httpRequest.set(boost::beast::http::field::content_length, std::to_string(theBody.size()));
-            }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+
+        auto& Idle = idleConnections[connection->Key];
+
+        if (Idle.size() < maxIdlePerHost) {
+            Idle.push_back(connection);
+            return;
         }
+    }
 
-        httpRequest.target(Endpoint + Query);
+    leetRequest::closeConnection(connection);
+}
 
-        httpRequest.prepare_payload();
+void leetRequest::ConnectionPool::clear() {
+    std::map<std::string, std::vector<std::shared_ptr<leetRequest::Connection>>> Idle;
 
-        boost::beast::http::write(stream, httpRequest);
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        Idle.swap(idleConnections);
+    }
 
-        boost::beast::flat_buffer flat_buffer;
-        boost::beast::http::response_parser<boost::beast::http::dynamic_body> res;
-        res.body_limit((std::numeric_limits<std::uint64_t>::max)());
-        boost::beast::http::read(stream, flat_buffer, res);
+    for (auto& it : Idle) {
+        for (auto& connection : it.second) {
+            leetRequest::closeConnection(connection);
+        }
+    }
+}
+
+boost::beast::http::request<boost::beast::http::string_body> leetRequest::returnHTTPRequest(const leetRequest::Request& theRequest) {
+    boost::beast::http::verb theVerb;
+
+    switch (theRequest.Type) {
+        case leetRequest::LEET_REQUEST_REQTYPE_GET:
+            theVerb = boost::beast::http::verb::get;
+            break;
+        case leetRequest::LEET_REQUEST_REQTYPE_POST:
+            theVerb = boost::beast::http::verb::post;
+            break;
+        case leetRequest::LEET_REQUEST_REQTYPE_PUT:
+            theVerb = boost::beast::http::verb::put;
+            break;
+        case leetRequest::LEET_REQUEST_REQTYPE_DELETE:
+            theVerb = boost::beast::http::verb::delete_;
+            break;
+        default:
+            theVerb = boost::beast::http::verb::get;
+            break;
+    }
 
-        resp.statusCode = res.get().result_int();
-        resp.Body = boost::beast::buffers_to_string(res.get().body().data());
+    boost::beast::http::request<boost::beast::http::string_body> httpRequest{theVerb, theRequest.Host + std::to_string(theRequest.Port), 11};
+    httpRequest.set(boost::beast::http::field::host, theRequest.Host);
 
-        stream.next_layer().cancel();
-        stream.shutdown(ec);
-        stream.next_layer().close();
+    if (theRequest.userAgent.compare("")) httpRequest.set(boost::beast::http::field::user_agent, theRequest.userAgent);
+    if (theRequest.contentTypeHeaderData.compare("")) httpRequest.set(boost::beast::http::field::content_type, theRequest.contentTypeHeaderData);
+    if (theRequest.Body.compare("")) httpRequest.body() = theRequest.Body;
+    if (theRequest.Authentication) httpRequest.set(boost::beast::http::field::authorization, theRequest.authenticationHeaderData);
 
-        if (ec == boost::asio::error::eof) {
-            ec = {};
+    for (int it{0}; it < static_cast<int>(theRequest.headerName.size()); ++it) {
+        if (!theRequest.headerName[it].compare("") || !theRequest.headerData[it].compare("")) {
+            continue;
         }
-        if (ec == boost::asio::ssl::error::stream_truncated) {
-            return resp;
+
+        httpRequest.set(theRequest.headerName[it], theRequest.headerData[it]);
+    }
+
+    if (theRequest.Filename.compare("")) {
+        std::filesystem::path fileName = theRequest.Filename;
+
+        if (std::filesystem::exists(fileName)) {
+            std::ostringstream fileBody;
+
+            fileBody << std::ifstream(fileName, std::ios::binary).rdbuf();
+
+            std::string theBody{ std::move(fileBody).str() };
+            httpRequest.body() = theBody;
+            httpRequest.set(boost::beast::http::field::content_length, std::to_string(theBody.size()));
         }
-        if (ec) {
-            throw boost::beast::system_error{ec};
+    }
+
+    httpRequest.target(theRequest.Endpoint + theRequest.Query);
+
+    httpRequest.prepare_payload();
+
+    return httpRequest;
+}
+
+leetRequest::AsyncClient::AsyncClient() : State(std::make_shared<leetRequest::AsyncState>()) {
+}
+
+leetRequest::AsyncClient::~AsyncClient() {
+    stop();
+}
+
+void leetRequest::AsyncClient::makeRequest(const leetRequest::Request& theRequest, std::function<void(const leetRequest::Response&)> Callback) {
+    auto exchange = std::make_shared<leetRequest::AsyncExchange>(State, theRequest, std::move(Callback));
+
+    boost::asio::post(State->ioc, [exchange]() {
+        exchange->start();
+    });
+}
+
+void leetRequest::AsyncClient::post(std::function<void()> Function) {
+    boost::asio::post(State->ioc, std::move(Function));
+}
+
+void leetRequest::AsyncClient::postAfter(const std::chrono::milliseconds Delay, std::function<void()> Function) {
+    auto Timer = std::make_shared<boost::asio::steady_timer>(State->ioc, Delay);
+
+    Timer->async_wait([Timer, Function](const boost::system::error_code& ec) {
+        if (!ec) {
+            Function();
         }
+    });
+}
+
+void leetRequest::AsyncClient::run() {
+    State->maxIdlePerHost = maxIdlePerHost;
+    State->ioc.restart();
+    State->ioc.run();
+}
+
+void leetRequest::AsyncClient::stop() {
+    State->ioc.stop();
+}
+
+leetRequest::Response leetRequest::Request::makeRequest() {
+    leetRequest::Response resp;
+
+    const int theClass = endpointClass == LEET_REQUEST_CLASS_AUTO ? leetRequest::returnEndpointClass(Endpoint) : endpointClass;
+
+    try {
+        boost::beast::http::request<boost::beast::http::string_body> httpRequest = leetRequest::returnHTTPRequest(*this);
+
+        leetRequest::trafficShaper.waitFor(Host, theClass, httpRequest.body().size(), cancellationToken);
+
+        /* Try an idle connection from the pool first. If the server has closed it in the meantime,
+         * nothing will have been received, in which case the request is made again on a new connection,
+         * unless it is a POST which may already have reached the server.
+         */
+        for (int attempt{0}; attempt < 2; ++attempt) {
+            if (cancellationToken.isCancelled()) {
+                throw boost::system::system_error{boost::asio::error::operation_aborted};
+            }
+
+            std::shared_ptr<leetRequest::Connection> connection = attempt == 0 ? leetRequest::connectionPool.acquire(Host, Port) : nullptr;
+            const bool Reused = connection != nullptr;
+
+            if (!Reused) {
+                connection = leetRequest::createConnection(Host, Port);
+            }
+
+            std::optional<leetRequest::CancellationSubscription> Subscription{};
+            Subscription.emplace(cancellationToken, connection);
+
+            if (!Reused) {
+                leetRequest::connectConnection(*connection, Host, Port, Timeouts);
+            }
+
+            boost::system::error_code ec;
+            boost::beast::http::response_parser<boost::beast::http::buffer_body> res;
+            res.body_limit((std::numeric_limits<std::uint64_t>::max)()); // enforced below, once we know what kind of body it is
+
+            std::size_t Written{0};
+
+            ec = connection->runOperation(Timeouts.sendTimeout, [&](auto Handler) {
+                boost::beast::http::async_write(connection->stream, httpRequest, [&Written, Handler](const boost::system::error_code& theError, std::size_t Length) {
+                    Written = Length;
+                    Handler(theError, Length);
+                });
+            });
+
+            if (!ec) {
+                ec = connection->runOperation(Timeouts.headerTimeout, [&](auto Handler) {
+                    boost::beast::http::async_read_header(connection->stream, connection->Buffer, res, Handler);
+                });
+            }
+
+            if (ec) {
+                if (Reused && !res.got_some() && ec != boost::beast::error::timeout && !cancellationToken.isCancelled() && leetRequest::isRetrySafe(Type, Written)) {
+                    continue;
+                }
+
+                throw boost::system::system_error{ec};
+            }
+
+            resp.statusCode = res.get().result_int();
+            resp.contentType = std::string(res.get()[boost::beast::http::field::content_type]);
+
+            std::uint64_t theLimit = leetRequest::bodyLimits.defaultLimit;
+
+            if (bodyLimit >= 0) {
+                theLimit = static_cast<std::uint64_t>(bodyLimit);
+            } else if (theClass == LEET_REQUEST_CLASS_MEDIA) {
+                theLimit = leetRequest::bodyLimits.mediaLimit;
+            } else if (resp.contentType.find("json") != std::string::npos) {
+                theLimit = leetRequest::bodyLimits.jsonLimit;
+            }
+
+            if (res.content_length() && *res.content_length() > theLimit) {
+                throw boost::system::system_error{boost::beast::http::error::body_limit};
+            }
+
+            const std::uint64_t Threshold = streamThreshold >= 0 ? static_cast<std::uint64_t>(streamThreshold) : leetRequest::bodyLimits.streamThreshold;
+            bool Aborted{false};
+
+            // Hand the body to the consumer once it has grown past the threshold
+            auto Deliver = [&](const char* Data, const std::size_t Length) {
+                resp.bodySize += Length;
+
+                if (resp.bodySize > theLimit) {
+                    throw boost::system::system_error{boost::beast::http::error::body_limit};
+                }
+
+                if (bodyConsumer && !resp.Streamed && resp.bodySize > Threshold) {
+                    resp.Streamed = true;
+
+                    if (!resp.Body.empty() && !bodyConsumer(resp.Body.data(), resp.Body.size())) {
+                        return false;
+                    }
+
+                    if (!keepStreamedBody) {
+                        resp.Body.clear();
+                        resp.Body.shrink_to_fit();
+                    }
+                }
+
+                if (resp.Streamed) {
+                    if (keepStreamedBody) {
+                        resp.Body.append(Data, Length);
+                    }
+
+                    return bodyConsumer(Data, Length);
+                }
+
+                resp.Body.append(Data, Length);
 
-        return resp;
-    } catch (boost::wrapexcept<boost::system::system_error> const &e) {
+                return true;
+            };
+
+            char Chunk[65536];
+
+            while (!res.is_done()) {
+                res.get().body().data = Chunk;
+                res.get().body().size = sizeof(Chunk);
+
+                ec = connection->runOperation(Timeouts.bodyTimeout, [&](auto Handler) {
+                    boost::beast::http::async_read(connection->stream, connection->Buffer, res, Handler);
+                });
+
+                if (ec == boost::beast::http::error::need_buffer) {
+                    ec = {};
+                }
+                if (ec) {
+                    throw boost::system::system_error{ec};
+                }
+
+                const std::size_t Length = sizeof(Chunk) - res.get().body().size;
+
+                if (Length && !Deliver(Chunk, Length)) {
+                    Aborted = true;
+                    break;
+                }
+            }
+
+            leetRequest::trafficShaper.consume(Host, theClass, resp.bodySize);
+
+            // The next borrower mustn't be reached by a cancel of this request
+            Subscription.reset();
+
+            if (!Aborted && res.keep_alive() && !cancellationToken.isCancelled()) {
+                boost::beast::get_lowest_layer(connection->stream).expires_never();
+                leetRequest::connectionPool.release(connection);
+            } else {
+                leetRequest::closeConnection(connection);
+            }
+
+            return resp;
+        }
+    } catch (boost::system::system_error const &e) {
         std::cout << e.what();
+
+        resp.statusCode = 0;
+        resp.networkError = e.what();
+        resp.Body.clear();
+        resp.timedOut = e.code() == boost::beast::error::timeout;
+        resp.Cancelled = cancellationToken.isCancelled();
+    }
+
+    return resp;
+}
+
+leetRequest::Response leetRequest::Request::makeRequest(const std::function<void(std::istream&)>& Reader) {
+    leetRequest::ChunkBuffer Buffer{};
+    std::exception_ptr readerException{};
+
+    // Parsing happens on another thread, so it overlaps with receiving the rest of the body
+    std::thread readerThread([&]() {
+        std::istream Stream(&Buffer);
+
+        try {
+            Reader(Stream);
+        } catch (...) {
+            readerException = std::current_exception();
+        }
+
+        Buffer.abandon();
+    });
+
+    const auto previousConsumer = bodyConsumer;
+    const auto previousThreshold = streamThreshold;
+
+    bodyConsumer = [&Buffer](const char* Data, const std::size_t Length) {
+        return Buffer.push(Data, Length);
+    };
+    streamThreshold = 0;
+
+    leetRequest::Response resp{};
+
+    try {
+        resp = makeRequest();
+    } catch (...) {
+        Buffer.finish();
+        readerThread.join();
+
+        bodyConsumer = previousConsumer;
+        streamThreshold = previousThreshold;
+
+        throw;
+    }
+
+    Buffer.finish();
+    readerThread.join();
+
+    bodyConsumer = previousConsumer;
+    streamThreshold = previousThreshold;
+
+    if (readerException) {
+        std::rethrow_exception(readerException);
     }
 
     return resp;
@@ -207,10 +1307,31 @@ leetRequest::Response leetRequest::Request::makeRequest() {
 const bool leetRequest::Request::downloadFile() {
     if (!outputFile.compare("")) return false;
 
-    leetRequest::Response resp = makeRequest();
-
     std::ofstream of(outputFile, std::ios::binary);
-    of << resp.Body;
+
+    const auto previousConsumer = bodyConsumer;
+    const auto previousThreshold = streamThreshold;
+
+    // Write the file as it is received rather than holding all of it in memory
+    streamThreshold = 0;
+    bodyConsumer = [&](const char* Data, const std::size_t Length) {
+        of.write(Data, static_cast<std::streamsize>(Length));
+        return of.good();
+    };
+
+    leetRequest::Response resp{};
+
+    try {
+        resp = makeRequest();
+    } catch (...) {
+        bodyConsumer = previousConsumer;
+        streamThreshold = previousThreshold;
+
+        throw;
+    }
+
+    bodyConsumer = previousConsumer;
+    streamThreshold = previousThreshold;
 
     if (resp.statusCode == 200) {
         return true;